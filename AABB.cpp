@@ -0,0 +1,57 @@
+#include <algorithm>
+#include <limits>
+#include "AABB.h"
+
+AABB :: AABB()
+    : min(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max()),
+      max(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max()) {}
+
+AABB :: AABB(const Vector& min, const Vector& max) : min(min), max(max) {}
+
+void AABB :: expand(const Vector& point) {
+    min = Vector(std::min(min.x, point.x), std::min(min.y, point.y), std::min(min.z, point.z));
+    max = Vector(std::max(max.x, point.x), std::max(max.y, point.y), std::max(max.z, point.z));
+}
+
+void AABB :: expand(const AABB& other) {
+    min = Vector(std::min(min.x, other.min.x), std::min(min.y, other.min.y), std::min(min.z, other.min.z));
+    max = Vector(std::max(max.x, other.max.x), std::max(max.y, other.max.y), std::max(max.z, other.max.z));
+}
+
+bool AABB :: isEmpty() const {
+    return min.x > max.x || min.y > max.y || min.z > max.z;
+}
+
+Vector AABB :: centroid() const {
+    return Vector((min.x + max.x) * 0.5f, (min.y + max.y) * 0.5f, (min.z + max.z) * 0.5f);
+}
+
+float AABB :: surfaceArea() const {
+    if (isEmpty()) return 0.0f;
+    float dx = max.x - min.x;
+    float dy = max.y - min.y;
+    float dz = max.z - min.z;
+    return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+int AABB :: longestAxis() const {
+    float dx = max.x - min.x;
+    float dy = max.y - min.y;
+    float dz = max.z - min.z;
+    if (dx >= dy && dx >= dz) return 0;
+    return dy >= dz ? 1 : 2;
+}
+
+bool intersectBox(const AABB& box, const Vector& origin, const Vector& invDirection, float tMax, float& tNear) {
+    float tx0 = (box.min.x - origin.x) * invDirection.x;
+    float tx1 = (box.max.x - origin.x) * invDirection.x;
+    float ty0 = (box.min.y - origin.y) * invDirection.y;
+    float ty1 = (box.max.y - origin.y) * invDirection.y;
+    float tz0 = (box.min.z - origin.z) * invDirection.z;
+    float tz1 = (box.max.z - origin.z) * invDirection.z;
+
+    float tEnter = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), 0.0f));
+    float tExit = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), tMax));
+    tNear = tEnter;
+    return tEnter <= tExit;
+}
@@ -0,0 +1,27 @@
+// AABB.h
+#ifndef AABB_H
+#define AABB_H
+
+#include "Vector.h"
+
+// axis aligned bounding box. a default constructed box is empty and grows with expand
+struct AABB {
+    Vector min;
+    Vector max;
+
+    AABB();
+    AABB(const Vector& min, const Vector& max);
+
+    void expand(const Vector& point);
+    void expand(const AABB& other);
+    bool isEmpty() const;
+    Vector centroid() const;
+    float surfaceArea() const;
+    int longestAxis() const;
+};
+
+// slab test against a box given the ray origin and 1/direction. returns true when
+// the ray overlaps the box somewhere in [0, tMax], and sets tNear to the entry distance
+bool intersectBox(const AABB& box, const Vector& origin, const Vector& invDirection, float tMax, float& tNear);
+
+#endif // AABB_H
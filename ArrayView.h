@@ -0,0 +1,29 @@
+// ArrayView.h
+#ifndef ARRAYVIEW_H
+#define ARRAYVIEW_H
+
+#include <cstddef>
+#include <vector>
+
+// read-only array that does not own its elements: they live in a std::vector kept
+// by the owner of the view, or in a memory mapped scene cache
+template <class T>
+class ArrayView {
+public:
+    ArrayView() : values(nullptr), length(0) {}
+    ArrayView(const T* values, std::size_t length) : values(values), length(length) {}
+    ArrayView(const std::vector<T>& vector) : values(vector.data()), length(vector.size()) {}
+
+    const T& operator[](std::size_t index) const { return values[index]; }
+    const T* data() const { return values; }
+    std::size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+    const T* begin() const { return values; }
+    const T* end() const { return values + length; }
+
+private:
+    const T* values;
+    std::size_t length;
+};
+
+#endif // ARRAYVIEW_H
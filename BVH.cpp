@@ -0,0 +1,491 @@
+#include <algorithm>
+#include <future>
+#include <limits>
+#include <thread>
+#include "BVH.h"
+#include "Object.h"
+#include "PrimitiveStore.h"
+#include "Kernels.h"
+#include "TriangleMesh.h"
+#include "Instance.h"
+#include "RenderStats.h"
+
+namespace {
+
+const int kBinCount = 16;
+const int kMaxLeafSize = 8;
+const int kParallelMinRefs = 4096;
+const int kMaxDepth = 64;
+const int kStackSize = kMaxDepth + 1;
+
+struct BuildRef {
+    AABB box;
+    Vector centroid;
+    int index;
+    int type;
+};
+
+struct Bin {
+    AABB box;
+    int count = 0;
+};
+
+float axisValue(const Vector& v, int axis) {
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+//appends the subtree for refs[begin, end) to nodes and returns the index of its root
+int buildNode(std::vector<BuildRef>& refs, int begin, int end, std::vector<BVHNode>& nodes, int depth, int parallelDepth) {
+    AABB box, centroidBox;
+    bool mixed = false;
+    for (int k = begin; k < end; k++) {
+        box.expand(refs[k].box);
+        centroidBox.expand(refs[k].centroid);
+        mixed = mixed || refs[k].type != refs[begin].type;
+    }
+
+    int nodeIndex = (int)nodes.size();
+    nodes.push_back(BVHNode{box, begin, end - begin});
+    int count = end - begin;
+    if (count <= kMaxLeafSize && !mixed) {
+        return nodeIndex;
+    }
+
+    //binned SAH: bin the centroids along each axis and sweep for the cheapest split plane
+    int bestAxis = -1;
+    int bestSplit = 0;
+    float bestCost = std::numeric_limits<float>::max();
+    for (int axis = 0; axis < 3; axis++) {
+        float lo = axisValue(centroidBox.min, axis);
+        float hi = axisValue(centroidBox.max, axis);
+        if (hi - lo < 1e-12f) continue;
+        float scale = kBinCount / (hi - lo);
+
+        Bin bins[kBinCount];
+        for (int k = begin; k < end; k++) {
+            int b = std::min(kBinCount - 1, (int)((axisValue(refs[k].centroid, axis) - lo) * scale));
+            bins[b].count++;
+            bins[b].box.expand(refs[k].box);
+        }
+
+        float leftArea[kBinCount - 1];
+        int leftCount[kBinCount - 1];
+        AABB leftBox;
+        int leftSum = 0;
+        for (int b = 0; b < kBinCount - 1; b++) {
+            leftBox.expand(bins[b].box);
+            leftSum += bins[b].count;
+            leftArea[b] = leftBox.surfaceArea();
+            leftCount[b] = leftSum;
+        }
+        AABB rightBox;
+        int rightSum = 0;
+        for (int b = kBinCount - 1; b > 0; b--) {
+            rightBox.expand(bins[b].box);
+            rightSum += bins[b].count;
+            if (leftCount[b - 1] == 0 || rightSum == 0) continue;
+            float cost = leftArea[b - 1] * leftCount[b - 1] + rightBox.surfaceArea() * rightSum;
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = b;
+            }
+        }
+    }
+
+    int middle = -1;
+    float leafCost = box.surfaceArea() * count;
+    bool sahLeaf = false;
+    if (bestAxis >= 0 && depth < kMaxDepth / 2) {
+        //one traversal step costs about as much as one object test
+        sahLeaf = box.surfaceArea() + bestCost >= leafCost && count <= 4 * kMaxLeafSize;
+        if (sahLeaf && !mixed) {
+            return nodeIndex;
+        }
+        if (!sahLeaf) {
+            float lo = axisValue(centroidBox.min, bestAxis);
+            float scale = kBinCount / (axisValue(centroidBox.max, bestAxis) - lo);
+            auto split = std::partition(refs.begin() + begin, refs.begin() + end, [&](const BuildRef& ref) {
+                int b = std::min(kBinCount - 1, (int)((axisValue(ref.centroid, bestAxis) - lo) * scale));
+                return b < bestSplit;
+            });
+            middle = (int)(split - refs.begin());
+        }
+    }
+    if (middle < 0) {
+        if (mixed) {
+            //a leaf may only hold one primitive type, split off the first type
+            int firstType = refs[begin].type;
+            auto split = std::partition(refs.begin() + begin, refs.begin() + end,
+                                        [&](const BuildRef& ref) { return ref.type == firstType; });
+            middle = (int)(split - refs.begin());
+        } else {
+            //all centroids coincide (or the tree got too deep), just halve the list
+            middle = begin + count / 2;
+        }
+    }
+
+    nodes[nodeIndex].count = 0;
+    int rightIndex;
+    if (parallelDepth > 0 && count >= kParallelMinRefs) {
+        //build the right half on another thread into its own array, then append it
+        std::vector<BVHNode> rightNodes;
+        auto rightTask = std::async(std::launch::async, [&] {
+            buildNode(refs, middle, end, rightNodes, depth + 1, parallelDepth - 1);
+        });
+        buildNode(refs, begin, middle, nodes, depth + 1, parallelDepth - 1);
+        rightTask.get();
+
+        rightIndex = (int)nodes.size();
+        for (BVHNode node : rightNodes) {
+            if (node.count == 0) node.leftFirst += rightIndex;
+            nodes.push_back(node);
+        }
+    } else {
+        buildNode(refs, begin, middle, nodes, depth + 1, parallelDepth);
+        rightIndex = buildNode(refs, middle, end, nodes, depth + 1, parallelDepth);
+    }
+    nodes[nodeIndex].leftFirst = rightIndex;
+    return nodeIndex;
+}
+
+Vector inverseDirection(const Vector& d) {
+    return Vector(1.0f / d.x, 1.0f / d.y, 1.0f / d.z);
+}
+
+}
+
+BVH :: BVH() {}
+
+void BVH :: build(const std::vector<Object*>& objects, int threadCount) {
+    nodeStorage.clear();
+    primIndexStorage.clear();
+    unboundedStorage.clear();
+    nodes = ArrayView<BVHNode>();
+    primIndices = ArrayView<int>();
+
+    std::vector<BuildRef> refs;
+    refs.reserve(objects.size());
+    for (int i = 0; i < (int)objects.size(); i++) {
+        AABB box;
+        if (visitObject(*objects[i], [&box](const auto& object) { return object.bounds(box); })) {
+            refs.push_back(BuildRef{box, box.centroid(), i, objects[i]->type()});
+        } else {
+            unboundedStorage.push_back(i);
+        }
+    }
+    unbounded = unboundedStorage;
+    if (refs.empty()) return;
+
+    if (threadCount <= 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+    int parallelDepth = 0;
+    while ((1 << parallelDepth) < threadCount) parallelDepth++;
+
+    nodeStorage.reserve(2 * refs.size() / kMaxLeafSize + 1);
+    buildNode(refs, 0, (int)refs.size(), nodeStorage, 0, parallelDepth);
+
+    primIndexStorage.resize(refs.size());
+    for (size_t k = 0; k < refs.size(); k++) {
+        primIndexStorage[k] = refs[k].index;
+    }
+    nodes = nodeStorage;
+    primIndices = primIndexStorage;
+}
+
+void buildBoxTree(const std::vector<AABB>& boxes, std::vector<BVHNode>& nodes, std::vector<int>& order,
+                  int threadCount) {
+    nodes.clear();
+    order.clear();
+    if (boxes.empty()) return;
+    std::vector<BuildRef> refs(boxes.size());
+    for (std::size_t k = 0; k < boxes.size(); k++) refs[k] = BuildRef{boxes[k], boxes[k].centroid(), (int)k, 0};
+
+    if (threadCount <= 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+    int parallelDepth = 0;
+    while ((1 << parallelDepth) < threadCount) parallelDepth++;
+    nodes.reserve(2 * refs.size() / kMaxLeafSize + 1);
+    buildNode(refs, 0, (int)refs.size(), nodes, 0, parallelDepth);
+
+    order.resize(refs.size());
+    for (std::size_t k = 0; k < refs.size(); k++) order[k] = refs[k].index;
+}
+
+void BVH :: closestHit(const Ray& ray, const PrimitiveStore& store, HitRecord& hit) const {
+    KernelRay kernelRay{ray.origin.x, ray.origin.y, ray.origin.z, ray.direction.x, ray.direction.y, ray.direction.z};
+    countStat(STAT_PLANE_TESTS, store.planes.count);
+    closestPlanes(store.planes, kernelRay, hit.t, hit.primitive);
+    if (nodes.empty()) return;
+    closestFrom(0, store, kernelRay, inverseDirection(ray.direction), hit.t, hit.primitive);
+}
+
+void BVH :: closestFrom(int root, const PrimitiveStore& store, const KernelRay& ray, const Vector& invDirection,
+                        float& tBest, int& idBest) const {
+    const KernelTable& kernels = activeKernels();
+    Vector origin(ray.ox, ray.oy, ray.oz);
+    float tNear;
+    TraversalCounts counts;
+    counts.boxes++;
+    if (!intersectBox(nodes[root].box, origin, invDirection, tBest, tNear)) return;
+
+    int stack[kStackSize];
+    int stackSize = 0;
+    int current = root;
+    while (true) {
+        const BVHNode& node = nodes[current];
+        if (node.count > 0) {
+            int slot = store.slots[node.leftFirst];
+            counts.primitives[store.types[node.leftFirst]] += node.count;
+            if (store.types[node.leftFirst] == PRIMITIVE_SPHERE) {
+                kernels.closestSpheres(store.sphereSoA, slot, node.count, ray, tBest, idBest);
+            } else if (store.types[node.leftFirst] == PRIMITIVE_MESH) {
+                closestMeshes(store.meshSoA, slot, node.count, ray, tBest, idBest);
+            } else if (store.types[node.leftFirst] == PRIMITIVE_INSTANCE) {
+                closestInstances(store.instanceSoA, slot, node.count, ray, tBest, idBest);
+            } else {
+                kernels.closestCylinders(store.cylinderSoA, slot, node.count, ray, tBest, idBest);
+            }
+        } else {
+            //visit the nearer child first, so the far one is often culled by the closer hit
+            int left = current + 1;
+            int right = node.leftFirst;
+            float tLeft, tRight;
+            counts.boxes += 2;
+            bool hitLeft = intersectBox(nodes[left].box, origin, invDirection, tBest, tLeft);
+            bool hitRight = intersectBox(nodes[right].box, origin, invDirection, tBest, tRight);
+            if (hitLeft && hitRight) {
+                if (tRight < tLeft) std::swap(left, right);
+                stack[stackSize++] = right;
+                current = left;
+                continue;
+            }
+            if (hitLeft) { current = left; continue; }
+            if (hitRight) { current = right; continue; }
+        }
+
+        //pop the next node that can still hold a closer hit
+        bool found = false;
+        while (stackSize > 0) {
+            current = stack[--stackSize];
+            counts.boxes++;
+            if (intersectBox(nodes[current].box, origin, invDirection, tBest, tNear)) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) break;
+    }
+}
+
+bool BVH :: anyHit(const Ray& ray, const PrimitiveStore& store, float tMax, int* occluder) const {
+    KernelRay kernelRay{ray.origin.x, ray.origin.y, ray.origin.z, ray.direction.x, ray.direction.y, ray.direction.z};
+    countStat(STAT_PLANE_TESTS, store.planes.count);
+    if (occludedPlanes(store.planes, kernelRay, tMax)) {
+        if (occluder) {
+            for (int id : unbounded) {
+                if (store.occludedBy(id, kernelRay, tMax)) {
+                    *occluder = id;
+                    break;
+                }
+            }
+        }
+        return true;
+    }
+    if (nodes.empty()) return false;
+    return anyFrom(0, store, kernelRay, inverseDirection(ray.direction), tMax, occluder);
+}
+
+bool BVH :: anyFrom(int root, const PrimitiveStore& store, const KernelRay& ray, const Vector& invDirection,
+                    float tMax, int* occluder) const {
+    const KernelTable& kernels = activeKernels();
+    Vector origin(ray.ox, ray.oy, ray.oz);
+    TraversalCounts counts;
+    int stack[kStackSize];
+    int stackSize = 0;
+    stack[stackSize++] = root;
+    while (stackSize > 0) {
+        int current = stack[--stackSize];
+        const BVHNode& node = nodes[current];
+        float tNear;
+        counts.boxes++;
+        if (!intersectBox(node.box, origin, invDirection, tMax, tNear)) continue;
+        if (node.count > 0) {
+            int slot = store.slots[node.leftFirst];
+            counts.primitives[store.types[node.leftFirst]] += node.count;
+            bool occluded;
+            if (store.types[node.leftFirst] == PRIMITIVE_SPHERE) {
+                occluded = kernels.occludedSpheres(store.sphereSoA, slot, node.count, ray, tMax);
+            } else if (store.types[node.leftFirst] == PRIMITIVE_MESH) {
+                occluded = occludedMeshes(store.meshSoA, slot, node.count, ray, tMax);
+            } else if (store.types[node.leftFirst] == PRIMITIVE_INSTANCE) {
+                occluded = occludedInstances(store.instanceSoA, slot, node.count, ray, tMax);
+            } else {
+                occluded = kernels.occludedCylinders(store.cylinderSoA, slot, node.count, ray, tMax);
+            }
+            if (occluded) {
+                //which one: tested again alone, only for the leaf that blocks the ray
+                for (int k = node.leftFirst; occluder && k < node.leftFirst + node.count; k++) {
+                    if (store.occludedBy(primIndices[k], ray, tMax)) {
+                        *occluder = primIndices[k];
+                        break;
+                    }
+                }
+                return true;
+            }
+        } else {
+            stack[stackSize++] = node.leftFirst;
+            stack[stackSize++] = current + 1;
+        }
+    }
+    return false;
+}
+
+namespace {
+
+//below this many rays on a node the packet is considered diverged
+const int kMinPacketRays = 3;
+
+struct PacketEntry {
+    int node;
+    uint64_t rays;
+};
+
+KernelRay packetRay(const RayPacket& packet, int k) {
+    return KernelRay{packet.ox[k], packet.oy[k], packet.oz[k], packet.dx[k], packet.dy[k], packet.dz[k]};
+}
+
+Vector packetInverse(const RayPacket& packet, int k) {
+    return Vector(packet.invDx[k], packet.invDy[k], packet.invDz[k]);
+}
+
+int lowestRay(uint64_t rays) {
+    return __builtin_ctzll(rays);
+}
+
+}
+
+void BVH :: closestHitPacket(RayPacket& packet, const PrimitiveStore& store, uint64_t rays) const {
+    const KernelTable& kernels = activeKernels();
+    countStat(STAT_PLANE_TESTS, (uint64_t)store.planes.count * __builtin_popcountll(rays));
+    for (uint64_t left = rays; left; left &= left - 1) {
+        int k = lowestRay(left);
+        closestPlanes(store.planes, packetRay(packet, k), packet.t[k], packet.id[k]);
+    }
+    if (nodes.empty()) return;
+
+    TraversalCounts counts;
+    PacketEntry stack[kStackSize];
+    int stackSize = 0;
+    stack[stackSize++] = PacketEntry{0, rays};
+    while (stackSize > 0) {
+        PacketEntry entry = stack[--stackSize];
+        const BVHNode& node = nodes[entry.node];
+        counts.boxes += __builtin_popcountll(entry.rays);
+        uint64_t active = kernels.boxPacket(&node.box.min.x, &node.box.max.x, packet, entry.rays);
+        if (!active) continue;
+
+        if (__builtin_popcountll(active) < kMinPacketRays) {
+            //diverged: the few rays left finish this subtree on their own
+            for (uint64_t left = active; left; left &= left - 1) {
+                int k = lowestRay(left);
+                closestFrom(entry.node, store, packetRay(packet, k), packetInverse(packet, k), packet.t[k], packet.id[k]);
+            }
+            continue;
+        }
+
+        if (node.count > 0) {
+            int slot = store.slots[node.leftFirst];
+            counts.primitives[store.types[node.leftFirst]] += (uint64_t)node.count * __builtin_popcountll(active);
+            if (store.types[node.leftFirst] == PRIMITIVE_SPHERE) {
+                kernels.closestSpheresPacket(store.sphereSoA, slot, node.count, packet, active);
+            } else if (store.types[node.leftFirst] == PRIMITIVE_MESH) {
+                //meshes and instances have no packet kernel, their own tree is walked ray by ray
+                for (uint64_t left = active; left; left &= left - 1) {
+                    int k = lowestRay(left);
+                    closestMeshes(store.meshSoA, slot, node.count, packetRay(packet, k), packet.t[k], packet.id[k]);
+                }
+            } else if (store.types[node.leftFirst] == PRIMITIVE_INSTANCE) {
+                for (uint64_t left = active; left; left &= left - 1) {
+                    int k = lowestRay(left);
+                    closestInstances(store.instanceSoA, slot, node.count, packetRay(packet, k), packet.t[k], packet.id[k]);
+                }
+            } else {
+                kernels.closestCylindersPacket(store.cylinderSoA, slot, node.count, packet, active);
+            }
+            continue;
+        }
+
+        //the packet's rays point the same way, let its first ray pick the nearer child
+        int left = entry.node + 1;
+        int right = node.leftFirst;
+        int k = lowestRay(active);
+        Vector toRight = nodes[right].box.centroid() - nodes[left].box.centroid();
+        if (toRight.x * packet.dx[k] + toRight.y * packet.dy[k] + toRight.z * packet.dz[k] < 0) {
+            std::swap(left, right);
+        }
+        stack[stackSize++] = PacketEntry{right, active};
+        stack[stackSize++] = PacketEntry{left, active};
+    }
+}
+
+uint64_t BVH :: anyHitPacket(const RayPacket& packet, const PrimitiveStore& store, uint64_t rays) const {
+    const KernelTable& kernels = activeKernels();
+    uint64_t occluded = 0;
+    countStat(STAT_PLANE_TESTS, (uint64_t)store.planes.count * __builtin_popcountll(rays));
+    for (uint64_t left = rays; left; left &= left - 1) {
+        int k = lowestRay(left);
+        if (occludedPlanes(store.planes, packetRay(packet, k), packet.t[k])) occluded |= 1ull << k;
+    }
+    if (nodes.empty()) return occluded;
+
+    TraversalCounts counts;
+    PacketEntry stack[kStackSize];
+    int stackSize = 0;
+    stack[stackSize++] = PacketEntry{0, rays & ~occluded};
+    while (stackSize > 0 && occluded != rays) {
+        PacketEntry entry = stack[--stackSize];
+        uint64_t live = entry.rays & ~occluded;
+        if (!live) continue;
+        const BVHNode& node = nodes[entry.node];
+        counts.boxes += __builtin_popcountll(live);
+        uint64_t active = kernels.boxPacket(&node.box.min.x, &node.box.max.x, packet, live);
+        if (!active) continue;
+
+        if (__builtin_popcountll(active) < kMinPacketRays) {
+            for (uint64_t left = active; left; left &= left - 1) {
+                int k = lowestRay(left);
+                if (anyFrom(entry.node, store, packetRay(packet, k), packetInverse(packet, k), packet.t[k])) {
+                    occluded |= 1ull << k;
+                }
+            }
+            continue;
+        }
+
+        if (node.count > 0) {
+            int slot = store.slots[node.leftFirst];
+            counts.primitives[store.types[node.leftFirst]] += (uint64_t)node.count * __builtin_popcountll(active);
+            if (store.types[node.leftFirst] == PRIMITIVE_SPHERE) {
+                occluded |= kernels.occludedSpheresPacket(store.sphereSoA, slot, node.count, packet, active);
+            } else if (store.types[node.leftFirst] == PRIMITIVE_MESH) {
+                for (uint64_t left = active; left; left &= left - 1) {
+                    int k = lowestRay(left);
+                    if (occludedMeshes(store.meshSoA, slot, node.count, packetRay(packet, k), packet.t[k])) {
+                        occluded |= 1ull << k;
+                    }
+                }
+            } else if (store.types[node.leftFirst] == PRIMITIVE_INSTANCE) {
+                for (uint64_t left = active; left; left &= left - 1) {
+                    int k = lowestRay(left);
+                    if (occludedInstances(store.instanceSoA, slot, node.count, packetRay(packet, k), packet.t[k])) {
+                        occluded |= 1ull << k;
+                    }
+                }
+            } else {
+                occluded |= kernels.occludedCylindersPacket(store.cylinderSoA, slot, node.count, packet, active);
+            }
+            continue;
+        }
+        stack[stackSize++] = PacketEntry{node.leftFirst, active};
+        stack[stackSize++] = PacketEntry{entry.node + 1, active};
+    }
+    return occluded;
+}
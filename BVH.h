@@ -0,0 +1,71 @@
+// BVH.h
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include "AABB.h"
+#include "ArrayView.h"
+#include "Ray.h"
+#include "RayPacket.h"
+#include "Intersection.h"
+
+class Object;
+class PrimitiveStore;
+struct KernelRay;
+
+// 32 byte node of the flattened tree. nodes are stored depth first, so the left
+// child of an interior node is always the node right after it
+struct BVHNode {
+    AABB box;
+    int leftFirst;  // interior: index of the right child, leaf: first entry in BVH::primIndices
+    int count;      // number of objects in a leaf, 0 for interior nodes
+};
+
+// bounding volume hierarchy over the scene objects, built with a binned SAH.
+// objects without a finite box (planes) are kept in a separate list that every ray tests.
+// every leaf holds a single primitive type, so the traversal can hand it to one
+// SIMD kernel over the matching PrimitiveStore arrays
+class BVH {
+public:
+    BVH();
+
+    // threadCount 0 = one per hardware thread
+    void build(const std::vector<Object*>& objects, int threadCount = 0);
+
+    // lowers hit to the closest hit over all primitives in store that is not farther
+    // than hit.t. on equal distances the primitive that comes first in the scene wins
+    void closestHit(const Ray& ray, const PrimitiveStore& store, HitRecord& hit) const;
+    // true when any primitive is hit closer than tMax. occluder, when given, is set to the
+    // ID of the primitive that was found
+    bool anyHit(const Ray& ray, const PrimitiveStore& store, float tMax, int* occluder = nullptr) const;
+
+    // packet versions of the two queries above for the rays in the mask rays. the
+    // packet walks the tree as long as enough of its rays agree on a node; below
+    // that the remaining rays finish the subtree one by one
+    void closestHitPacket(RayPacket& packet, const PrimitiveStore& store, uint64_t rays) const;
+    // returns the mask of rays that are blocked before their t
+    uint64_t anyHitPacket(const RayPacket& packet, const PrimitiveStore& store, uint64_t rays) const;
+
+    // views of the tree, into the arrays below after build() or into a mapped scene cache
+    ArrayView<BVHNode> nodes;
+    ArrayView<int> primIndices;  // object indices, referenced by the leaves
+    ArrayView<int> unbounded;    // object indices of the objects without a box
+
+private:
+    std::vector<BVHNode> nodeStorage;
+    std::vector<int> primIndexStorage;
+    std::vector<int> unboundedStorage;
+
+    void closestFrom(int root, const PrimitiveStore& store, const KernelRay& ray, const Vector& invDirection,
+                     float& tBest, int& idBest) const;
+    bool anyFrom(int root, const PrimitiveStore& store, const KernelRay& ray, const Vector& invDirection,
+                 float tMax, int* occluder = nullptr) const;
+};
+
+// the same binned SAH tree over plain boxes, for the structures that keep their own tree
+// (triangle meshes). nodes get the layout of BVH::nodes, a leaf referencing [leftFirst,
+// leftFirst + count) of order, which lists the box indices in leaf order
+void buildBoxTree(const std::vector<AABB>& boxes, std::vector<BVHNode>& nodes, std::vector<int>& order,
+                  int threadCount = 0);
+
+#endif // BVH_H
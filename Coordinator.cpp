@@ -0,0 +1,297 @@
+#include "Coordinator.h"
+#include "PartialImage.h"
+#include "Render.h"
+#include "Server.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+//bands per worker: enough that a slow band does not hold the others up for long
+static const int kBandsPerWorker = 4;
+//a band still running after this many times the mean band time is rendered again by an idle worker
+static const double kSlowBand = 1.5;
+//times a failing band is tried before the render is given up
+static const int kMaxAttempts = 3;
+
+namespace {
+
+struct Band {
+    int y0, y1;              // rows [y0, y1), row 0 at the top
+    bool done = false;
+    int running = 0;         // workers rendering it now
+    int attempts = 0;
+    double started = 0;      // when the copy that runs now started
+    std::string part;        // the partial image that is used
+};
+
+struct Worker {
+    pid_t pid = -1;
+    int input = -1;          // the worker's stdin
+    int output = -1;         // the worker's stdout
+    std::string pending;     // output read that is not a whole line yet
+    int band = -1;           // the band it renders, -1 when idle
+    std::string part;        // where that band goes
+    double started = 0;
+    bool alive = false;
+};
+
+double seconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//the command line of the workers: this one in --serve mode, without what concerns the
+//coordinator's own output
+std::vector<std::string> workerArguments(const RenderOptions& options, int argc, char* argv[]) {
+    std::vector<std::string> arguments = {argv[0], "--serve"};
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--workers" || arg == "--output" || arg == "--aa-heatmap" || arg == "--stats-json" ||
+            arg == "--sequence") {
+            i++;
+        } else if (arg == "--crop") {
+            i += 4;
+        } else if (arg != "--stats" && arg != "--watch") {
+            arguments.push_back(arg);
+        }
+    }
+    //the workers share the cores, unless --threads says how many each one gets
+    if (options.threads == 0) {
+        arguments.push_back("--threads");
+        arguments.push_back(std::to_string(std::max(1, ThreadPool::defaultThreadCount() / options.workers)));
+    }
+    return arguments;
+}
+
+bool startWorker(const std::vector<std::string>& arguments, Worker& worker) {
+    //close on exec, so no worker holds the pipes of another one open
+    int toWorker[2], fromWorker[2];
+    if (pipe2(toWorker, O_CLOEXEC) != 0) return false;
+    if (pipe2(fromWorker, O_CLOEXEC) != 0) {
+        close(toWorker[0]);
+        close(toWorker[1]);
+        return false;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(toWorker[0], STDIN_FILENO);
+        dup2(fromWorker[1], STDOUT_FILENO);
+        std::vector<char*> argv;
+        for (const std::string& argument : arguments) argv.push_back(const_cast<char*>(argument.c_str()));
+        argv.push_back(nullptr);
+        execv("/proc/self/exe", argv.data());
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+    close(toWorker[0]);
+    close(fromWorker[1]);
+    if (pid < 0) {
+        close(toWorker[1]);
+        close(fromWorker[0]);
+        return false;
+    }
+    worker.pid = pid;
+    worker.input = toWorker[1];
+    worker.output = fromWorker[0];
+    worker.alive = true;
+    return true;
+}
+
+bool sendLine(int fd, const std::string& line) {
+    std::size_t sent = 0;
+    while (sent < line.size()) {
+        ssize_t count = write(fd, line.data() + sent, line.size() - sent);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return false;
+        sent += count;
+    }
+    return true;
+}
+
+//the band an idle worker should render: one nobody renders yet, else the band that has
+//been running longest if it is slow. -1 when there is nothing worth doing
+int pickBand(const std::vector<Band>& bands, const std::vector<double>& bandTimes, double now) {
+    for (std::size_t b = 0; b < bands.size(); b++) {
+        if (!bands[b].done && bands[b].running == 0 && bands[b].attempts < kMaxAttempts) return (int)b;
+    }
+    if (bandTimes.empty()) return -1;
+    double mean = 0;
+    for (double time : bandTimes) mean += time;
+    mean /= bandTimes.size();
+    int slowest = -1;
+    for (std::size_t b = 0; b < bands.size(); b++) {
+        if (bands[b].done || bands[b].running != 1 || now - bands[b].started <= kSlowBand * mean) continue;
+        if (slowest < 0 || bands[b].started < bands[slowest].started) slowest = (int)b;
+    }
+    return slowest;
+}
+
+//a worker that exited or closed its output: its band goes back to the others
+void loseWorker(Worker& worker, std::vector<Band>& bands) {
+    std::cerr << "Worker " << worker.pid << " stopped" << std::endl;
+    worker.alive = false;
+    close(worker.input);
+    close(worker.output);
+    if (worker.band >= 0) bands[worker.band].running--;
+    worker.band = -1;
+}
+
+}
+
+bool renderDistributed(const RenderOptions& options, int argc, char* argv[]) {
+    double start = seconds();
+    int width = options.imageWidth, height = options.imageHeight;
+    int bandCount = std::min(height, options.workers * kBandsPerWorker);
+    std::vector<Band> bands(bandCount);
+    for (int b = 0; b < bandCount; b++) {
+        bands[b].y0 = height * b / bandCount;
+        bands[b].y1 = height * (b + 1) / bandCount;
+    }
+
+    std::error_code error;
+    std::filesystem::path directory = std::filesystem::temp_directory_path(error) /
+                                      ("raytracer-" + std::to_string(getpid()));
+    std::filesystem::create_directories(directory, error);
+    if (error) {
+        std::cerr << "Failed to create " << directory.string() << ": " << error.message() << std::endl;
+        return false;
+    }
+
+    //a worker that dies must not take the coordinator with it when it is sent a job
+    std::signal(SIGPIPE, SIG_IGN);
+    std::vector<std::string> arguments = workerArguments(options, argc, argv);
+    std::vector<Worker> workers(options.workers);
+    for (Worker& worker : workers) {
+        if (!startWorker(arguments, worker)) {
+            std::cerr << "Failed to start a worker: " << std::strerror(errno) << std::endl;
+        }
+    }
+
+    int finished = 0, again = 0, jobs = 0;
+    std::vector<double> bandTimes;
+    bool failed = false;
+    while (finished < bandCount && !failed) {
+        //hand the bands out to the idle workers
+        for (Worker& worker : workers) {
+            if (!worker.alive || worker.band >= 0) continue;
+            int next = pickBand(bands, bandTimes, seconds());
+            if (next < 0) break;
+            Band& band = bands[next];
+            std::string name = "band" + std::to_string(next) + "_" + std::to_string(jobs++) + ".part";
+            worker.part = (directory / name).string();
+            std::string job = quoteJobWord(options.scenePath) + " --crop 0 " + std::to_string(band.y0) + " " +
+                              std::to_string(width) + " " + std::to_string(band.y1) + " --output " +
+                              quoteJobWord(worker.part) + "\n";
+            if (!sendLine(worker.input, job)) {
+                loseWorker(worker, bands);
+                continue;
+            }
+            if (band.running == 0) band.started = seconds();
+            else again++;
+            band.running++;
+            band.attempts++;
+            worker.band = next;
+            worker.started = seconds();
+        }
+
+        //wait for the replies
+        std::vector<pollfd> outputs;
+        std::vector<Worker*> owners;
+        for (Worker& worker : workers) {
+            if (!worker.alive) continue;
+            outputs.push_back(pollfd{worker.output, POLLIN, 0});
+            owners.push_back(&worker);
+        }
+        if (outputs.empty()) {
+            std::cerr << "No worker is left to render the image" << std::endl;
+            failed = true;
+            break;
+        }
+        if (poll(outputs.data(), outputs.size(), 100) < 0 && errno != EINTR) {
+            std::cerr << "Failed to wait for the workers: " << std::strerror(errno) << std::endl;
+            failed = true;
+            break;
+        }
+        for (std::size_t k = 0; k < outputs.size(); k++) {
+            if (!(outputs[k].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            Worker& worker = *owners[k];
+            char buffer[4096];
+            ssize_t count = read(worker.output, buffer, sizeof(buffer));
+            if (count <= 0) {
+                loseWorker(worker, bands);
+                continue;
+            }
+            worker.pending.append(buffer, count);
+            std::size_t newline;
+            while ((newline = worker.pending.find('\n')) != std::string::npos) {
+                std::string line = worker.pending.substr(0, newline);
+                worker.pending.erase(0, newline + 1);
+                bool ok = line.compare(0, 3, "ok ") == 0;
+                //anything else is the worker's own log
+                if ((!ok && line.compare(0, 6, "error ") != 0) || worker.band < 0) continue;
+                Band& band = bands[worker.band];
+                band.running--;
+                if (ok && !band.done) {
+                    band.done = true;
+                    band.part = worker.part;
+                    finished++;
+                    bandTimes.push_back(seconds() - worker.started);
+                } else if (!ok) {
+                    std::cerr << "Band " << worker.band << " failed: " << line << std::endl;
+                }
+                worker.band = -1;
+            }
+        }
+        for (const Band& band : bands) {
+            if (!band.done && band.running == 0 && band.attempts >= kMaxAttempts) failed = true;
+        }
+    }
+
+    //workers still rendering have a copy of a band that is done already
+    for (Worker& worker : workers) {
+        if (worker.alive) {
+            if (worker.band >= 0) kill(worker.pid, SIGKILL);
+            else sendLine(worker.input, "quit\n");
+            close(worker.input);
+            close(worker.output);
+        }
+        if (worker.pid > 0) waitpid(worker.pid, nullptr, 0);
+    }
+
+    if (!failed) {
+        std::vector<Vector> image((std::size_t)width * height);
+        bool aliasing = false;
+        for (const Band& band : bands) {
+            PartialImage part;
+            if (!readPartialImage(band.part, part)) {
+                failed = true;
+                break;
+            }
+            if (part.width != width || part.height != height || part.x0 != 0 || part.x1 != width ||
+                part.y0 != band.y0 || part.y1 != band.y1) {
+                std::cerr << "Partial image " << band.part << " is not the band it was rendered for" << std::endl;
+                failed = true;
+                break;
+            }
+            aliasing = part.aliasing;
+            std::copy(part.pixels.begin(), part.pixels.end(), image.begin() + (std::size_t)band.y0 * width);
+        }
+        if (!failed) failed = !saveImage(width, height, image, imageFileName(options, aliasing));
+        if (!failed) {
+            std::cout << "Rendered " << bandCount << " bands on " << options.workers << " workers in "
+                      << seconds() - start << "s, " << again << " of them again" << std::endl;
+        }
+    }
+    std::filesystem::remove_all(directory, error);
+    return !failed;
+}
@@ -0,0 +1,16 @@
+// Coordinator.h
+#ifndef COORDINATOR_H
+#define COORDINATOR_H
+
+#include "Options.h"
+
+// renders one image over options.workers local worker processes (--workers). the image
+// is cut into bands of rows, a few per worker; every worker is this program in --serve
+// mode, so it parses the scene once and renders band after band as --crop jobs into
+// partial images. a worker that finishes takes the next band, and once none is left an
+// idle worker renders again the band that has been running longest, when it runs well
+// over the typical band time; whichever copy finishes first is used. the bands are then
+// merged into the image. argv is the command line, passed on to the workers
+bool renderDistributed(const RenderOptions& options, int argc, char* argv[]);
+
+#endif // COORDINATOR_H
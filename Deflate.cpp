@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <cstring>
+#include "Deflate.h"
+
+namespace {
+
+const int kWindowSize = 1 << 15;
+const int kHashBits = 15;
+const int kMinMatch = 3;
+const int kMaxMatch = 258;
+const int kMaxChain = 32;   // candidates looked at per position
+const std::size_t kMaxStored = 65535;
+
+const uint16_t kLengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const uint8_t kLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const uint16_t kDistanceBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                    8193, 12289, 16385, 24577};
+const uint8_t kDistanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+//deflate packs bits starting at the lowest bit of each byte
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& out) : out(out), bits(0), count(0) {}
+
+    void put(uint32_t value, int length) {
+        bits |= (uint64_t)value << count;
+        count += length;
+        while (count >= 8) {
+            out.push_back((uint8_t)bits);
+            bits >>= 8;
+            count -= 8;
+        }
+    }
+
+    //huffman codes are stored most significant bit first
+    void putCode(uint32_t code, int length) {
+        uint32_t reversed = 0;
+        for (int k = 0; k < length; k++) reversed |= ((code >> k) & 1) << (length - 1 - k);
+        put(reversed, length);
+    }
+
+    void alignToByte() {
+        if (count > 0) put(0, 8 - count);
+    }
+
+private:
+    std::vector<uint8_t>& out;
+    uint64_t bits;
+    int count;
+};
+
+//fixed huffman code of a literal/length symbol
+void putSymbol(BitWriter& writer, int symbol) {
+    if (symbol < 144) writer.putCode(0x30 + symbol, 8);
+    else if (symbol < 256) writer.putCode(0x190 + symbol - 144, 9);
+    else if (symbol < 280) writer.putCode(symbol - 256, 7);
+    else writer.putCode(0xc0 + symbol - 280, 8);
+}
+
+void putMatch(BitWriter& writer, int length, int distance) {
+    int code = 0;
+    while (code < 28 && kLengthBase[code + 1] <= length) code++;
+    putSymbol(writer, 257 + code);
+    writer.put(length - kLengthBase[code], kLengthExtra[code]);
+
+    code = 0;
+    while (code < 29 && kDistanceBase[code + 1] <= distance) code++;
+    writer.putCode(code, 5);
+    writer.put(distance - kDistanceBase[code], kDistanceExtra[code]);
+}
+
+uint32_t hash3(const uint8_t* p) {
+    uint32_t v = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+    return (v * 2654435761u) >> (32 - kHashBits);
+}
+
+//one fixed huffman block holding all of data
+void compressFixed(const uint8_t* data, std::size_t size, bool last, std::vector<uint8_t>& out) {
+    BitWriter writer(out);
+    writer.put(last ? 1 : 0, 1);
+    writer.put(1, 2);
+
+    std::vector<int> head(1 << kHashBits, -1);
+    std::vector<int> previous(kWindowSize, -1);
+    std::size_t pos = 0;
+    while (pos < size) {
+        int bestLength = 0, bestDistance = 0;
+        if (pos + kMinMatch <= size) {
+            uint32_t h = hash3(data + pos);
+            int maxLength = (int)std::min<std::size_t>(kMaxMatch, size - pos);
+            int candidate = head[h];
+            for (int chain = 0; candidate >= 0 && chain < kMaxChain; chain++) {
+                int distance = (int)pos - candidate;
+                if (distance > kWindowSize - 1) break;
+                if (data[candidate + bestLength] == data[pos + bestLength]) {
+                    int length = 0;
+                    while (length < maxLength && data[candidate + length] == data[pos + length]) length++;
+                    if (length > bestLength) {
+                        bestLength = length;
+                        bestDistance = distance;
+                        if (length == maxLength) break;
+                    }
+                }
+                candidate = previous[candidate & (kWindowSize - 1)];
+            }
+            previous[pos & (kWindowSize - 1)] = head[h];
+            head[h] = (int)pos;
+        }
+        if (bestLength >= kMinMatch) {
+            putMatch(writer, bestLength, bestDistance);
+            //the skipped positions still go into the hash chains
+            for (std::size_t k = pos + 1; k < pos + bestLength && k + kMinMatch <= size; k++) {
+                uint32_t h = hash3(data + k);
+                previous[k & (kWindowSize - 1)] = head[h];
+                head[h] = (int)k;
+            }
+            pos += bestLength;
+        } else {
+            putSymbol(writer, data[pos]);
+            pos++;
+        }
+    }
+    putSymbol(writer, 256);
+
+    //an empty stored block brings a piece that is not last to a byte boundary
+    if (!last) {
+        writer.put(0, 3);
+        writer.alignToByte();
+        out.push_back(0x00);
+        out.push_back(0x00);
+        out.push_back(0xff);
+        out.push_back(0xff);
+    } else {
+        writer.alignToByte();
+    }
+}
+
+void compressStored(const uint8_t* data, std::size_t size, bool last, std::vector<uint8_t>& out) {
+    std::size_t pos = 0;
+    do {
+        std::size_t length = std::min(kMaxStored, size - pos);
+        bool final = last && pos + length == size;
+        out.push_back(final ? 1 : 0);
+        out.push_back((uint8_t)length);
+        out.push_back((uint8_t)(length >> 8));
+        out.push_back((uint8_t)~length);
+        out.push_back((uint8_t)(~length >> 8));
+        out.insert(out.end(), data + pos, data + pos + length);
+        pos += length;
+    } while (pos < size);
+}
+
+}
+
+void deflatePiece(const uint8_t* data, std::size_t size, bool last, std::vector<uint8_t>& out) {
+    std::size_t start = out.size();
+    compressFixed(data, size, last, out);
+    std::size_t storedSize = size + 5 * (size / kMaxStored + 1);
+    if (out.size() - start > storedSize) {
+        out.resize(start);
+        compressStored(data, size, last, out);
+    }
+}
+
+uint32_t adler32(const uint8_t* data, std::size_t size, uint32_t adler) {
+    const uint32_t base = 65521;
+    uint32_t a = adler & 0xffff, b = adler >> 16;
+    while (size > 0) {
+        //5552 bytes is the most that can be summed before b can overflow
+        std::size_t block = std::min<std::size_t>(size, 5552);
+        for (std::size_t k = 0; k < block; k++) {
+            a += data[k];
+            b += a;
+        }
+        a %= base;
+        b %= base;
+        data += block;
+        size -= block;
+    }
+    return a | (b << 16);
+}
+
+uint32_t adler32Combine(uint32_t first, uint32_t second, std::size_t secondSize) {
+    const uint32_t base = 65521;
+    uint32_t remainder = (uint32_t)(secondSize % base);
+    uint32_t a = first & 0xffff;
+    uint32_t b = (uint32_t)(((uint64_t)remainder * a) % base);
+    a += (second & 0xffff) + base - 1;
+    b += (first >> 16) + (second >> 16) + base - remainder;
+    if (a >= base) a -= base;
+    if (a >= base) a -= base;
+    if (b >= base * 2) b -= base * 2;
+    if (b >= base) b -= base;
+    return a | (b << 16);
+}
+
+uint32_t crc32(const uint8_t* data, std::size_t size, uint32_t crc) {
+    static uint32_t table[256];
+    static bool ready = [] {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        return true;
+    }();
+    (void)ready;
+    crc = ~crc;
+    for (std::size_t k = 0; k < size; k++) crc = table[(crc ^ data[k]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
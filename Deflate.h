@@ -0,0 +1,23 @@
+// Deflate.h
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// appends the raw deflate (RFC 1951) encoding of data to out: LZ77 matches with the
+// fixed Huffman codes, or stored blocks when those come out smaller. every piece starts
+// a new LZ77 window and a piece that is not last ends on a byte boundary, so pieces
+// compressed on different threads can be concatenated into one stream
+void deflatePiece(const uint8_t* data, std::size_t size, bool last, std::vector<uint8_t>& out);
+
+// zlib checksum of data, continuing from adler
+uint32_t adler32(const uint8_t* data, std::size_t size, uint32_t adler = 1);
+// checksum of first's data followed by second's data (secondSize bytes)
+uint32_t adler32Combine(uint32_t first, uint32_t second, std::size_t secondSize);
+
+// png chunk checksum of data, continuing from crc
+uint32_t crc32(const uint8_t* data, std::size_t size, uint32_t crc = 0);
+
+#endif // DEFLATE_H
@@ -0,0 +1,255 @@
+#include <cstring>
+#include "GBuffer.h"
+#include "Render.h"
+#include "Scene.h"
+#include "Light.h"
+#include "RenderStats.h"
+#include "TriangleMesh.h"
+#include "Instance.h"
+#include "Object.h"
+
+//same as createColor: rays deeper than this are black
+static const int kMaxDepth = 5;
+//lights a record can tell apart, one bit each
+static const std::size_t kMaxLights = 64;
+
+namespace {
+
+template <class T>
+bool sameArray(const T* a, const T* b, std::size_t count) {
+    return count == 0 || std::memcmp(a, b, count * sizeof(T)) == 0;
+}
+
+template <class T>
+bool sameView(const ArrayView<T>& a, const ArrayView<T>& b) {
+    return a.size() == b.size() && sameArray(a.data(), b.data(), a.size());
+}
+
+bool sameVector(const Vector& a, const Vector& b) {
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+//the tree follows from the triangles, so they are all that is compared
+bool sameMesh(const MeshGeometry& a, const MeshGeometry& b) {
+    return &a == &b || (a.vertices.size() == b.vertices.size() && a.indices.size() == b.indices.size() &&
+                        sameArray(a.vertices.data(), b.vertices.data(), a.vertices.size()) &&
+                        sameArray(a.indices.data(), b.indices.data(), a.indices.size()));
+}
+
+//same geometry file and placement
+bool sameInstance(const Instance& a, const Instance& b) {
+    return a.geometry->sourceHash == b.geometry->sourceHash && sameVector(a.position, b.position) &&
+           a.scale == b.scale && sameVector(a.rotation[0], b.rotation[0]) && sameVector(a.rotation[1], b.rotation[1]) &&
+           sameVector(a.rotation[2], b.rotation[2]);
+}
+
+//true when every ray of previous would travel and hit exactly the same way in scene: same
+//camera, primitives, BVH, mirror and glass flags and light placement. colors may differ
+bool sameGeometry(const Scene& previous, const Scene& scene) {
+    if (!sameVector(previous.cameraPosition, scene.cameraPosition) || previous.aliasing != scene.aliasing) return false;
+    const PrimitiveStore& a = previous.primitives;
+    const PrimitiveStore& b = scene.primitives;
+    if (a.sphereCount != b.sphereCount || a.cylinderCount != b.cylinderCount || a.meshCount != b.meshCount ||
+        a.instanceCount != b.instanceCount || a.planes.count != b.planes.count) {
+        return false;
+    }
+    if (!sameView(previous.bvh.nodes, scene.bvh.nodes) || !sameView(previous.bvh.primIndices, scene.bvh.primIndices) ||
+        !sameView(previous.bvh.unbounded, scene.bvh.unbounded) || !sameView(a.types, b.types) ||
+        !sameView(a.slots, b.slots) || !sameView(a.primitiveTypes, b.primitiveTypes) ||
+        !sameView(a.primitiveSlots, b.primitiveSlots) || a.materials.size() != b.materials.size()) {
+        return false;
+    }
+    std::size_t spheres = a.sphereCount, cylinders = a.cylinderCount, planes = a.planes.count;
+    bool same = sameArray(a.sphereSoA.centerX, b.sphereSoA.centerX, spheres) &&
+                sameArray(a.sphereSoA.centerY, b.sphereSoA.centerY, spheres) &&
+                sameArray(a.sphereSoA.centerZ, b.sphereSoA.centerZ, spheres) &&
+                sameArray(a.sphereSoA.radius, b.sphereSoA.radius, spheres) &&
+                sameArray(a.cylinderSoA.centerX, b.cylinderSoA.centerX, cylinders) &&
+                sameArray(a.cylinderSoA.centerY, b.cylinderSoA.centerY, cylinders) &&
+                sameArray(a.cylinderSoA.centerZ, b.cylinderSoA.centerZ, cylinders) &&
+                sameArray(a.cylinderSoA.axisX, b.cylinderSoA.axisX, cylinders) &&
+                sameArray(a.cylinderSoA.axisY, b.cylinderSoA.axisY, cylinders) &&
+                sameArray(a.cylinderSoA.axisZ, b.cylinderSoA.axisZ, cylinders) &&
+                sameArray(a.cylinderSoA.radius, b.cylinderSoA.radius, cylinders) &&
+                sameArray(a.cylinderSoA.halfHeight, b.cylinderSoA.halfHeight, cylinders) &&
+                sameArray(a.planes.normalX, b.planes.normalX, planes) &&
+                sameArray(a.planes.normalY, b.planes.normalY, planes) &&
+                sameArray(a.planes.normalZ, b.planes.normalZ, planes) &&
+                sameArray(a.planes.d, b.planes.d, planes);
+    if (!same) return false;
+    for (int slot = 0; slot < a.meshCount; slot++) {
+        if (!sameMesh(*a.meshSoA.geometry[slot], *b.meshSoA.geometry[slot])) return false;
+    }
+    for (int slot = 0; slot < a.instanceCount; slot++) {
+        if (!sameInstance(*a.instanceSoA.records[slot], *b.instanceSoA.records[slot])) return false;
+    }
+    for (std::size_t id = 0; id < a.materials.size(); id++) {
+        if (a.materials[id].reflective != b.materials[id].reflective ||
+            a.materials[id].transparent != b.materials[id].transparent) {
+            return false;
+        }
+    }
+
+    if (previous.shadingLights.size() != scene.shadingLights.size()) return false;
+    for (std::size_t l = 0; l < scene.shadingLights.size(); l++) {
+        const ShadingLight& p = previous.shadingLights[l];
+        const ShadingLight& s = scene.shadingLights[l];
+        if (p.type != s.type || !sameVector(p.toLight, s.toLight) || !sameVector(p.position, s.position) ||
+            !sameVector(p.axis, s.axis) || p.cutoff != s.cutoff) {
+            return false;
+        }
+    }
+    return (previous.ambientLight != nullptr) == (scene.ambientLight != nullptr);
+}
+
+//the color createColor gives the sample, from its record: phong shading of the opaque hit
+//by the lights in the record, with the materials and intensities of scene
+void shadeRecord(const Scene& scene, SampleRecord& record) {
+    if (record.primitive < 0) {
+        record.color = Vector(0, 0, 0);
+        return;
+    }
+    HitRecord hit;
+    hit.t = record.t;
+    hit.primitive = record.primitive;
+    Intersection interObject = scene.primitives.surface(record.ray, hit);
+    Vector viewDir = (record.ray.origin - interObject.point).normalize();
+    Vector finalColor(0, 0, 0);
+    for (std::size_t l = 0; l < scene.shadingLights.size(); l++) {
+        if (!((record.lights >> l) & 1)) continue;
+        Ray shadowRay(Vector(0, 0, 0), Vector(0, 0, 0));
+        float lightDistance;
+        Vector toLight;
+        lightShadowRay(scene.shadingLights[l], interObject.point, shadowRay, lightDistance, toLight);
+        finalColor = finalColor + lightContribution(interObject, viewDir, scene.shadingLights[l], toLight);
+    }
+    finalColor = finalColor + interObject.color.Hadamard(scene.ambientLight->getIntensity());
+    //createColor adds a mirror's reflection to black, which turns a -0 into 0
+    record.color = record.depth > 0 ? Vector(0, 0, 0) + finalColor : finalColor;
+}
+
+//createColor(cameraRay, scene, 0), keeping what shadeRecord needs. scenes with more lights
+//than the record has bits are never shaded from records, update clears the cache for them
+void traceRecord(const Ray& cameraRay, const Scene& scene, SampleRecord& record) {
+    Ray ray = cameraRay;
+    record.primitive = -1;
+    record.lights = 0;
+    record.color = Vector(0, 0, 0);
+    for (int depth = 0; depth <= kMaxDepth; depth++) {
+        countDepth(depth);
+        HitRecord hit = traceClosest(ray, scene);
+        if (!hit.hit()) break;
+        Intersection interObject = scene.primitives.surface(ray, hit);
+        if (interObject.reflective || interObject.transparent) {
+            Vector direction = interObject.reflective
+                                   ? reflect(ray.direction, interObject.normal).normalize()
+                                   : refract(ray.direction, interObject.normal, 1.5f).normalize();
+            countStat(interObject.reflective ? STAT_REFLECTED_RAYS : STAT_REFRACTED_RAYS);
+            ray = Ray(interObject.point + direction * 1e-4f, direction);
+            continue;
+        }
+        record.ray = ray;
+        record.t = hit.t;
+        record.primitive = hit.primitive;
+        record.depth = depth;
+        //shadeLights, noting the lights that get through
+        const ShadingLight* first = scene.shadingLights.data();
+        Vector viewDir = (ray.origin - interObject.point).normalize();
+        Vector finalColor(0, 0, 0);
+        findLights(scene, interObject, [&](const ShadingLight& light, const Vector& toLight) {
+            std::size_t l = &light - first;
+            if (l < kMaxLights) record.lights |= 1ull << l;
+            finalColor = finalColor + lightContribution(interObject, viewDir, light, toLight);
+        });
+        finalColor = finalColor + interObject.color.Hadamard(scene.ambientLight->getIntensity());
+        record.color = depth > 0 ? Vector(0, 0, 0) + finalColor : finalColor;
+        break;
+    }
+    record.traced = true;
+    record.stale = false;
+}
+
+}
+
+GBuffer :: GBuffer() : width(0), height(0), minSamples(0), render(0) {}
+
+void GBuffer :: clear(int newWidth, int newHeight, int newMinSamples) {
+    width = newWidth;
+    height = newHeight;
+    minSamples = newMinSamples;
+    firstPass.assign((std::size_t)width * height * minSamples, SampleRecord());
+    refined.assign((std::size_t)width * height, std::vector<SampleRecord>());
+}
+
+bool GBuffer :: update(const Scene* previous, const Scene& scene, int newWidth, int newHeight, int newMinSamples) {
+    render++;
+    bool reusable = previous && newWidth == width && newHeight == height && newMinSamples == minSamples &&
+                    scene.shadingLights.size() <= kMaxLights && sameGeometry(*previous, scene);
+    if (!reusable) {
+        clear(newWidth, newHeight, newMinSamples);
+        return false;
+    }
+
+    std::vector<char> materialChanged(scene.primitives.materials.size());
+    for (std::size_t id = 0; id < materialChanged.size(); id++) {
+        const Material& a = previous->primitives.materials[id];
+        const Material& b = scene.primitives.materials[id];
+        materialChanged[id] = !sameVector(a.color, b.color) || a.shininess != b.shininess;
+    }
+    uint64_t lightsChanged = 0;
+    for (std::size_t l = 0; l < scene.shadingLights.size(); l++) {
+        if (!sameVector(previous->shadingLights[l].intensity, scene.shadingLights[l].intensity)) {
+            lightsChanged |= 1ull << l;
+        }
+    }
+    bool ambientChanged = scene.ambientLight &&
+                          !sameVector(previous->ambientLight->getIntensity(), scene.ambientLight->getIntensity());
+
+    //stale stays set until the sample is shaded, also for samples this render does not reach
+    auto mark = [&](SampleRecord& record) {
+        if (!record.traced || record.primitive < 0) return;
+        if (ambientChanged || materialChanged[record.primitive] || (record.lights & lightsChanged)) record.stale = true;
+    };
+    for (SampleRecord& record : firstPass) mark(record);
+    for (std::vector<SampleRecord>& records : refined) {
+        for (SampleRecord& record : records) mark(record);
+    }
+    return true;
+}
+
+SampleRecord& GBuffer :: record(int index, int k) {
+    if (k < minSamples) return firstPass[(std::size_t)index * minSamples + k];
+    std::vector<SampleRecord>& records = refined[index];
+    if ((int)records.size() <= k - minSamples) records.resize(k - minSamples + 1);
+    return records[k - minSamples];
+}
+
+Vector GBuffer :: sample(int index, int k, const Ray& cameraRay, const Scene& scene) {
+    SampleRecord& entry = record(index, k);
+    if (!entry.traced) {
+        traceRecord(cameraRay, scene, entry);
+        entry.action = 't';
+    } else if (entry.stale) {
+        shadeRecord(scene, entry);
+        entry.stale = false;
+        entry.action = 's';
+    } else {
+        entry.action = 'r';
+    }
+    entry.render = render;
+    return entry.color;
+}
+
+void GBuffer :: counts(long long& traced, long long& reshaded, long long& reused) const {
+    traced = reshaded = reused = 0;
+    auto count = [&](const SampleRecord& record) {
+        if (record.render != render) return;
+        if (record.action == 't') traced++;
+        else if (record.action == 's') reshaded++;
+        else reused++;
+    };
+    for (const SampleRecord& record : firstPass) count(record);
+    for (const std::vector<SampleRecord>& records : refined) {
+        for (const SampleRecord& record : records) count(record);
+    }
+}
@@ -0,0 +1,63 @@
+// GBuffer.h
+#ifndef GBUFFER_H
+#define GBUFFER_H
+
+#include <cstdint>
+#include <vector>
+#include "Vector.h"
+#include "Ray.h"
+
+class Scene;
+
+// what one camera sample saw, enough to shade it again without tracing a ray: the
+// ray that reached the opaque hit that colors the sample (the camera ray, or the last
+// ray of its mirror and glass chain), that hit and the lights whose shadow rays got
+// through. primitive is -1 when the chain ended without an opaque hit
+struct SampleRecord {
+    Ray ray;
+    float t;
+    int primitive;
+    int depth;           // mirror and glass bounces before the opaque hit
+    uint64_t lights;     // bit l for scene.shadingLights[l]
+    Vector color;
+    bool traced = false;
+    bool stale = false;  // the material or a light it depends on changed, shade it again
+    int render = -1;     // the last render that used it
+    char action = 0;     // what that render did with it: 't'raced, 's'haded again or 'r'eused
+
+    SampleRecord() : ray(Vector(0, 0, 0), Vector(0, 0, 0)), t(0), primitive(-1), depth(0), lights(0) {}
+};
+
+// per sample cache of a render for re-rendering a changed scene (--watch). when only
+// object colors, light intensities or the ambient light changed, a sample is shaded
+// again from its record, with no ray traced, and only if something it depends on
+// changed; anything else (camera, geometry, light positions, mirror or glass flags)
+// clears the cache. colors are exactly the ones createColor returns
+class GBuffer {
+public:
+    GBuffer();
+
+    // called before rendering scene: compares it with previous, the scene the cache was
+    // filled from (null for the first render), and marks the samples to shade again.
+    // returns false when the cache was cleared and every sample will be traced
+    bool update(const Scene* previous, const Scene& scene, int width, int height, int minSamples);
+
+    // color of sample k of pixel index (the k-th sample added to it), traced or shaded
+    // from the cache. cameraRay is the sample's ray, used when it has to be traced.
+    // different pixels may be sampled from different threads
+    Vector sample(int index, int k, const Ray& cameraRay, const Scene& scene);
+
+    // how many samples of the current render were traced, shaded again and reused as they were
+    void counts(long long& traced, long long& reshaded, long long& reused) const;
+
+private:
+    SampleRecord& record(int index, int k);
+    void clear(int width, int height, int minSamples);
+
+    int width, height, minSamples;
+    std::vector<SampleRecord> firstPass;               // [index * minSamples + k]
+    std::vector<std::vector<SampleRecord>> refined;    // per pixel, its samples past minSamples
+    int render;                                        // renders since the cache was created
+};
+
+#endif // GBUFFER_H
@@ -1,238 +1,88 @@
-#include "Vector.h"
 #include "Scene.h"
-#include "Object.h"
-#include "Intersection.h"
-#include "Light.h"
-#include <cmath>
-#include <fstream>
+#include "Options.h"
+#include "Render.h"
+#include "Kernels.h"
+#include "SceneCache.h"
+#include "GBuffer.h"
+#include "Server.h"
+#include "Sequence.h"
+#include "Coordinator.h"
+#include <chrono>
+#include <filesystem>
 #include <iostream>
-
-//find the closest object
-Intersection findObject(const Ray& ray, const Scene& scene) {
-    Intersection closestHit;
-    for (const auto& obj : scene.objects) {
-        Intersection tempHit = obj->intersect(ray);
-        if (tempHit.hit && tempHit.distance < closestHit.distance) {
-            closestHit = tempHit;
+#include <memory>
+#include <string>
+#include <thread>
+
+//renders the scene file every time it changes, until the process is stopped. samples
+//whose hit and lights did not change are shaded from the G-buffer instead of traced
+static void watchScene(const RenderOptions& options) {
+    std::unique_ptr<Scene> previous;
+    GBuffer gbuffer;
+    std::error_code error;
+    std::filesystem::file_time_type renderedTime{};
+    while (true) {
+        std::filesystem::file_time_type time = std::filesystem::last_write_time(options.scenePath, error);
+        if (error || (previous && time == renderedTime)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            continue;
         }
-    }
-    return closestHit;
-}
-
-//find the ligth that that effect the object
-std::vector<Light*> findLights(const Scene& scene, const Intersection& interObject) {
-    std::vector<Light*> lightsForHitPoint;
-    for (const auto& light : scene.lights) {
-        if (DirectionalLight* directionalLight = dynamic_cast<DirectionalLight*>(light)) {
-            Vector shadowRayDirection = (directionalLight->getDirection() * -1).normalize();
-            Ray shadowRay(interObject.point + shadowRayDirection * 1e-4f, shadowRayDirection);
-
-            bool inShadow = false;
-            for (const auto& obj : scene.objects) {
-                Intersection shadowIntersection = obj->intersect(shadowRay);
-                if (shadowIntersection.hit) {
-                    inShadow = true;
-                    break;
-                }
-            }
-            if (!inShadow) {
-                lightsForHitPoint.push_back(directionalLight);
-            }
-        } else if (Spotlight* spotlight = dynamic_cast<Spotlight*>(light)) {
-            Vector lightToPoint = (interObject.point - spotlight->position).normalize();
-            float cosAngle = lightToPoint.dot(spotlight->getDirection().normalize());
-            if (cosAngle >= spotlight->cutoffAngle) {
-                Vector shadowRayDirection = (spotlight->position - interObject.point).normalize();
-                Ray shadowRay(interObject.point + shadowRayDirection * 1e-4f, shadowRayDirection);
-
-                bool inShadow = false;
-                for (const auto& obj : scene.objects) {
-                    Intersection shadowIntersection = obj->intersect(shadowRay);
-                    if (shadowIntersection.hit) {
-                        float lightDistance = (spotlight->position - interObject.point).magnitude();
-                        if (shadowIntersection.distance < lightDistance) {
-                            inShadow = true;
-                            break;
-                        }
-                    }
-                }
-                if (!inShadow) {
-                    lightsForHitPoint.push_back(spotlight);
-                }
-            }
+        renderedTime = time;
+        auto start = std::chrono::steady_clock::now();
+        std::unique_ptr<Scene> scene(new Scene());
+        if (!scene->loadFromFile(options.scenePath)) {
+            //keep the last render, the file is probably still being written
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            continue;
         }
+        int minSamples = scene->aliasing ? options.aaMinSamples : 1;
+        bool reused = gbuffer.update(previous.get(), *scene, options.imageWidth, options.imageHeight, minSamples);
+        renderScene(options, *scene, &gbuffer);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        long long traced, reshaded, unchanged;
+        gbuffer.counts(traced, reshaded, unchanged);
+        std::cout << (reused ? "Rendered again in " : "Rendered in ") << seconds << "s: " << traced
+                  << " samples traced, " << reshaded << " shaded again, " << unchanged << " reused" << std::endl;
+        previous = std::move(scene);
     }
-    return lightsForHitPoint;
-}
-
-//calculating alpha and theta from the class 
-float calcTheta(const Vector& normal, const Vector& lightDir) {
-    return std::max(0.0f, std::abs(normal.normalize().dot(lightDir.normalize())));
-}
-float calcAlpha(const Vector& normal, const Vector& lightDir, const Vector& viewDir) {
-    Vector reflectionDir = (normal * 2.0f * lightDir.dot(normal) - lightDir).normalize();
-    return std::max(0.0f, viewDir.dot(reflectionDir));
-}
-
-// calculate the reflrct direction from the class
-Vector reflect(const Vector& I, const Vector& N) {
-    return I - N * 2.0f * I.dot(N);
-}
-
-//calculate the reflrct direction of the transperent object
-Vector refract(const Vector& I, const Vector& N, float eta) {
-    float cosi = std::clamp(I.dot(N), -1.0f, 1.0f);
-    float etai = 1.0f, etat = eta;
-    Vector n = N;
-    if (cosi < 0) cosi = -cosi; 
-    else { std::swap(etai, etat); n = N * -1.0f; }
-    float etaRatio = etai / etat;
-    float k = 1 - etaRatio * etaRatio * (1 - cosi * cosi);
-    return k < 0 ? Vector(0, 0, 0) : I * etaRatio + n * (etaRatio * cosi - std::sqrt(k));
-}
-
-//calculate the pixels color
-Vector createColor(Ray ray, Scene& scene, int counter) {
-    if (counter > 5) return Vector(0, 0, 0);
-
-    Intersection interObject = findObject(ray, scene);
-    if (!interObject.hit) return Vector(0, 0, 0);
-
-    Vector finalColor(0, 0, 0);
-    Vector viewDir = (ray.origin - interObject.point).normalize();
-    //recursive reflect object
-    if (interObject.reflective) {
-        Vector reflectedDir = reflect(ray.direction, interObject.normal).normalize();
-        Ray reflectedRay(interObject.point + reflectedDir * 1e-4f, reflectedDir);
-        finalColor = finalColor + createColor(reflectedRay, scene, counter + 1);
-        return finalColor;
-    }
-    //recursive transparent object
-    if (interObject.transparent) {
-        float refractiveIndex = 1.5f;
-        Vector refractedDir = refract(ray.direction, interObject.normal, refractiveIndex).normalize();
-        Ray refractedRay(interObject.point + refractedDir * 1e-4f, refractedDir);
-        finalColor = finalColor + createColor(refractedRay, scene, counter + 1);
-        return finalColor;
-    }
-    //for transparent reflect the I vector will be (0,0,0)
-    for (const auto& light : findLights(scene, interObject)) {
-        float cosTheta = calcTheta(interObject.normal, light->getDistance(interObject.point));
-        float cosAlpha = calcAlpha(interObject.normal, light->getDistance(interObject.point), viewDir);
-        float ncosAlpha = pow(cosAlpha, interObject.shininess);
-        Vector diffuse = interObject.color * cosTheta;
-        Vector specular = Vector(0.7, 0.7, 0.7) * ncosAlpha;
-        Vector I = diffuse + specular;
-        finalColor = finalColor + I.Hadamard(light->getIntensity());
-    }
-
-    finalColor = finalColor + interObject.color.Hadamard(scene.ambientLight->getIntensity());
-    return finalColor;
 }
 
-void saveImage(int width, int height, const std::vector<Vector>& buffer, const std::string& fileName) {
-    std::ofstream file(fileName, std::ios::out | std::ios::binary);
-    if (!file) {
-        std::cerr << "Failed to save the image to " << fileName << std::endl;
-        return;
+int main(int argc, char* argv[]) {
+    RenderOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        return 1;
     }
-    file << "P6\n" << width << " " << height << "\n255\n";
-    for (const auto& color : buffer) {
-        file.put(static_cast<unsigned char>(std::min(1.0f, std::max(0.0f, color.x)) * 255));
-        file.put(static_cast<unsigned char>(std::min(1.0f, std::max(0.0f, color.y)) * 255));
-        file.put(static_cast<unsigned char>(std::min(1.0f, std::max(0.0f, color.z)) * 255));
+    if (!selectKernels(options.kernels)) {
+        return 1;
     }
-    file.close();
-    std::cout << "Image saved to " << fileName << std::endl;
-}
+    setOccluderCache(options.occluderCache);
 
-#include <cstdlib> // For std::rand and std::srand
-#include <ctime>   // For seeding random number generator
-
-//creating and sending the rays
-void renderImage(int imageWidth, int imageHeight, const std::string& dataPath, Scene& scene) {
-    float screenWidth = 2.0f, screenHeight = 2.0f;
-    scene.loadFromFile(dataPath);
-    int raysPerPixel = 1;
-    // Extract the input file name
-    std::filesystem::path inputPath(dataPath);
-    std::string inputFileName = inputPath.stem().string();
-    std::string outputFileName = "outputs/my" + inputFileName + ".png";
-   
-    //if we want more then one ray, will change the ray nomber and the output name
-    if (scene.aliasing) {
-        outputFileName = "outputs/myAliasing" + inputFileName + ".png";
-        raysPerPixel = 10;
+    if (options.serve) {
+        RenderServer server(options);
+        return server.run() ? 0 : 1;
     }
 
-    float pixelWidth = screenWidth / imageWidth;
-    float pixelHeight = screenHeight / imageHeight;
-    std::vector<Vector> imageBuffer(imageWidth * imageHeight);
-
-   int subGridX = std::ceil(std::sqrt(raysPerPixel));
-    int subGridY = std::ceil(static_cast<float>(raysPerPixel) / subGridX);
-
-    for (int j = 0; j < imageHeight; j++) {
-        for (int i = 0; i < imageWidth; i++) {
-            Vector accumulatedColor(0, 0, 0);
-
-            for (int sx = 0; sx < subGridX; ++sx) {
-                for (int sy = 0; sy < subGridY; ++sy) {
-                    if (sx * subGridY + sy >= raysPerPixel) {
-                        continue; // Skip extra sub-pixels if raysPerPixel is not perfectly divisible
-                    }
-
-                    // Compute sub-pixel position
-                    float subPixelX = -1.0f + (i + (sx + 0.5f) / subGridX) * pixelWidth;
-                    float subPixelY = -1.0f + (j + (sy + 0.5f) / subGridY) * pixelHeight;
-
-                    Vector subPixelPosition(subPixelX, subPixelY, 0);
-                    Vector rayDirection = (subPixelPosition - scene.cameraPosition).normalize();
-                    Ray ray(scene.cameraPosition, rayDirection);
-
-                    // Accumulate color from this ray
-                    accumulatedColor = accumulatedColor + createColor(ray, scene, 0);
-                }
-            }
-            accumulatedColor = accumulatedColor / float(raysPerPixel);
+    // Print the paths for debugging
+    std::cout << "Input file: " << options.scenePath << std::endl;
 
-            // Store the final color in the image buffer
-            int idx = (imageHeight - j - 1) * imageWidth + i;
-            imageBuffer[idx] = accumulatedColor;
+    Scene scene;
+    if (options.compile) {
+        std::string cachePath = sceneCachePath(options.scenePath);
+        if (!scene.loadFromFile(options.scenePath) || !writeSceneCache(scene, options.scenePath, cachePath)) {
+            return 1;
         }
+        std::cout << "Compiled scene: " << cachePath << std::endl;
+        return 0;
     }
-
-    // Save the image
-    saveImage(imageWidth, imageHeight, imageBuffer, outputFileName);
-}
-
-
-
-
-#include <iostream>
-
-#include <iostream>
-#include <string>
-#include <filesystem>
-
-int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: ./racetracer <scene file path>" << std::endl;
-        return 1;
+    if (options.workers > 0 && !options.cropped()) {
+        return renderDistributed(options, argc, argv) ? 0 : 1;
     }
-
-    std::string dataPath = argv[1];
-    int imageWidth = 800;
-    int imageHeight = 800;
-
-    
-    // Print the paths for debugging
-    std::cout << "Input file: " << dataPath << std::endl;
-
-    Scene scene;
-    renderImage(imageWidth, imageHeight, dataPath, scene);
-
-    return 0;
+    if (!options.sequencePath.empty()) {
+        return renderSequence(options) ? 0 : 1;
+    }
+    if (options.watch) {
+        watchScene(options);
+        return 0;
+    }
+    return renderImage(options, scene).ok ? 0 : 1;
 }
-
-
@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "ImageWriter.h"
+#include "Deflate.h"
+#include "ThreadPool.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+ImageFormat imageFormatFor(const std::string& fileName) {
+    std::size_t dot = fileName.find_last_of('.');
+    std::string extension = dot == std::string::npos ? "" : fileName.substr(dot);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    if (extension == ".ppm") return IMAGE_PPM;
+    if (extension == ".pfm") return IMAGE_PFM;
+    return IMAGE_PNG;
+}
+
+std::string imageExtension(ImageFormat format) {
+    switch (format) {
+        case IMAGE_PPM: return ".ppm";
+        case IMAGE_PFM: return ".pfm";
+        default: return ".png";
+    }
+}
+
+void colorsToBytes(const Vector* colors, std::size_t count, uint8_t* bytes) {
+    static_assert(sizeof(Vector) == 3 * sizeof(float), "Vector must be three packed floats");
+    const float* values = &colors[0].x;
+    std::size_t total = count * 3;
+    std::size_t k = 0;
+#if defined(__SSE2__)
+    //max(c, 0) then min(c, 1) pick the same operand as std::max(0, c) and std::min(1, c), nan included
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), scale = _mm_set1_ps(255.0f);
+    for (; k + 16 <= total; k += 16) {
+        __m128i a = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(values + k), zero), one), scale));
+        __m128i b = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(values + k + 4), zero), one), scale));
+        __m128i c = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(values + k + 8), zero), one), scale));
+        __m128i d = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(values + k + 12), zero), one), scale));
+        _mm_storeu_si128((__m128i*)(bytes + k), _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+    }
+#endif
+    for (; k < total; k++) {
+        bytes[k] = static_cast<unsigned char>(std::min(1.0f, std::max(0.0f, values[k])) * 255);
+    }
+}
+
+static void putBigEndian(uint8_t* p, uint32_t value) {
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)(value >> 16);
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t)value;
+}
+
+ImageWriter :: ImageWriter(const std::string& fileName, int width, int height, const std::vector<Vector>& buffer)
+    : fileName(fileName), format(imageFormatFor(fileName)), width(width), height(height), buffer(buffer),
+      file(fileName, std::ios::out | std::ios::binary), nextStrip(0), adler(1) {
+    int count = (height + kStripRows - 1) / kStripRows;
+    strips.resize(count);
+    remaining.reset(new std::atomic<int>[count]);
+    for (int s = 0; s < count; s++) {
+        int first, last;
+        stripRows(s, first, last);
+        remaining[s] = (last - first) * width;
+    }
+    if (!file) {
+        std::cerr << "Failed to save the image to " << fileName << std::endl;
+        return;
+    }
+
+    if (format == IMAGE_PPM) {
+        file << "P6\n" << width << " " << height << "\n255\n";
+    } else if (format == IMAGE_PFM) {
+        //a negative scale marks little endian floats
+        file << "PF\n" << width << " " << height << "\n-1.0\n";
+    } else {
+        static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        file.write((const char*)signature, 8);
+        uint8_t header[13];
+        putBigEndian(header, width);
+        putBigEndian(header + 4, height);
+        header[8] = 8;    // bits per channel
+        header[9] = 2;    // rgb
+        header[10] = 0;   // deflate
+        header[11] = 0;   // adaptive filtering
+        header[12] = 0;   // not interlaced
+        writeChunk("IHDR", header, 13);
+    }
+}
+
+bool ImageWriter :: isOpen() const {
+    return (bool)file;
+}
+
+//pfm stores the bottom row first, so its strips are counted from the bottom
+int ImageWriter :: stripOf(int row) const {
+    return format == IMAGE_PFM ? (height - 1 - row) / kStripRows : row / kStripRows;
+}
+
+void ImageWriter :: stripRows(int strip, int& first, int& last) const {
+    if (format == IMAGE_PFM) {
+        first = std::max(0, height - (strip + 1) * kStripRows);
+        last = height - strip * kStripRows;
+    } else {
+        first = strip * kStripRows;
+        last = std::min(height, (strip + 1) * kStripRows);
+    }
+}
+
+void ImageWriter :: regionDone(int x0, int y0, int x1, int y1) {
+    bool finished = false;
+    for (int row = y0; row < y1; row++) {
+        int strip = stripOf(row);
+        if (remaining[strip].fetch_sub(x1 - x0) == x1 - x0) {
+            encodeStrip(strip);
+            finished = true;
+        }
+    }
+    if (finished) writeReady();
+}
+
+void ImageWriter :: writeAll(ThreadPool& pool) {
+    if (!file) return;
+    if (format == IMAGE_PNG) {
+        pool.run((int)strips.size(), [&](int /*worker*/, int strip) {
+            encodeStrip(strip);
+        });
+        writeReady();
+        return;
+    }
+
+    //one conversion pass over the buffer and one write
+    std::vector<uint8_t> data;
+    if (format == IMAGE_PPM) {
+        data.resize(buffer.size() * 3);
+        colorsToBytes(buffer.data(), buffer.size(), data.data());
+    } else {
+        std::size_t rowBytes = width * sizeof(Vector);
+        data.resize(buffer.size() * sizeof(Vector));
+        for (int row = 0; row < height; row++) {
+            std::memcpy(data.data() + row * rowBytes, &buffer[(height - 1 - row) * width], rowBytes);
+        }
+    }
+    file.write((const char*)data.data(), data.size());
+    nextStrip = (int)strips.size();
+}
+
+void ImageWriter :: encodeStrip(int strip) {
+    Strip& out = strips[strip];
+    int first, last;
+    stripRows(strip, first, last);
+    std::size_t pixels = (std::size_t)(last - first) * width;
+
+    if (format == IMAGE_PPM) {
+        out.data.resize(pixels * 3);
+        colorsToBytes(&buffer[first * width], pixels, out.data.data());
+    } else if (format == IMAGE_PFM) {
+        std::size_t rowBytes = width * sizeof(Vector);
+        out.data.resize(pixels * sizeof(Vector));
+        for (int row = last - 1, k = 0; row >= first; row--, k++) {
+            std::memcpy(out.data.data() + k * rowBytes, &buffer[row * width], rowBytes);
+        }
+    } else {
+        encodePngStrip(strip, out);
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    out.ready = true;
+}
+
+//filters every row of the strip with the filter that leaves the smallest sum of
+//(signed) bytes and compresses the strip as one piece of the zlib stream
+void ImageWriter :: encodePngStrip(int strip, Strip& out) {
+    int first, last;
+    stripRows(strip, first, last);
+    std::size_t rowBytes = (std::size_t)width * 3;
+    std::vector<uint8_t> pixels((last - first) * rowBytes);
+    colorsToBytes(&buffer[first * width], (std::size_t)(last - first) * width, pixels.data());
+
+    std::vector<uint8_t> raw((last - first) * (rowBytes + 1));
+    std::vector<uint8_t> candidate(rowBytes);
+    for (int row = 0; row < last - first; row++) {
+        const uint8_t* current = pixels.data() + row * rowBytes;
+        //the row above may belong to a strip that is not rendered yet, so the first
+        //row of a strip only uses the filters that look to the left
+        const uint8_t* above = row > 0 ? current - rowBytes : nullptr;
+        uint8_t* target = raw.data() + row * (rowBytes + 1);
+        long bestCost = -1;
+        for (int filter = 0; filter < (above ? 5 : 2); filter++) {
+            long cost = 0;
+            for (std::size_t k = 0; k < rowBytes; k++) {
+                int a = k >= 3 ? current[k - 3] : 0;
+                int b = above ? above[k] : 0;
+                int c = above && k >= 3 ? above[k - 3] : 0;
+                int predicted = 0;
+                if (filter == 1) predicted = a;
+                else if (filter == 2) predicted = b;
+                else if (filter == 3) predicted = (a + b) / 2;
+                else if (filter == 4) {
+                    int p = a + b - c;
+                    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+                    predicted = pa <= pb && pa <= pc ? a : (pb <= pc ? b : c);
+                }
+                candidate[k] = (uint8_t)(current[k] - predicted);
+                cost += std::abs((int)(int8_t)candidate[k]);
+            }
+            if (bestCost < 0 || cost < bestCost) {
+                bestCost = cost;
+                target[0] = (uint8_t)filter;
+                std::memcpy(target + 1, candidate.data(), rowBytes);
+            }
+        }
+    }
+
+    out.data.clear();
+    if (strip == 0) {
+        out.data.push_back(0x78);   // deflate, 32K window
+        out.data.push_back(0x01);
+    }
+    deflatePiece(raw.data(), raw.size(), strip + 1 == (int)strips.size(), out.data);
+    out.adler = adler32(raw.data(), raw.size());
+    out.rawSize = raw.size();
+}
+
+//writes the strips that are ready, in file order. whoever gets the lock writes for everyone
+void ImageWriter :: writeReady() {
+    std::lock_guard<std::mutex> guard(lock);
+    while (nextStrip < (int)strips.size() && strips[nextStrip].ready) {
+        Strip& strip = strips[nextStrip];
+        if (format == IMAGE_PNG) {
+            adler = adler32Combine(adler, strip.adler, strip.rawSize);
+            if (nextStrip + 1 == (int)strips.size()) {
+                uint8_t checksum[4];
+                putBigEndian(checksum, adler);
+                strip.data.insert(strip.data.end(), checksum, checksum + 4);
+            }
+            writeChunk("IDAT", strip.data.data(), strip.data.size());
+        } else {
+            file.write((const char*)strip.data.data(), strip.data.size());
+        }
+        std::vector<uint8_t>().swap(strip.data);
+        nextStrip++;
+    }
+}
+
+void ImageWriter :: writeChunk(const char* type, const uint8_t* data, std::size_t size) {
+    uint8_t header[8];
+    putBigEndian(header, (uint32_t)size);
+    std::memcpy(header + 4, type, 4);
+    uint32_t crc = crc32(data, size, crc32(header + 4, 4));
+    uint8_t footer[4];
+    putBigEndian(footer, crc);
+    file.write((const char*)header, 8);
+    file.write((const char*)data, size);
+    file.write((const char*)footer, 4);
+}
+
+bool ImageWriter :: finish() {
+    if (!file) return false;
+    if (nextStrip < (int)strips.size()) {
+        std::cerr << "Image " << fileName << " is missing rows" << std::endl;
+        return false;
+    }
+    if (format == IMAGE_PNG) writeChunk("IEND", nullptr, 0);
+    file.close();
+    if (!file) {
+        std::cerr << "Failed to save the image to " << fileName << std::endl;
+        return false;
+    }
+    std::cout << "Image saved to " << fileName << std::endl;
+    return true;
+}
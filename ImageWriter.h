@@ -0,0 +1,80 @@
+// ImageWriter.h
+#ifndef IMAGEWRITER_H
+#define IMAGEWRITER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Vector.h"
+
+class ThreadPool;
+
+enum ImageFormat {
+    IMAGE_PNG,   // 8 bit rgb, compressed
+    IMAGE_PPM,   // 8 bit rgb, binary P6
+    IMAGE_PFM    // 32 bit float rgb, unclamped, for HDR tools
+};
+
+// format of a file by its extension (.ppm, .pfm), png for anything else
+ImageFormat imageFormatFor(const std::string& fileName);
+// extension (with the dot) files of format are saved with
+std::string imageExtension(ImageFormat format);
+
+// clamps count colors to [0, 1] and stores them as rgb bytes, the same rounding
+// the renderer always used: (unsigned char)(c * 255)
+void colorsToBytes(const Vector* colors, std::size_t count, uint8_t* bytes);
+
+// writes an image buffer (row 0 = top) to disk in horizontal strips. a strip is encoded
+// by the thread that finishes its last pixel and written as soon as the strips before it
+// are on disk, so the file is written while the rest of the image is still rendering
+class ImageWriter {
+public:
+    ImageWriter(const std::string& fileName, int width, int height, const std::vector<Vector>& buffer);
+
+    bool isOpen() const;
+
+    // pixels [x0, x1) x [y0, y1) of the buffer hold their final color. every pixel must be
+    // reported once. can be called from several threads at a time
+    void regionDone(int x0, int y0, int x1, int y1);
+    // the whole buffer is final: ppm and pfm are converted and written in one go, png
+    // strips are filtered and compressed on the pool's threads
+    void writeAll(ThreadPool& pool);
+    // writes the end of the file and closes it, false when something went wrong
+    bool finish();
+
+private:
+    struct Strip {
+        std::vector<uint8_t> data;   // encoded, ready for the file
+        uint32_t adler = 1;          // png: checksum of the uncompressed strip
+        std::size_t rawSize = 0;
+        bool ready = false;
+    };
+
+    static const int kStripRows = 16;
+
+    int stripOf(int row) const;
+    void stripRows(int strip, int& first, int& last) const;
+    void encodeStrip(int strip);
+    void encodePngStrip(int strip, Strip& out);
+    void writeReady();
+    void writeChunk(const char* type, const uint8_t* data, std::size_t size);
+
+    std::string fileName;
+    ImageFormat format;
+    int width, height;
+    const std::vector<Vector>& buffer;
+    std::ofstream file;
+
+    std::vector<Strip> strips;
+    std::unique_ptr<std::atomic<int>[]> remaining;   // pixels of each strip not done yet
+    std::mutex lock;
+    int nextStrip;        // first strip not written yet
+    uint32_t adler;       // png: checksum of everything written so far
+};
+
+#endif // IMAGEWRITER_H
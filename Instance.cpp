@@ -0,0 +1,69 @@
+#include <filesystem>
+#include <iostream>
+#include "Instance.h"
+#include "Object.h"
+#include "Scene.h"
+#include "SceneCache.h"
+#include "MappedFile.h"
+#include "TriangleMesh.h"
+
+InstanceGeometry :: InstanceGeometry() : sourceHash(0) {}
+
+InstanceGeometry :: ~InstanceGeometry() {}
+
+bool loadInstanceGeometry(const std::string& path, InstanceGeometry& geometry) {
+    MappedFile file;
+    if (!file.open(path)) {
+        std::cerr << "Failed to open instance file: " << path << std::endl;
+        return false;
+    }
+    geometry.sourceHash = hashBytes(file.data(), file.size());
+    geometry.scene.reset(new Scene());
+    Scene& scene = *geometry.scene;
+    scene.instanceBlock = true;
+
+    if (std::filesystem::path(path).extension() == ".obj") {
+        auto mesh = std::make_shared<MeshGeometry>();
+        if (!loadObj(path, Vector(0, 0, 0), 1, *mesh)) return false;
+        scene.objects.push_back(scene.meshes.create(std::move(mesh), Vector(0, 0, 0), 0, false, false));
+        scene.bvh.build(scene.objects);
+        scene.primitives.build(scene.objects, scene.bvh);
+    } else if (!scene.loadFromText(file.data(), file.data() + file.size(), path)) {
+        return false;
+    }
+
+    if (!scene.bvh.unbounded.empty()) {
+        std::cerr << "Instance file " << path << " has planes, which cannot be instanced" << std::endl;
+        return false;
+    }
+    if (scene.bvh.nodes.empty()) {
+        std::cerr << "Instance file " << path << " has no objects" << std::endl;
+        return false;
+    }
+    geometry.bounds = scene.bvh.nodes[0].box;
+    return true;
+}
+
+void closestInstances(const InstanceSoA& instances, int begin, int count, const KernelRay& ray, float& tBest,
+                      int& idBest) {
+    Ray sceneRay(Vector(ray.ox, ray.oy, ray.oz), Vector(ray.dx, ray.dy, ray.dz));
+    for (int k = begin; k < begin + count; k++) {
+        float t = tBest;
+        HitRecord inner;
+        if (!instances.records[k]->closestHit(sceneRay, t, inner)) continue;
+        int id = instances.ids[k];
+        //back in scene units the distance can round past tBest
+        if (t < tBest || (t == tBest && id < idBest)) {
+            tBest = t;
+            idBest = id;
+        }
+    }
+}
+
+bool occludedInstances(const InstanceSoA& instances, int begin, int count, const KernelRay& ray, float tMax) {
+    Ray sceneRay(Vector(ray.ox, ray.oy, ray.oz), Vector(ray.dx, ray.dy, ray.dz));
+    for (int k = begin; k < begin + count; k++) {
+        if (instances.records[k]->occluded(sceneRay, tMax)) return true;
+    }
+    return false;
+}
@@ -0,0 +1,36 @@
+// Instance.h
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "AABB.h"
+#include "Kernels.h"
+
+class Scene;
+
+// geometry that instances share: the objects of a scene file (its camera and lights are
+// not used) or a single OBJ mesh, with their own BVH and primitive store. planes, which
+// have no bounds, and nested instances are not allowed in it
+class InstanceGeometry {
+public:
+    InstanceGeometry();
+    ~InstanceGeometry();
+
+    std::unique_ptr<Scene> scene;
+    AABB bounds;          // in object space
+    uint64_t sourceHash;  // of the file it was loaded from
+};
+
+// loads the geometry of path, an .obj file or a scene file. false (and a message) when
+// it cannot be read or holds nothing that can be instanced
+bool loadInstanceGeometry(const std::string& path, InstanceGeometry& geometry);
+
+// the instance counterparts of the kernels, over the instances [begin, begin + count) of
+// store. every instance runs its ray through the shared BVH on its own
+void closestInstances(const InstanceSoA& instances, int begin, int count, const KernelRay& ray, float& tBest,
+                      int& idBest);
+bool occludedInstances(const InstanceSoA& instances, int begin, int count, const KernelRay& ray, float tMax);
+
+#endif // INSTANCE_H
@@ -1,3 +1,4 @@
+#include <limits>
 #include "Intersection.h"
 #include "Scene.h"
 #include "Light.h"
@@ -5,10 +6,14 @@
 
 // Intersection class to store hit details
 
-Intersection :: ~Intersection() {}
-
 Intersection :: Intersection() : hit(false), distance(std::numeric_limits<float>::max()) {}
 Intersection :: Intersection(bool h, float d, Vector p, Vector n, Vector c, float s, bool r, bool t) : hit(h), distance(d), point(p), normal(n), color(c), shininess(s), reflective(r), transparent(t){}
 bool Intersection :: getHit(){
     return hit;
 }
+
+HitRecord :: HitRecord() : t(std::numeric_limits<float>::max()), primitive(-1) {}
+
+bool HitRecord :: hit() const {
+    return primitive >= 0;
+}
@@ -3,11 +3,19 @@
 
 #include "Vector.h"
 
+// what a ray query returns: the distance along the ray and the primitive ID hit
+// (-1 on a miss). the full Intersection is only built for the hit that gets shaded
+struct HitRecord {
+    float t;
+    int primitive;
 
+    HitRecord();
+    bool hit() const;
+};
 
+// the hit point with everything shading needs
 class Intersection {
 public:
-    virtual ~Intersection();
     bool hit;
     float distance;
     Vector point;
@@ -0,0 +1,335 @@
+// KernelTemplates.h
+#ifndef KERNELTEMPLATES_H
+#define KERNELTEMPLATES_H
+
+// kernel bodies shared by the scalar, SSE and AVX2 translation units. each unit
+// instantiates them with its own lane type L, which provides:
+//   F, M                 float lanes and comparison masks
+//   width                lanes per register
+//   set1, load           broadcast / load width floats
+//   add sub mul div sqrt neg abs
+//   min max              same operand order and NaN behaviour as std::min/std::max
+//   lt le gt ge          comparisons giving M
+//   both either          mask and / or
+//   select(m, a, b)      a where m is set, b elsewhere
+//   firstLanes(n)        mask of the first n lanes
+//   bits(m)              one bit per set lane
+//   store(p, a)          write width floats
+// only include this from a kernel .cpp file, and keep it free of library calls
+// (see SphereSoA).
+
+#include <cmath>
+#include "Kernels.h"
+
+namespace {
+
+template <class L>
+inline typename L::F dot3(typename L::F ax, typename L::F ay, typename L::F az,
+                          typename L::F bx, typename L::F by, typename L::F bz) {
+    return L::add(L::add(L::mul(ax, bx), L::mul(ay, by)), L::mul(az, bz));
+}
+
+//distance along each ray to each sphere, infinity on a miss. same steps as Sphere::intersect.
+//either the rays or the spheres may be broadcast across the lanes
+template <class L>
+inline typename L::F sphereDistance(typename L::F cx, typename L::F cy, typename L::F cz, typename L::F r,
+                                    typename L::F ox, typename L::F oy, typename L::F oz,
+                                    typename L::F dx, typename L::F dy, typename L::F dz) {
+    typedef typename L::F F;
+    F tcx = L::sub(cx, ox);
+    F tcy = L::sub(cy, oy);
+    F tcz = L::sub(cz, oz);
+
+    F projection = dot3<L>(tcx, tcy, tcz, dx, dy, dz);
+    F perpendicular2 = L::sub(dot3<L>(tcx, tcy, tcz, tcx, tcy, tcz), L::mul(projection, projection));
+    F r2 = L::mul(r, r);
+    typename L::M inside = L::le(perpendicular2, r2);
+
+    F halfChord = L::sqrt(L::sub(r2, perpendicular2));
+    F t0 = L::sub(projection, halfChord);
+    F t1 = L::add(projection, halfChord);
+    F eps = L::set1(1e-6f);
+    F inf = L::set1(HUGE_VALF);
+    F t = L::select(L::gt(t0, eps), t0, L::select(L::gt(t1, eps), t1, inf));
+    return L::select(inside, t, inf);
+}
+
+template <class L>
+inline typename L::F sphereDistance(const SphereSoA& s, int base, const KernelRay& ray) {
+    return sphereDistance<L>(L::load(&s.centerX[base]), L::load(&s.centerY[base]), L::load(&s.centerZ[base]),
+                             L::load(&s.radius[base]), L::set1(ray.ox), L::set1(ray.oy), L::set1(ray.oz),
+                             L::set1(ray.dx), L::set1(ray.dy), L::set1(ray.dz));
+}
+
+//distance along each ray to each cylinder (side or caps), infinity on a miss.
+//same steps as Cylinder::intersect
+template <class L>
+inline typename L::F cylinderDistance(typename L::F cx, typename L::F cy, typename L::F cz,
+                                      typename L::F vx, typename L::F vy, typename L::F vz,
+                                      typename L::F r, typename L::F halfHeight,
+                                      typename L::F ox, typename L::F oy, typename L::F oz,
+                                      typename L::F dx, typename L::F dy, typename L::F dz,
+                                      typename L::M* onCap = 0, typename L::M* onBottom = 0) {
+    typedef typename L::F F;
+    typedef typename L::M M;
+    F eps = L::set1(1e-6f);
+    F inf = L::set1(HUGE_VALF);
+
+    F cox = L::sub(ox, cx), coy = L::sub(oy, cy), coz = L::sub(oz, cz);
+    F dDotV = dot3<L>(dx, dy, dz, vx, vy, vz);
+    F dPerpX = L::sub(dx, L::mul(vx, dDotV));
+    F dPerpY = L::sub(dy, L::mul(vy, dDotV));
+    F dPerpZ = L::sub(dz, L::mul(vz, dDotV));
+    F coDotV = dot3<L>(cox, coy, coz, vx, vy, vz);
+    F coPerpX = L::sub(cox, L::mul(vx, coDotV));
+    F coPerpY = L::sub(coy, L::mul(vy, coDotV));
+    F coPerpZ = L::sub(coz, L::mul(vz, coDotV));
+
+    //curved surface
+    F A = dot3<L>(dPerpX, dPerpY, dPerpZ, dPerpX, dPerpY, dPerpZ);
+    F B = L::mul(L::set1(2.0f), dot3<L>(dPerpX, dPerpY, dPerpZ, coPerpX, coPerpY, coPerpZ));
+    F r2 = L::mul(r, r);
+    F C = L::sub(dot3<L>(coPerpX, coPerpY, coPerpZ, coPerpX, coPerpY, coPerpZ), r2);
+    F discriminant = L::sub(L::mul(B, B), L::mul(L::mul(L::set1(4.0f), A), C));
+    M sideOk = L::both(L::gt(L::abs(A), eps), L::ge(discriminant, L::set1(0.0f)));
+    F sqrtDisc = L::sqrt(discriminant);
+    F minusB = L::neg(B);
+    F twoA = L::mul(L::set1(2.0f), A);
+    F t0 = L::div(L::sub(minusB, sqrtDisc), twoA);
+    F t1 = L::div(L::add(minusB, sqrtDisc), twoA);
+    F y0 = dot3<L>(L::sub(L::add(ox, L::mul(dx, t0)), cx), L::sub(L::add(oy, L::mul(dy, t0)), cy),
+                   L::sub(L::add(oz, L::mul(dz, t0)), cz), vx, vy, vz);
+    F y1 = dot3<L>(L::sub(L::add(ox, L::mul(dx, t1)), cx), L::sub(L::add(oy, L::mul(dy, t1)), cy),
+                   L::sub(L::add(oz, L::mul(dz, t1)), cz), vx, vy, vz);
+    M hit0 = L::both(sideOk, L::both(L::gt(t0, eps), L::le(L::abs(y0), halfHeight)));
+    M hit1 = L::both(sideOk, L::both(L::gt(t1, eps), L::le(L::abs(y1), halfHeight)));
+    F tSide = L::select(hit0, t0, inf);
+    tSide = L::select(L::both(hit1, L::lt(t1, tSide)), t1, tSide);
+
+    //caps
+    M capOk = L::gt(L::abs(dDotV), eps);
+    F topX = L::add(cx, L::mul(vx, halfHeight));
+    F topY = L::add(cy, L::mul(vy, halfHeight));
+    F topZ = L::add(cz, L::mul(vz, halfHeight));
+    F tTop = L::div(dot3<L>(L::sub(topX, ox), L::sub(topY, oy), L::sub(topZ, oz), vx, vy, vz), dDotV);
+    F topDiffX = L::sub(L::add(ox, L::mul(dx, tTop)), topX);
+    F topDiffY = L::sub(L::add(oy, L::mul(dy, tTop)), topY);
+    F topDiffZ = L::sub(L::add(oz, L::mul(dz, tTop)), topZ);
+    M hitTop = L::both(capOk, L::both(L::gt(tTop, eps),
+                       L::le(dot3<L>(topDiffX, topDiffY, topDiffZ, topDiffX, topDiffY, topDiffZ), r2)));
+    F bottomX = L::sub(cx, L::mul(vx, halfHeight));
+    F bottomY = L::sub(cy, L::mul(vy, halfHeight));
+    F bottomZ = L::sub(cz, L::mul(vz, halfHeight));
+    F tBottom = L::div(dot3<L>(L::sub(bottomX, ox), L::sub(bottomY, oy), L::sub(bottomZ, oz), vx, vy, vz), dDotV);
+    F bottomDiffX = L::sub(L::add(ox, L::mul(dx, tBottom)), bottomX);
+    F bottomDiffY = L::sub(L::add(oy, L::mul(dy, tBottom)), bottomY);
+    F bottomDiffZ = L::sub(L::add(oz, L::mul(dz, tBottom)), bottomZ);
+    M hitBottom = L::both(capOk, L::both(L::gt(tBottom, eps),
+                          L::le(dot3<L>(bottomDiffX, bottomDiffY, bottomDiffZ, bottomDiffX, bottomDiffY, bottomDiffZ), r2)));
+    F tCap = L::select(hitTop, tTop, inf);
+    tCap = L::select(L::both(hitBottom, L::lt(tBottom, tCap)), tBottom, tCap);
+
+    //the side wins ties, like in Cylinder::intersect
+    M capWins = L::lt(tCap, tSide);
+    if (onCap) *onCap = capWins;
+    if (onBottom) *onBottom = L::both(hitBottom, L::lt(tBottom, L::select(hitTop, tTop, inf)));
+    return L::select(capWins, tCap, tSide);
+}
+
+template <class L>
+inline typename L::F cylinderDistance(const CylinderSoA& c, int base, const KernelRay& ray) {
+    return cylinderDistance<L>(L::load(&c.centerX[base]), L::load(&c.centerY[base]), L::load(&c.centerZ[base]),
+                               L::load(&c.axisX[base]), L::load(&c.axisY[base]), L::load(&c.axisZ[base]),
+                               L::load(&c.radius[base]), L::load(&c.halfHeight[base]),
+                               L::set1(ray.ox), L::set1(ray.oy), L::set1(ray.oz),
+                               L::set1(ray.dx), L::set1(ray.dy), L::set1(ray.dz));
+}
+
+//keep the closest lane among the ones marked in candidates
+template <class L>
+inline void pickClosest(typename L::F t, typename L::M candidates, const int* ids, int base,
+                        float& tBest, int& idBest) {
+    int bits = L::bits(candidates);
+    if (bits == 0) return;
+    float lanes[L::width];
+    L::store(lanes, t);
+    for (int lane = 0; lane < L::width; lane++) {
+        if (!(bits & (1 << lane))) continue;
+        int id = ids[base + lane];
+        if (lanes[lane] < tBest || (lanes[lane] == tBest && id < idBest)) {
+            tBest = lanes[lane];
+            idBest = id;
+        }
+    }
+}
+
+template <class L>
+void closestSpheresT(const SphereSoA& s, int begin, int count, const KernelRay& ray, float& tBest, int& idBest) {
+    for (int base = begin; base < begin + count; base += L::width) {
+        typename L::F t = sphereDistance<L>(s, base, ray);
+        typename L::M candidates = L::both(L::firstLanes(begin + count - base), L::le(t, L::set1(tBest)));
+        pickClosest<L>(t, candidates, s.ids, base, tBest, idBest);
+    }
+}
+
+template <class L>
+bool occludedSpheresT(const SphereSoA& s, int begin, int count, const KernelRay& ray, float tMax) {
+    for (int base = begin; base < begin + count; base += L::width) {
+        typename L::F t = sphereDistance<L>(s, base, ray);
+        if (L::bits(L::both(L::firstLanes(begin + count - base), L::lt(t, L::set1(tMax))))) return true;
+    }
+    return false;
+}
+
+template <class L>
+void closestCylindersT(const CylinderSoA& c, int begin, int count, const KernelRay& ray, float& tBest, int& idBest) {
+    for (int base = begin; base < begin + count; base += L::width) {
+        typename L::F t = cylinderDistance<L>(c, base, ray);
+        typename L::M candidates = L::both(L::firstLanes(begin + count - base), L::le(t, L::set1(tBest)));
+        pickClosest<L>(t, candidates, c.ids, base, tBest, idBest);
+    }
+}
+
+template <class L>
+bool occludedCylindersT(const CylinderSoA& c, int begin, int count, const KernelRay& ray, float tMax) {
+    for (int base = begin; base < begin + count; base += L::width) {
+        typename L::F t = cylinderDistance<L>(c, base, ray);
+        if (L::bits(L::both(L::firstLanes(begin + count - base), L::lt(t, L::set1(tMax))))) return true;
+    }
+    return false;
+}
+
+//lanes of mask that belong to the register starting at ray base
+template <class L>
+inline int packetLanes(uint64_t mask, int base) {
+    return (int)((mask >> base) & ((1ull << L::width) - 1));
+}
+
+//record hits that are closer than a ray's best so far (lower id on ties)
+template <class L>
+inline void pickClosestRays(typename L::F t, int candidates, int id, RayPacket& packet, int base) {
+    if (candidates == 0) return;
+    float lanes[L::width];
+    L::store(lanes, t);
+    for (int lane = 0; lane < L::width; lane++) {
+        if (!(candidates & (1 << lane))) continue;
+        int ray = base + lane;
+        if (lanes[lane] < packet.t[ray] || (lanes[lane] == packet.t[ray] && id < packet.id[ray])) {
+            packet.t[ray] = lanes[lane];
+            packet.id[ray] = id;
+        }
+    }
+}
+
+//packet kernels: every primitive of the run is broadcast and tested against
+//L::width rays of the packet at a time, skipping registers without active rays
+template <class L>
+void closestSpheresPacketT(const SphereSoA& s, int begin, int count, RayPacket& packet, uint64_t rays) {
+    for (int k = begin; k < begin + count; k++) {
+        typename L::F cx = L::set1(s.centerX[k]), cy = L::set1(s.centerY[k]), cz = L::set1(s.centerZ[k]);
+        typename L::F r = L::set1(s.radius[k]);
+        for (int base = 0; base < packet.count; base += L::width) {
+            int active = packetLanes<L>(rays, base);
+            if (!active) continue;
+            typename L::F t = sphereDistance<L>(cx, cy, cz, r,
+                L::load(packet.ox + base), L::load(packet.oy + base), L::load(packet.oz + base),
+                L::load(packet.dx + base), L::load(packet.dy + base), L::load(packet.dz + base));
+            pickClosestRays<L>(t, active & L::bits(L::le(t, L::load(packet.t + base))), s.ids[k], packet, base);
+        }
+    }
+}
+
+template <class L>
+uint64_t occludedSpheresPacketT(const SphereSoA& s, int begin, int count, const RayPacket& packet, uint64_t rays) {
+    uint64_t occluded = 0;
+    for (int k = begin; k < begin + count && occluded != rays; k++) {
+        typename L::F cx = L::set1(s.centerX[k]), cy = L::set1(s.centerY[k]), cz = L::set1(s.centerZ[k]);
+        typename L::F r = L::set1(s.radius[k]);
+        for (int base = 0; base < packet.count; base += L::width) {
+            int active = packetLanes<L>(rays & ~occluded, base);
+            if (!active) continue;
+            typename L::F t = sphereDistance<L>(cx, cy, cz, r,
+                L::load(packet.ox + base), L::load(packet.oy + base), L::load(packet.oz + base),
+                L::load(packet.dx + base), L::load(packet.dy + base), L::load(packet.dz + base));
+            occluded |= (uint64_t)(active & L::bits(L::lt(t, L::load(packet.t + base)))) << base;
+        }
+    }
+    return occluded;
+}
+
+template <class L>
+void closestCylindersPacketT(const CylinderSoA& c, int begin, int count, RayPacket& packet, uint64_t rays) {
+    for (int k = begin; k < begin + count; k++) {
+        typename L::F cx = L::set1(c.centerX[k]), cy = L::set1(c.centerY[k]), cz = L::set1(c.centerZ[k]);
+        typename L::F vx = L::set1(c.axisX[k]), vy = L::set1(c.axisY[k]), vz = L::set1(c.axisZ[k]);
+        typename L::F r = L::set1(c.radius[k]), halfHeight = L::set1(c.halfHeight[k]);
+        for (int base = 0; base < packet.count; base += L::width) {
+            int active = packetLanes<L>(rays, base);
+            if (!active) continue;
+            typename L::F t = cylinderDistance<L>(cx, cy, cz, vx, vy, vz, r, halfHeight,
+                L::load(packet.ox + base), L::load(packet.oy + base), L::load(packet.oz + base),
+                L::load(packet.dx + base), L::load(packet.dy + base), L::load(packet.dz + base));
+            pickClosestRays<L>(t, active & L::bits(L::le(t, L::load(packet.t + base))), c.ids[k], packet, base);
+        }
+    }
+}
+
+template <class L>
+uint64_t occludedCylindersPacketT(const CylinderSoA& c, int begin, int count, const RayPacket& packet, uint64_t rays) {
+    uint64_t occluded = 0;
+    for (int k = begin; k < begin + count && occluded != rays; k++) {
+        typename L::F cx = L::set1(c.centerX[k]), cy = L::set1(c.centerY[k]), cz = L::set1(c.centerZ[k]);
+        typename L::F vx = L::set1(c.axisX[k]), vy = L::set1(c.axisY[k]), vz = L::set1(c.axisZ[k]);
+        typename L::F r = L::set1(c.radius[k]), halfHeight = L::set1(c.halfHeight[k]);
+        for (int base = 0; base < packet.count; base += L::width) {
+            int active = packetLanes<L>(rays & ~occluded, base);
+            if (!active) continue;
+            typename L::F t = cylinderDistance<L>(cx, cy, cz, vx, vy, vz, r, halfHeight,
+                L::load(packet.ox + base), L::load(packet.oy + base), L::load(packet.oz + base),
+                L::load(packet.dx + base), L::load(packet.dy + base), L::load(packet.dz + base));
+            occluded |= (uint64_t)(active & L::bits(L::lt(t, L::load(packet.t + base)))) << base;
+        }
+    }
+    return occluded;
+}
+
+//rays of the mask whose [0, t] range overlaps the box. same steps as intersectBox in AABB.cpp
+template <class L>
+uint64_t boxPacketT(const float* boxMin, const float* boxMax, const RayPacket& packet, uint64_t rays) {
+    typedef typename L::F F;
+    F minX = L::set1(boxMin[0]), minY = L::set1(boxMin[1]), minZ = L::set1(boxMin[2]);
+    F maxX = L::set1(boxMax[0]), maxY = L::set1(boxMax[1]), maxZ = L::set1(boxMax[2]);
+    uint64_t hit = 0;
+    for (int base = 0; base < packet.count; base += L::width) {
+        int active = packetLanes<L>(rays, base);
+        if (!active) continue;
+        F ox = L::load(packet.ox + base), oy = L::load(packet.oy + base), oz = L::load(packet.oz + base);
+        F ix = L::load(packet.invDx + base), iy = L::load(packet.invDy + base), iz = L::load(packet.invDz + base);
+        F tx0 = L::mul(L::sub(minX, ox), ix), tx1 = L::mul(L::sub(maxX, ox), ix);
+        F ty0 = L::mul(L::sub(minY, oy), iy), ty1 = L::mul(L::sub(maxY, oy), iy);
+        F tz0 = L::mul(L::sub(minZ, oz), iz), tz1 = L::mul(L::sub(maxZ, oz), iz);
+        F tEnter = L::max(L::max(L::min(tx0, tx1), L::min(ty0, ty1)), L::max(L::min(tz0, tz1), L::set1(0.0f)));
+        F tExit = L::min(L::min(L::max(tx0, tx1), L::max(ty0, ty1)),
+                         L::min(L::max(tz0, tz1), L::load(packet.t + base)));
+        hit |= (uint64_t)(active & L::bits(L::le(tEnter, tExit))) << base;
+    }
+    return hit;
+}
+
+template <class L>
+void fillTable(KernelTable& table, const char* name) {
+    table.name = name;
+    table.closestSpheres = closestSpheresT<L>;
+    table.occludedSpheres = occludedSpheresT<L>;
+    table.closestCylinders = closestCylindersT<L>;
+    table.occludedCylinders = occludedCylindersT<L>;
+    table.closestSpheresPacket = closestSpheresPacketT<L>;
+    table.occludedSpheresPacket = occludedSpheresPacketT<L>;
+    table.closestCylindersPacket = closestCylindersPacketT<L>;
+    table.occludedCylindersPacket = occludedCylindersPacketT<L>;
+    table.boxPacket = boxPacketT<L>;
+}
+
+}
+
+#endif // KERNELTEMPLATES_H
@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include "Kernels.h"
+#include "KernelTemplates.h"
+
+namespace {
+
+// one lane per "register": the portable fallback
+struct ScalarLanes {
+    typedef float F;
+    typedef bool M;
+    static const int width = 1;
+
+    static F set1(float a) { return a; }
+    static F load(const float* p) { return *p; }
+    static void store(float* p, F a) { *p = a; }
+    static F add(F a, F b) { return a + b; }
+    static F sub(F a, F b) { return a - b; }
+    static F mul(F a, F b) { return a * b; }
+    static F div(F a, F b) { return a / b; }
+    static F sqrt(F a) { return std::sqrt(a); }
+    static F neg(F a) { return -a; }
+    static F abs(F a) { return std::abs(a); }
+    static F min(F a, F b) { return std::min(a, b); }
+    static F max(F a, F b) { return std::max(a, b); }
+    static M lt(F a, F b) { return a < b; }
+    static M le(F a, F b) { return a <= b; }
+    static M gt(F a, F b) { return a > b; }
+    static M ge(F a, F b) { return a >= b; }
+    static M both(M a, M b) { return a && b; }
+    static M either(M a, M b) { return a || b; }
+    static F select(M m, F a, F b) { return m ? a : b; }
+    static M firstLanes(int n) { return n > 0; }
+    static int bits(M m) { return m ? 1 : 0; }
+};
+
+const KernelTable* active = nullptr;
+KernelTable activeTable;
+
+bool cpuHas(const char* feature) {
+#if defined(__x86_64__) || defined(__i386__)
+    std::string name = feature;
+    if (name == "avx2") return __builtin_cpu_supports("avx2");
+    if (name == "sse") return __builtin_cpu_supports("sse2");
+#endif
+    (void)feature;
+    return false;
+}
+
+}
+
+bool scalarKernels(KernelTable& table) {
+    fillTable<ScalarLanes>(table, "scalar");
+    return true;
+}
+
+bool selectKernels(const std::string& name) {
+    KernelTable table;
+    bool found = false;
+    if (name == "auto") {
+        found = (cpuHas("avx2") && avx2Kernels(table)) ||
+                (cpuHas("sse") && sseKernels(table)) ||
+                scalarKernels(table);
+    } else if (name == "avx2") {
+        found = cpuHas("avx2") && avx2Kernels(table);
+    } else if (name == "sse") {
+        found = cpuHas("sse") && sseKernels(table);
+    } else if (name == "scalar") {
+        found = scalarKernels(table);
+    }
+    if (!found) {
+        std::cerr << "Intersection kernels '" << name << "' are not available on this machine." << std::endl;
+        return false;
+    }
+    activeTable = table;
+    active = &activeTable;
+    return true;
+}
+
+const KernelTable& activeKernels() {
+    if (!active) selectKernels("auto");
+    return *active;
+}
+
+void cylinderSurface(const CylinderSoA& c, int slot, const KernelRay& ray, bool& onCap, bool& onBottom) {
+    cylinderDistance<ScalarLanes>(c.centerX[slot], c.centerY[slot], c.centerZ[slot],
+                                  c.axisX[slot], c.axisY[slot], c.axisZ[slot], c.radius[slot], c.halfHeight[slot],
+                                  ray.ox, ray.oy, ray.oz, ray.dx, ray.dy, ray.dz, &onCap, &onBottom);
+}
+
+//same steps as Plane::intersect, minus the shading data
+void closestPlanes(const PlaneSoA& planes, const KernelRay& ray, float& tBest, int& idBest) {
+    for (int k = 0; k < planes.count; k++) {
+        float denominator = planes.normalX[k] * ray.dx + planes.normalY[k] * ray.dy + planes.normalZ[k] * ray.dz;
+        if (std::abs(denominator) < 1e-6) continue;
+        float t = -(planes.normalX[k] * ray.ox + planes.normalY[k] * ray.oy + planes.normalZ[k] * ray.oz + planes.d[k]) / denominator;
+        if (t < 1e-6) continue;
+        int id = planes.ids[k];
+        if (t < tBest || (t == tBest && id < idBest)) {
+            tBest = t;
+            idBest = id;
+        }
+    }
+}
+
+bool occludedPlanes(const PlaneSoA& planes, const KernelRay& ray, float tMax) {
+    for (int k = 0; k < planes.count; k++) {
+        float denominator = planes.normalX[k] * ray.dx + planes.normalY[k] * ray.dy + planes.normalZ[k] * ray.dz;
+        if (std::abs(denominator) < 1e-6) continue;
+        float t = -(planes.normalX[k] * ray.ox + planes.normalY[k] * ray.oy + planes.normalZ[k] * ray.oz + planes.d[k]) / denominator;
+        if (!(t < 1e-6) && t < tMax) return true;
+    }
+    return false;
+}
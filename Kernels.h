@@ -0,0 +1,54 @@
+// Kernels.h
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <string>
+#include "PrimitiveStore.h"
+#include "RayPacket.h"
+
+// ray in plain floats, as the kernels read it
+struct KernelRay {
+    float ox, oy, oz;
+    float dx, dy, dz;
+};
+
+// intersection kernels that test one ray against a run of [begin, begin + count)
+// entries of a typed array. closest* lower tBest/idBest when an entry is hit closer
+// (on equal distance the lower primitive ID wins). occluded* return true when any
+// entry is hit closer than tMax. the arithmetic is the same as in Object.cpp, so
+// every variant gives bit-identical results
+struct KernelTable {
+    const char* name;
+    void (*closestSpheres)(const SphereSoA& spheres, int begin, int count, const KernelRay& ray, float& tBest, int& idBest);
+    bool (*occludedSpheres)(const SphereSoA& spheres, int begin, int count, const KernelRay& ray, float tMax);
+    void (*closestCylinders)(const CylinderSoA& cylinders, int begin, int count, const KernelRay& ray, float& tBest, int& idBest);
+    bool (*occludedCylinders)(const CylinderSoA& cylinders, int begin, int count, const KernelRay& ray, float tMax);
+
+    // the same tests for the rays of a packet selected by the mask rays. the
+    // occluded* versions return the mask of rays that are blocked before their t
+    void (*closestSpheresPacket)(const SphereSoA& spheres, int begin, int count, RayPacket& packet, uint64_t rays);
+    uint64_t (*occludedSpheresPacket)(const SphereSoA& spheres, int begin, int count, const RayPacket& packet, uint64_t rays);
+    void (*closestCylindersPacket)(const CylinderSoA& cylinders, int begin, int count, RayPacket& packet, uint64_t rays);
+    uint64_t (*occludedCylindersPacket)(const CylinderSoA& cylinders, int begin, int count, const RayPacket& packet, uint64_t rays);
+    // mask of the rays that overlap the box before their t
+    uint64_t (*boxPacket)(const float* boxMin, const float* boxMax, const RayPacket& packet, uint64_t rays);
+};
+
+// the kernels in use, picked on first use from what the CPU supports
+const KernelTable& activeKernels();
+// "auto", "scalar", "sse" or "avx2". returns false if not available on this machine
+bool selectKernels(const std::string& name);
+
+// per instruction set tables, false when that set was not compiled in
+bool scalarKernels(KernelTable& table);
+bool sseKernels(KernelTable& table);
+bool avx2Kernels(KernelTable& table);
+
+// which surface of cylinder slot the ray hits first: the curved side, or the top or bottom cap
+void cylinderSurface(const CylinderSoA& cylinders, int slot, const KernelRay& ray, bool& onCap, bool& onBottom);
+
+// planes are few and unbounded, they always use the scalar code
+void closestPlanes(const PlaneSoA& planes, const KernelRay& ray, float& tBest, int& idBest);
+bool occludedPlanes(const PlaneSoA& planes, const KernelRay& ray, float tMax);
+
+#endif // KERNELS_H
@@ -0,0 +1,54 @@
+// 8 lane kernels, built with -mavx2 on x86-64 (see makefile) and only used when
+// the CPU reports AVX2 support
+#include "Kernels.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#include "KernelTemplates.h"
+
+namespace {
+
+struct Avx2Lanes {
+    typedef __m256 F;
+    typedef __m256 M;
+    static const int width = 8;
+
+    static F set1(float a) { return _mm256_set1_ps(a); }
+    static F load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, F a) { _mm256_storeu_ps(p, a); }
+    static F add(F a, F b) { return _mm256_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+    static F div(F a, F b) { return _mm256_div_ps(a, b); }
+    static F sqrt(F a) { return _mm256_sqrt_ps(a); }
+    static F neg(F a) { return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)); }
+    static F abs(F a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    static F min(F a, F b) { return select(lt(b, a), b, a); }
+    static F max(F a, F b) { return select(lt(a, b), b, a); }
+    static M lt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static M le(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+    static M gt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static M ge(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    static M both(M a, M b) { return _mm256_and_ps(a, b); }
+    static M either(M a, M b) { return _mm256_or_ps(a, b); }
+    static F select(M m, F a, F b) { return _mm256_blendv_ps(b, a, m); }
+    static M firstLanes(int n) {
+        return _mm256_cmp_ps(_mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_ps((float)n), _CMP_LT_OQ);
+    }
+    static int bits(M m) { return _mm256_movemask_ps(m); }
+};
+
+}
+
+bool avx2Kernels(KernelTable& table) {
+    fillTable<Avx2Lanes>(table, "avx2");
+    return true;
+}
+
+#else
+
+bool avx2Kernels(KernelTable& /*table*/) {
+    return false;
+}
+
+#endif
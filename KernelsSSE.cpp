@@ -0,0 +1,51 @@
+// 4 lane kernels. SSE2 is part of every x86-64 CPU, so this file needs no extra flags
+#include "Kernels.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#include "KernelTemplates.h"
+
+namespace {
+
+struct SseLanes {
+    typedef __m128 F;
+    typedef __m128 M;
+    static const int width = 4;
+
+    static F set1(float a) { return _mm_set1_ps(a); }
+    static F load(const float* p) { return _mm_loadu_ps(p); }
+    static void store(float* p, F a) { _mm_storeu_ps(p, a); }
+    static F add(F a, F b) { return _mm_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+    static F div(F a, F b) { return _mm_div_ps(a, b); }
+    static F sqrt(F a) { return _mm_sqrt_ps(a); }
+    static F neg(F a) { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+    static F abs(F a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+    static F min(F a, F b) { return select(lt(b, a), b, a); }
+    static F max(F a, F b) { return select(lt(a, b), b, a); }
+    static M lt(F a, F b) { return _mm_cmplt_ps(a, b); }
+    static M le(F a, F b) { return _mm_cmple_ps(a, b); }
+    static M gt(F a, F b) { return _mm_cmpgt_ps(a, b); }
+    static M ge(F a, F b) { return _mm_cmpge_ps(a, b); }
+    static M both(M a, M b) { return _mm_and_ps(a, b); }
+    static M either(M a, M b) { return _mm_or_ps(a, b); }
+    static F select(M m, F a, F b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+    static M firstLanes(int n) { return _mm_cmplt_ps(_mm_setr_ps(0, 1, 2, 3), _mm_set1_ps((float)n)); }
+    static int bits(M m) { return _mm_movemask_ps(m); }
+};
+
+}
+
+bool sseKernels(KernelTable& table) {
+    fillTable<SseLanes>(table, "sse");
+    return true;
+}
+
+#else
+
+bool sseKernels(KernelTable& /*table*/) {
+    return false;
+}
+
+#endif
@@ -5,17 +5,29 @@
 
 #include "Vector.h"
 
+enum LightType {
+    LIGHT_AMBIENT,
+    LIGHT_DIRECTIONAL,
+    LIGHT_SPOT
+};
+
+// like objects, lights live in per-type pools and carry their concrete type as a tag
 class Light {
 public:
+    explicit Light(LightType lightType);
     virtual ~Light();
+    LightType type() const { return lightType; }
     virtual Vector getDirection() const = 0;
     virtual Vector getIntensity() const = 0;
     virtual void setPosition(Vector pos, float cutoff) = 0;
     virtual Vector getDistance( Vector& point) const = 0 ;
     virtual void setIntensity(Vector color) = 0;
+
+private:
+    LightType lightType;
 };
 
-class AmbientLight : public Light {
+class AmbientLight final : public Light {
 public:
     Vector intensity;
 
@@ -27,7 +39,7 @@ public:
     void setIntensity(Vector color) override;
 };
 
-class DirectionalLight : public Light {
+class DirectionalLight final : public Light {
 public:
     Vector direction;
     Vector intensity;
@@ -40,7 +52,7 @@ public:
     void setIntensity(Vector color) override;
 };
 
-class Spotlight : public Light {
+class Spotlight final : public Light {
 public:
     Vector position;
     Vector direction;
@@ -57,4 +69,18 @@ public:
 
 };
 
+// a light as the renderer reads it for every shaded point: one flat record tagged by
+// type, with everything that does not depend on the point computed once at load
+struct ShadingLight {
+    LightType type;
+    Vector intensity;
+    Vector toLight;      // directional: the light's getDistance(), -direction
+    Vector toLightUnit;  // directional: toLight normalized, the shadow ray direction
+    Vector position;     // spotlight
+    Vector axis;         // spotlight: the normalized direction of the cone
+    float cutoff;        // spotlight: cosine of the cone's half angle, as in the scene file
+};
+
+ShadingLight shadingLight(const Light& light);
+
 #endif // LIGHT_H
\ No newline at end of file
@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <cmath>
+#include "LightTree.h"
+#include "AABB.h"
+
+namespace {
+
+//below this many spotlights the tree costs more than it culls
+const int kMinSpotlights = 8;
+const int kLeafSize = 4;
+const float kPi = 3.14159265f;
+//angle (radians) a node keeps in reserve for the float error of lightShadowRay's cone test
+const float kSlack = 2e-3f;
+
+float angleBetween(const Vector& a, const Vector& b) {
+    return std::acos(std::max(-1.0f, std::min(1.0f, a.dot(b))));
+}
+
+int buildNode(LightTree& tree, const std::vector<ShadingLight>& lights, int begin, int end) {
+    int index = (int)tree.nodes.size();
+    tree.nodes.push_back(LightTree::Node());
+    AABB box;
+    Vector axisSum(0, 0, 0);
+    for (int k = begin; k < end; k++) {
+        box.expand(lights[tree.order[k]].position);
+        axisSum = axisSum + lights[tree.order[k]].axis;
+    }
+
+    LightTree::Node node;
+    node.center = box.centroid();
+    node.radius = 0.0f;
+    float axisLength = axisSum.magnitude();
+    node.axis = axisLength > 1e-3f ? axisSum / axisLength : Vector(0, 0, 1);
+    //axes that cancel out leave no direction to cull by
+    node.spread = axisLength > 1e-3f ? 0.0f : kPi;
+    for (int k = begin; k < end; k++) {
+        const ShadingLight& light = lights[tree.order[k]];
+        node.radius = std::max(node.radius, (light.position - node.center).magnitude());
+        float cone = std::acos(std::max(-1.0f, std::min(1.0f, light.cutoff)));
+        node.spread = std::max(node.spread, angleBetween(node.axis, light.axis) + cone);
+    }
+    node.first = begin;
+    node.count = end - begin;
+    node.right = 0;
+
+    if (end - begin > kLeafSize) {
+        //median split of the positions along the widest axis of their box
+        int axis = box.longestAxis();
+        int middle = (begin + end) / 2;
+        auto coordinate = [&](int light) {
+            const Vector& p = lights[light].position;
+            return axis == 0 ? p.x : axis == 1 ? p.y : p.z;
+        };
+        std::nth_element(tree.order.begin() + begin, tree.order.begin() + middle, tree.order.begin() + end,
+                         [&](int a, int b) { return coordinate(a) < coordinate(b); });
+        buildNode(tree, lights, begin, middle);
+        node.right = buildNode(tree, lights, middle, end);
+    }
+    tree.nodes[index] = node;
+    return index;
+}
+
+//false only when no light under node can reach a point within radius of center
+bool mayReach(const LightTree::Node& node, const Vector& center, float radius) {
+    if (node.spread >= kPi) return true;
+    Vector offset = center - node.center;
+    float distance = offset.magnitude();
+    float reach = node.radius + radius;
+    if (distance <= reach) return true;
+    //every direction from the sphere to the point lies within asin(reach / distance) of offset
+    float alpha = angleBetween(offset / distance, node.axis);
+    return alpha <= std::asin(reach / distance) + node.spread + kSlack;
+}
+
+}
+
+void LightTree :: build(const std::vector<ShadingLight>& lights) {
+    nodes.clear();
+    order.clear();
+    directional.clear();
+    for (std::size_t l = 0; l < lights.size(); l++) {
+        if (lights[l].type == LIGHT_SPOT) order.push_back((int)l);
+        else directional.push_back((int)l);
+    }
+    if ((int)order.size() < kMinSpotlights) {
+        order.clear();
+        directional.clear();
+        return;
+    }
+    nodes.reserve(2 * order.size() / kLeafSize + 1);
+    buildNode(*this, lights, 0, (int)order.size());
+}
+
+int LightTree :: candidates(const Vector& center, float radius, std::vector<int>& out) const {
+    out.assign(directional.begin(), directional.end());
+    int culled = 0;
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        int index = stack[--top];
+        const Node& node = nodes[index];
+        if (!mayReach(node, center, radius)) {
+            culled += node.count;
+        } else if (node.right == 0) {
+            out.insert(out.end(), order.begin() + node.first, order.begin() + node.first + node.count);
+        } else {
+            stack[top++] = node.right;
+            stack[top++] = index + 1;
+        }
+    }
+    std::sort(out.begin(), out.end());
+    return culled;
+}
@@ -0,0 +1,40 @@
+// LightTree.h
+#ifndef LIGHTTREE_H
+#define LIGHTTREE_H
+
+#include <vector>
+#include "Vector.h"
+#include "Light.h"
+
+// a bounding volume hierarchy over the spotlights of a scene, so a shaded point only looks at
+// the lights that can reach it. a node bounds the positions of its lights with a sphere and
+// their cones with one cone of directions around their mean axis: a point whose direction
+// from the sphere falls outside it is lit by none of them. directional lights reach every
+// point and are always candidates. the culling is conservative, the exact cone test of
+// lightShadowRay still decides for every candidate, so the image does not change
+class LightTree {
+public:
+    struct Node {
+        Vector center;  // sphere around the positions of the node's lights
+        float radius;
+        Vector axis;    // normalized mean of their cone axes
+        float spread;   // largest angle from axis to a light's axis, plus that light's cone half angle
+        int first;      // the node's lights are [first, first + count) of order
+        int count;
+        int right;      // inner nodes: the second child, the first is this node + 1. 0 for leaves
+    };
+
+    // rebuilds the tree over the spotlights of lights. scenes with few spotlights get none,
+    // looking at every light is cheaper there
+    void build(const std::vector<ShadingLight>& lights);
+    bool empty() const { return nodes.empty(); }
+    // sets out to the indices, in scene order, of the lights that may reach a point within
+    // radius of center. returns how many spotlights were left out
+    int candidates(const Vector& center, float radius, std::vector<int>& out) const;
+
+    std::vector<Node> nodes;
+    std::vector<int> order;        // spotlight indices, grouped by leaf
+    std::vector<int> directional;  // the lights every point gets
+};
+
+#endif // LIGHTTREE_H
@@ -4,13 +4,15 @@
 
 // Base Light class
 
+    Light :: Light(LightType lightType) : lightType(lightType) {}
+
     Light:: ~Light() {}
 
 
 
 // Ambient Light class
 
-    AmbientLight :: AmbientLight(const Vector& inten) : intensity(inten) {}
+    AmbientLight :: AmbientLight(const Vector& inten) : Light(LIGHT_AMBIENT), intensity(inten) {}
 
     Vector AmbientLight :: getDirection() const  {
         return Vector(0, 0, 0);
@@ -33,7 +35,7 @@
 
 // Directional Light class
 
-    DirectionalLight :: DirectionalLight(const Vector& dir, const Vector& inten) : direction(dir), intensity(inten) {}
+    DirectionalLight :: DirectionalLight(const Vector& dir, const Vector& inten) : Light(LIGHT_DIRECTIONAL), direction(dir), intensity(inten) {}
 
     Vector DirectionalLight :: getDirection() const  {
         return direction;
@@ -56,7 +58,7 @@
 // Spotlight class
 
     Spotlight :: Spotlight(const Vector& pos, const Vector& dir, float cutoff, const Vector& inten)
-        : position(pos), direction(dir), cutoffAngle(cutoff), intensity(inten) {}
+        : Light(LIGHT_SPOT), position(pos), direction(dir), cutoffAngle(cutoff), intensity(inten) {}
 
     Vector Spotlight :: getDirection() const  {
         return direction;
@@ -79,4 +81,21 @@
         intensity = color;
     }
 
-
+// Shading data
+
+    ShadingLight shadingLight(const Light& light) {
+        ShadingLight shading;
+        shading.type = light.type();
+        shading.intensity = light.getIntensity();
+        shading.cutoff = 0;
+        if (light.type() == LIGHT_DIRECTIONAL) {
+            shading.toLight = static_cast<const DirectionalLight&>(light).direction * -1;
+            shading.toLightUnit = shading.toLight.normalize();
+        } else if (light.type() == LIGHT_SPOT) {
+            const Spotlight& spotlight = static_cast<const Spotlight&>(light);
+            shading.position = spotlight.position;
+            shading.axis = spotlight.direction.normalize();
+            shading.cutoff = spotlight.cutoffAngle;
+        }
+        return shading;
+    }
@@ -0,0 +1,54 @@
+#include <fstream>
+#include <iterator>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "MappedFile.h"
+
+MappedFile :: MappedFile() : bytes(nullptr), length(0), mapping(nullptr) {}
+
+MappedFile :: ~MappedFile() {
+    close();
+}
+
+bool MappedFile :: open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    bool known = fstat(fd, &info) == 0;
+    //reading a directory throws from the stream below
+    if (known && S_ISDIR(info.st_mode)) {
+        ::close(fd);
+        return false;
+    }
+    if (known && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* address = mmap(nullptr, (std::size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address != MAP_FAILED) {
+            //the file is read front to back
+            madvise(address, (std::size_t)info.st_size, MADV_SEQUENTIAL);
+            mapping = address;
+            bytes = static_cast<const char*>(address);
+            length = (std::size_t)info.st_size;
+            ::close(fd);
+            return true;
+        }
+    }
+    ::close(fd);
+
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file) return false;
+    contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    bytes = contents.data();
+    length = contents.size();
+    return true;
+}
+
+void MappedFile :: close() {
+    if (mapping) munmap(mapping, length);
+    mapping = nullptr;
+    bytes = nullptr;
+    length = 0;
+    std::vector<char>().swap(contents);
+}
@@ -0,0 +1,31 @@
+// MappedFile.h
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// read-only view of a whole file. the file is memory mapped, so nothing is copied
+// until a page is read; where mapping fails (empty files, pipes) it is read into memory
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    const char* data() const { return bytes; }
+    std::size_t size() const { return length; }
+
+private:
+    const char* bytes;
+    std::size_t length;
+    void* mapping;               // the mmap'ed range, or null
+    std::vector<char> contents;  // used when the file could not be mapped
+};
+
+#endif // MAPPEDFILE_H
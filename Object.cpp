@@ -10,14 +10,18 @@
 #include "Vector.h"
 #include "Scene.h"
 #include "Intersection.h"
+#include "TriangleMesh.h"
+#include "Instance.h"
 
 
+Object :: Object(PrimitiveType primitiveType) : primitiveType(primitiveType) {}
+
 Object :: ~Object() {}
 
 //plane
 Plane :: ~Plane() {}
 Plane::Plane(const Vector& n, float dist, const Vector& color, float s, bool t, bool r)
-    : colors(color), shininess(s), reflective(r), transparent(t) {
+    : Object(PRIMITIVE_PLANE), colors(color), shininess(s), reflective(r), transparent(t) {
     
     float magnitude = n.magnitude();
     if (magnitude > 1e-6) {
@@ -49,6 +53,14 @@ Intersection Plane::intersect(const Ray& ray) {
     return Intersection(true, t, intersectionPoint, normal.normalize(), color, shininess, reflective, transparent);
 }
 
+bool Plane::occluded(const Ray& ray, float tMax) const {
+    float denominator = normal.dot(ray.direction);
+    if (std::abs(denominator) < 1e-6) {
+        return false;
+    }
+    float t = -(normal.dot(ray.origin) + d) / denominator;
+    return !(t < 1e-6) && t < tMax;
+}
 
 void Plane :: setColor(const Vector& newColors, const float newShiness) {
     if (!reflective && !transparent )
@@ -83,13 +95,21 @@ Vector Plane :: checkerboardColor(const Vector& baseColor, const Vector& hitPoin
     return baseColor; 
     }
 
+bool Plane :: bounds(AABB& /*box*/) const {
+    return false;
+}
+
+Material Plane :: material() const {
+    return Material{colors, shininess, reflective, transparent};
+}
+
 
 
 // Sphere 
 Sphere :: ~Sphere(){}
 
 Sphere :: Sphere(const Vector& c, float radius, const Vector& color, float s, bool t, bool reflective)
-    : center(c), radius(radius), colors(color), shininess(s), reflective(reflective), transparent(t) {}
+    : Object(PRIMITIVE_SPHERE), center(c), radius(radius), colors(color), shininess(s), reflective(reflective), transparent(t) {}
 
 Intersection Sphere::intersect(const Ray& ray) {
     Vector rayOrigin = ray.origin; 
@@ -128,6 +148,24 @@ Intersection Sphere::intersect(const Ray& ray) {
     return Intersection(true, t, intersectionPoint, normal, colors, shininess, reflective, transparent);
 }
 
+bool Sphere::occluded(const Ray& ray, float tMax) const {
+    Vector toCenter = center - ray.origin;
+
+    float projectionLength = toCenter.dot(ray.direction);
+    float perpendicularDist2 = toCenter.dot(toCenter) - projectionLength * projectionLength;
+    if (perpendicularDist2 > radius * radius) {
+        return false;
+    }
+
+    // the near root is never larger than the far one, so test it first
+    float halfChord = std::sqrt(radius * radius - perpendicularDist2);
+    float t0 = projectionLength - halfChord;
+    if (t0 > 1e-6 && t0 < tMax) {
+        return true;
+    }
+    float t1 = projectionLength + halfChord;
+    return t1 > 1e-6 && t1 < tMax;
+}
 
 void Sphere :: setColor(const Vector& newColors, const float newShiness) {
     if (!reflective && !transparent )
@@ -138,11 +176,22 @@ void Sphere :: setColor(const Vector& newColors, const float newShiness) {
     
 }
 
+bool Sphere :: bounds(AABB& box) const {
+    // pad a little so rays starting on the surface still enter the box
+    float extent = radius + 1e-4f;
+    box = AABB(center - Vector(extent, extent, extent), center + Vector(extent, extent, extent));
+    return true;
+}
+
+Material Sphere :: material() const {
+    return Material{colors, shininess, reflective, transparent};
+}
+
 // Sphere 
 Cylinder :: ~Cylinder(){}
 
 Cylinder :: Cylinder(const Vector& center, const Vector& axis, float radius, float height, const Vector& colors, float shininess, bool reflective, bool transparent)
-    : center(center), radius(radius), height(height), colors(colors), shininess(shininess), reflective(reflective), transparent(transparent) {
+    : Object(PRIMITIVE_CYLINDER), center(center), radius(radius), height(height), colors(colors), shininess(shininess), reflective(reflective), transparent(transparent) {
     // Ensure the axis is normalized
     this->axis = axis.normalize();
 }
@@ -295,6 +344,57 @@ Intersection Cylinder::intersect(const Ray& ray) {
     return Intersection(true, t, intersectionPoint, normal, colors, shininess, reflective, transparent);
 }
 
+bool Cylinder::occluded(const Ray& ray, float tMax) const {
+    // same tests as intersect, but returns at the first surface closer than tMax
+    Vector O = ray.origin;
+    Vector d = ray.direction;
+    Vector C = center;
+    Vector v = axis;
+    Vector CO = O - C;
+
+    float d_dot_v = d.dot(v);
+    Vector d_perp = d - v * d_dot_v;
+    float CO_dot_v = CO.dot(v);
+    Vector CO_perp = CO - v * CO_dot_v;
+
+    float A = d_perp.dot(d_perp);
+    float B = 2.0f * d_perp.dot(CO_perp);
+    float C_coef = CO_perp.dot(CO_perp) - radius * radius;
+
+    if (std::abs(A) > 1e-6f) {
+        float discriminant = B * B - 4 * A * C_coef;
+        if (discriminant >= 0.0f) {
+            float sqrtDisc = std::sqrt(discriminant);
+            float t0 = (-B - sqrtDisc) / (2 * A);
+            float t1 = (-B + sqrtDisc) / (2 * A);
+            if (t0 > 1e-6f && t0 < tMax) {
+                float y0 = ((O + d * t0) - C).dot(v);
+                if (std::abs(y0) <= height / 2.0f) return true;
+            }
+            if (t1 > 1e-6f && t1 < tMax) {
+                float y1 = ((O + d * t1) - C).dot(v);
+                if (std::abs(y1) <= height / 2.0f) return true;
+            }
+        }
+    }
+
+    float denom = d.dot(v);
+    if (std::abs(denom) > 1e-6f) {
+        Vector capCenterTop = C + v * (height / 2.0f);
+        float tTop = (capCenterTop - O).dot(v) / denom;
+        if (tTop > 1e-6f && tTop < tMax) {
+            Vector diff = (O + d * tTop) - capCenterTop;
+            if (diff.dot(diff) <= radius * radius) return true;
+        }
+        Vector capCenterBottom = C - v * (height / 2.0f);
+        float tBottom = (capCenterBottom - O).dot(v) / denom;
+        if (tBottom > 1e-6f && tBottom < tMax) {
+            Vector diff = (O + d * tBottom) - capCenterBottom;
+            if (diff.dot(diff) <= radius * radius) return true;
+        }
+    }
+    return false;
+}
 
 void Cylinder :: setColor(const Vector& newColors, const float newShiness) {
     if (!reflective && !transparent )
@@ -305,6 +405,145 @@ void Cylinder :: setColor(const Vector& newColors, const float newShiness) {
     
 }
 
+bool Cylinder :: bounds(AABB& box) const {
+    // the caps are disks of the given radius around the axis ends, so along each
+    // world axis the cylinder reaches |axis_i| * height/2 + radius * sqrt(1 - axis_i^2)
+    float halfHeight = height / 2.0f;
+    Vector extent(
+        std::abs(axis.x) * halfHeight + radius * std::sqrt(std::max(0.0f, 1.0f - axis.x * axis.x)) + 1e-4f,
+        std::abs(axis.y) * halfHeight + radius * std::sqrt(std::max(0.0f, 1.0f - axis.y * axis.y)) + 1e-4f,
+        std::abs(axis.z) * halfHeight + radius * std::sqrt(std::max(0.0f, 1.0f - axis.z * axis.z)) + 1e-4f);
+    box = AABB(center - extent, center + extent);
+    return true;
+}
+
+Material Cylinder :: material() const {
+    return Material{colors, shininess, reflective, transparent};
+}
+
+//triangle mesh
+TriangleMesh :: ~TriangleMesh() {}
+
+TriangleMesh :: TriangleMesh(std::shared_ptr<const MeshGeometry> geometry, const Vector& color, float s, bool t, bool r)
+    : Object(PRIMITIVE_MESH), geometry(std::move(geometry)), colors(color), shininess(s), reflective(r), transparent(t) {}
+
+Intersection TriangleMesh :: intersect(const Ray& ray) {
+    KernelRay kernelRay{ray.origin.x, ray.origin.y, ray.origin.z, ray.direction.x, ray.direction.y, ray.direction.z};
+    float t = std::numeric_limits<float>::infinity();
+    int triangle = 0;
+    if (!geometry->closestHit(kernelRay, t, triangle)) {
+        return Intersection();
+    }
+    Vector point = ray.origin + ray.direction * t;
+    return Intersection(true, t, point, geometry->normal(triangle), colors, shininess, reflective, transparent);
+}
+
+bool TriangleMesh :: occluded(const Ray& ray, float tMax) const {
+    KernelRay kernelRay{ray.origin.x, ray.origin.y, ray.origin.z, ray.direction.x, ray.direction.y, ray.direction.z};
+    return geometry->occluded(kernelRay, tMax);
+}
+
+void TriangleMesh :: setColor(const Vector& newColors, const float newShiness) {
+    if (!reflective && !transparent) {
+        colors = newColors;
+        shininess = newShiness;
+    }
+}
+
+bool TriangleMesh :: bounds(AABB& box) const {
+    box = geometry->bounds;
+    return true;
+}
+
+Material TriangleMesh :: material() const {
+    return Material{colors, shininess, reflective, transparent};
+}
+
+//instance
+Instance :: ~Instance() {}
+
+Instance :: Instance(std::shared_ptr<const InstanceGeometry> geometry, const Vector& position, float scale,
+                     const Vector& axis, float degrees)
+    : Object(PRIMITIVE_INSTANCE), geometry(std::move(geometry)), position(position), scale(scale),
+      colors(0, 0, 0), shininess(0), overridden(false) {
+    //rotation around axis by degrees (Rodrigues), as rows
+    Vector k = axis.magnitude() > 1e-6 ? axis.normalize() : Vector(0, 0, 1);
+    float angle = axis.magnitude() > 1e-6 ? degrees * (float)M_PI / 180.0f : 0.0f;
+    float c = std::cos(angle), s = std::sin(angle), t = 1 - c;
+    rotation[0] = Vector(t * k.x * k.x + c, t * k.x * k.y - s * k.z, t * k.x * k.z + s * k.y);
+    rotation[1] = Vector(t * k.x * k.y + s * k.z, t * k.y * k.y + c, t * k.y * k.z - s * k.x);
+    rotation[2] = Vector(t * k.x * k.z - s * k.y, t * k.y * k.z + s * k.x, t * k.z * k.z + c);
+}
+
+Ray Instance :: toObject(const Ray& ray) const {
+    //the inverse of a rotation is its transpose
+    Vector offset = (ray.origin - position) / scale;
+    Vector origin = rotation[0] * offset.x + rotation[1] * offset.y + rotation[2] * offset.z;
+    Vector direction = rotation[0] * ray.direction.x + rotation[1] * ray.direction.y + rotation[2] * ray.direction.z;
+    return Ray(origin, direction);
+}
+
+bool Instance :: closestHit(const Ray& ray, float& t, HitRecord& inner) const {
+    const Scene& shared = *geometry->scene;
+    inner = HitRecord();
+    inner.t = t / scale;
+    shared.bvh.closestHit(toObject(ray), shared.primitives, inner);
+    if (!inner.hit()) return false;
+    t = inner.t * scale;
+    return true;
+}
+
+Intersection Instance :: surface(const Ray& ray, float t) const {
+    const Scene& shared = *geometry->scene;
+    Ray objectRay = toObject(ray);
+    HitRecord inner;
+    shared.bvh.closestHit(objectRay, shared.primitives, inner);
+    Intersection hit = shared.primitives.surface(objectRay, inner);
+    if (!hit.hit) return hit;
+    Vector n = hit.normal;
+    hit.normal = Vector(rotation[0].dot(n), rotation[1].dot(n), rotation[2].dot(n));
+    hit.distance = t;
+    hit.point = ray.origin + ray.direction * t;
+    if (overridden && !hit.reflective && !hit.transparent) {
+        hit.color = colors;
+        hit.shininess = shininess;
+    }
+    return hit;
+}
 
+Intersection Instance :: intersect(const Ray& ray) {
+    float t = std::numeric_limits<float>::max();
+    HitRecord inner;
+    if (!closestHit(ray, t, inner)) {
+        return Intersection();
+    }
+    return surface(ray, t);
+}
 
+bool Instance :: occluded(const Ray& ray, float tMax) const {
+    const Scene& shared = *geometry->scene;
+    return shared.bvh.anyHit(toObject(ray), shared.primitives, tMax / scale);
+}
 
+void Instance :: setColor(const Vector& newColors, const float newShiness) {
+    colors = newColors;
+    shininess = newShiness;
+    overridden = true;
+}
+
+bool Instance :: bounds(AABB& box) const {
+    //the box around the eight moved corners of the geometry's box
+    const AABB& local = geometry->bounds;
+    box = AABB();
+    for (int corner = 0; corner < 8; corner++) {
+        Vector p((corner & 1) ? local.max.x : local.min.x, (corner & 2) ? local.max.y : local.min.y,
+                 (corner & 4) ? local.max.z : local.min.z);
+        p = p * scale;
+        box.expand(Vector(rotation[0].dot(p), rotation[1].dot(p), rotation[2].dot(p)) + position);
+    }
+    return true;
+}
+
+Material Instance :: material() const {
+    return Material{colors, shininess, false, false};
+}
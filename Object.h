@@ -1,21 +1,49 @@
 #ifndef OBJECT_H
 #define OBJECT_H
 
+#include <memory>
 #include "Vector.h"
 #include "Ray.h"
 #include "Intersection.h"
+#include "AABB.h"
+#include "PrimitiveStore.h"
 
 
+enum PrimitiveType {
+    PRIMITIVE_SPHERE,
+    PRIMITIVE_PLANE,
+    PRIMITIVE_CYLINDER,
+    PRIMITIVE_MESH,
+    PRIMITIVE_INSTANCE
+};
+
+class MeshGeometry;
+class InstanceGeometry;
 
+// the scene keeps objects in per-type pools (see Scene.h) and every object carries its
+// concrete type as a tag, so code that needs the concrete class switches on type()
+// (or uses visitObject below) instead of going through the virtual functions
 class Object {
 public:
+    explicit Object(PrimitiveType primitiveType);
     virtual ~Object();
     virtual Intersection intersect(const Ray& ray) = 0;
+    // any-hit test for shadow rays: true when intersect would report a hit closer
+    // than tMax. stops at the first such hit and computes no shading data
+    virtual bool occluded(const Ray& ray, float tMax) const = 0;
     virtual void setColor(const Vector& newColors, const float newShiness) = 0;
+    // box around the whole object, false for unbounded objects such as planes
+    virtual bool bounds(AABB& box) const = 0;
+    PrimitiveType type() const { return primitiveType; }
+    // shading data, as stored in the scene's material table
+    virtual Material material() const = 0;
+
+private:
+    PrimitiveType primitiveType;
 };
 
 // Plane and Sphere declarations remain unchanged
-class Plane : public Object {
+class Plane final : public Object {
 public:
     Vector normal;
     Vector colors;
@@ -26,11 +54,14 @@ public:
     virtual ~Plane(); 
     Plane(const Vector& n, float dist, const Vector& color, float s, bool t, bool r);
     Intersection intersect(const Ray& ray) override;
+    bool occluded(const Ray& ray, float tMax) const override;
     void setColor(const Vector& newColors, const float newShiness) override;
-    Vector checkerboardColor(const Vector& baseColor, const Vector& hitPoint)  ;
+    static Vector checkerboardColor(const Vector& baseColor, const Vector& hitPoint)  ;
+    bool bounds(AABB& box) const override;
+    Material material() const override;
 };
 
-class Sphere : public Object {
+class Sphere final : public Object {
 public:
     Vector center;
     float radius;
@@ -41,10 +72,13 @@ public:
     virtual ~ Sphere();
     Sphere(const Vector& c, float radius, const Vector& color, float s, bool t, bool reflective);
     Intersection intersect(const Ray& ray)  override;
+    bool occluded(const Ray& ray, float tMax) const override;
     void setColor(const Vector& newColors, const float newShiness) override;
+    bool bounds(AABB& box) const override;
+    Material material() const override;
 };
 
-class Cylinder : public Object {
+class Cylinder final : public Object {
 public:
     Vector center;       // Center of the cylinder (middle of its height)
     Vector axis;         // Unit vector along the cylinder's axis
@@ -58,7 +92,76 @@ public:
     virtual ~Cylinder();
     Cylinder(const Vector& center, const Vector& axis, float radius, float height, const Vector& colors, float shininess, bool reflective, bool transparent);
     Intersection intersect(const Ray& ray)  override;
+    bool occluded(const Ray& ray, float tMax) const override;
     void setColor(const Vector& newColors, const float newShiness) override;
+    bool bounds(AABB& box) const override;
+    Material material() const override;
 };
 
+// triangles from an OBJ file (TriangleMesh.h), one object with one material. the
+// geometry and its BVH are immutable once loaded and could be shared
+class TriangleMesh final : public Object {
+public:
+    std::shared_ptr<const MeshGeometry> geometry;
+    Vector colors;
+    float shininess;
+    bool reflective;
+    bool transparent;
+
+    virtual ~TriangleMesh();
+    TriangleMesh(std::shared_ptr<const MeshGeometry> geometry, const Vector& color, float s, bool t, bool r);
+    Intersection intersect(const Ray& ray) override;
+    bool occluded(const Ray& ray, float tMax) const override;
+    void setColor(const Vector& newColors, const float newShiness) override;
+    bool bounds(AABB& box) const override;
+    Material material() const override;
+};
+
+// a placed copy of shared geometry (Instance.h): object space is rotated, uniformly
+// scaled and moved into the scene. only this record is stored per copy, the geometry
+// and its BVH are shared. a 'c' line overrides the color and shininess of the
+// geometry's opaque primitives, without one they keep their own
+class Instance final : public Object {
+public:
+    std::shared_ptr<const InstanceGeometry> geometry;
+    Vector rotation[3];  // rows of the object to scene rotation
+    Vector position;
+    float scale;
+    Vector colors;
+    float shininess;
+    bool overridden;
+
+    virtual ~Instance();
+    // rotated by degrees around axis (none for a zero axis), then scaled and moved to position
+    Instance(std::shared_ptr<const InstanceGeometry> geometry, const Vector& position, float scale,
+             const Vector& axis, float degrees);
+    Intersection intersect(const Ray& ray) override;
+    bool occluded(const Ray& ray, float tMax) const override;
+    void setColor(const Vector& newColors, const float newShiness) override;
+    bool bounds(AABB& box) const override;
+    Material material() const override;
+
+    // ray in object space. its direction stays unit length and distances there are the
+    // scene's divided by scale
+    Ray toObject(const Ray& ray) const;
+    // closest hit of the geometry closer than t: lowers t (in scene units) and sets inner
+    // to the hit in object space
+    bool closestHit(const Ray& ray, float& t, HitRecord& inner) const;
+    // the full hit at distance t, found by closestHit
+    Intersection surface(const Ray& ray, float t) const;
+};
+
+// calls visitor with object as its concrete class, picked by the type tag. the
+// classes are final, so calls made through the visitor are not virtual
+template <class Visitor>
+auto visitObject(const Object& object, Visitor&& visitor) {
+    switch (object.type()) {
+        case PRIMITIVE_SPHERE: return visitor(static_cast<const Sphere&>(object));
+        case PRIMITIVE_PLANE: return visitor(static_cast<const Plane&>(object));
+        case PRIMITIVE_MESH: return visitor(static_cast<const TriangleMesh&>(object));
+        case PRIMITIVE_INSTANCE: return visitor(static_cast<const Instance&>(object));
+        default: return visitor(static_cast<const Cylinder&>(object));
+    }
+}
+
 #endif // OBJECT_H
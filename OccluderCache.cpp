@@ -0,0 +1,72 @@
+#include "OccluderCache.h"
+#include "Kernels.h"
+#include "RenderStats.h"
+#include "Scene.h"
+
+namespace {
+
+bool cacheEnabled = true;
+//by light, the ID of the primitive that last blocked one of the thread's shadow rays, -1 for none
+thread_local std::vector<int> occluders;
+
+int& cachedOccluder(int light) {
+    if ((int)occluders.size() <= light) occluders.resize(light + 1, -1);
+    return occluders[light];
+}
+
+//a thread can go from one scene to another (--serve), an ID from the last one is only a poor guess
+bool usable(const Scene& scene, int primitive) {
+    return primitive >= 0 && primitive < (int)scene.primitives.materials.size();
+}
+
+}
+
+void setOccluderCache(bool enabled) {
+    cacheEnabled = enabled;
+}
+
+bool shadowBlocked(const Scene& scene, int light, const Ray& shadowRay, float tMax) {
+    if (!cacheEnabled) return scene.bvh.anyHit(shadowRay, scene.primitives, tMax);
+    int& cached = cachedOccluder(light);
+    if (usable(scene, cached)) {
+        KernelRay ray{shadowRay.origin.x, shadowRay.origin.y, shadowRay.origin.z,
+                      shadowRay.direction.x, shadowRay.direction.y, shadowRay.direction.z};
+        if (scene.primitives.occludedBy(cached, ray, tMax)) {
+            countStat(STAT_OCCLUDER_CACHE_HITS);
+            return true;
+        }
+    }
+    //a lit point forgets the occluder, so lit regions pay no extra test per ray
+    cached = -1;
+    return scene.bvh.anyHit(shadowRay, scene.primitives, tMax, &cached);
+}
+
+uint64_t shadowBlockedPacket(const Scene& scene, int light, const RayPacket& packet, uint64_t rays) {
+    if (!cacheEnabled) return scene.bvh.anyHitPacket(packet, scene.primitives, rays);
+    int& cached = cachedOccluder(light);
+    uint64_t blocked = 0;
+    if (usable(scene, cached)) {
+        blocked = scene.primitives.occludedByPacket(cached, packet, rays);
+        countStat(STAT_OCCLUDER_CACHE_HITS, __builtin_popcountll(blocked));
+    }
+    uint64_t rest = rays & ~blocked;
+    if (!rest) return blocked;
+    uint64_t found = scene.bvh.anyHitPacket(packet, scene.primitives, rest);
+    if (found) {
+        //the packet query does not say what blocked its rays, the first of them asks again
+        int k = __builtin_ctzll(found);
+        Ray ray(Vector(packet.ox[k], packet.oy[k], packet.oz[k]), Vector(packet.dx[k], packet.dy[k], packet.dz[k]));
+        scene.bvh.anyHit(ray, scene.primitives, packet.t[k], &cached);
+    } else if (!blocked) {
+        cached = -1;
+    }
+    return blocked | found;
+}
+
+void saveOccluders(std::vector<int>& hint) {
+    hint = occluders;
+}
+
+void loadOccluders(const std::vector<int>& hint) {
+    if (!hint.empty()) occluders = hint;
+}
@@ -0,0 +1,32 @@
+// OccluderCache.h
+#ifndef OCCLUDERCACHE_H
+#define OCCLUDERCACHE_H
+
+#include <cstdint>
+#include <vector>
+#include "Ray.h"
+#include "RayPacket.h"
+
+class Scene;
+
+// shadow rays toward one light from neighbouring points are mostly blocked by the same
+// primitive. every thread remembers, per light, the primitive that blocked its last
+// shadow ray toward it and tests that one before the BVH; a ray it blocks needs no
+// traversal. the cache only ever skips work, so the image does not change
+
+// turns the cache on or off for every thread (--no-occluder-cache), on by default
+void setOccluderCache(bool enabled);
+
+// true when the shadow ray toward light (its index in scene.shadingLights) is blocked
+// before tMax: the cached occluder first, then the BVH, which refreshes the cache
+bool shadowBlocked(const Scene& scene, int light, const Ray& shadowRay, float tMax);
+
+// packet version for shadow rays that all go toward light: the mask of rays that are blocked
+uint64_t shadowBlockedPacket(const Scene& scene, int light, const RayPacket& packet, uint64_t rays);
+
+// per-tile hints: the calling thread's cache as it is now, and back. a pass that comes back
+// to a tile starts from what its shadow rays ran into the last time
+void saveOccluders(std::vector<int>& hint);
+void loadOccluders(const std::vector<int>& hint);
+
+#endif // OCCLUDERCACHE_H
@@ -0,0 +1,264 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include "Options.h"
+
+RenderOptions :: RenderOptions() {}
+
+void printUsage() {
+    std::cerr << "Usage: ./raytracer <scene file path> [options]" << std::endl;
+    std::cerr << "       ./raytracer --serve [--socket <path>] [options]" << std::endl;
+    std::cerr << "  --width <n>       image width in pixels (default: 800)" << std::endl;
+    std::cerr << "  --height <n>      image height in pixels (default: 800)" << std::endl;
+    std::cerr << "  --crop <x0> <y0> <x1> <y1>  render only these pixels (row 0 at the top) into a partial image" << std::endl;
+    std::cerr << "  --workers <n>     render in n local worker processes and merge their parts into the image" << std::endl;
+    std::cerr << "  --threads <n>     number of render threads (default: all cores)" << std::endl;
+    std::cerr << "  --tile <n>        tile size in pixels (default: 16)" << std::endl;
+    std::cerr << "  --packet <n>      trace primary rays in n x n packets: 0 (off), 4 or 8 (default: 4)" << std::endl;
+    std::cerr << "  --wavefront       trace each tile in batches, stage by stage, instead of ray by ray" << std::endl;
+    std::cerr << "  --kernels <name>  intersection kernels: auto, scalar, sse, avx2 (default: auto)" << std::endl;
+    std::cerr << "  --no-occluder-cache  test every shadow ray against the BVH, not its light's last occluder first" << std::endl;
+    std::cerr << "  --light-budget <n>  trace n shadow rays per point, to lights drawn by their contribution (default: 0, all)" << std::endl;
+    std::cerr << "  --output-dir <dir>  directory the image is saved in (default: outputs)" << std::endl;
+    std::cerr << "  --output <path>   save the image to this file, format from its extension" << std::endl;
+    std::cerr << "  --format <name>   output image format: png, ppm or pfm (float, for HDR tools) (default: png)" << std::endl;
+    std::cerr << "  --aa-min <n>      anti-aliasing samples for every pixel (default: 4)" << std::endl;
+    std::cerr << "  --aa-max <n>      anti-aliasing samples for noisy pixels and edges (default: 16)" << std::endl;
+    std::cerr << "  --aa-threshold <x>  luminance error under which a pixel stops sampling (default: 0.02)" << std::endl;
+    std::cerr << "  --aa-heatmap <path> save a picture of the samples per pixel, blue = fewest, red = most" << std::endl;
+    std::cerr << "  --stats           print ray, intersection and shadow counts after the render" << std::endl;
+    std::cerr << "  --stats-json <path> write the same counts as JSON" << std::endl;
+    std::cerr << "  --compile         parse the scene, save it as a binary cache next to it (.rtc) and exit" << std::endl;
+    std::cerr << "  --no-cache        always parse the scene file, even when an up to date cache exists" << std::endl;
+    std::cerr << "  --progressive     render coarse to fine in passes and save the image after every pass" << std::endl;
+    std::cerr << "  --time-budget <ms>  with --progressive: stop after this many milliseconds, keeping the best image" << std::endl;
+    std::cerr << "  --watch           keep running and render again every time the scene file is saved" << std::endl;
+    std::cerr << "  --sequence <path> render a frame from every camera position (x y z per line) of the file" << std::endl;
+    std::cerr << "  --serve           render the jobs read from stdin, one per line, keeping scenes and threads" << std::endl;
+    std::cerr << "  --socket <path>   with --serve: take the jobs from connections to this Unix socket" << std::endl;
+}
+
+//reads the integer argument that follows a flag
+static bool readInt(int argc, char* argv[], int& index, int& value) {
+    if (index + 1 >= argc) {
+        std::cerr << "Missing value for " << argv[index] << std::endl;
+        return false;
+    }
+    char* end = nullptr;
+    long parsed = std::strtol(argv[index + 1], &end, 10);
+    if (end == argv[index + 1] || *end != '\0') {
+        std::cerr << "Invalid value for " << argv[index] << ": " << argv[index + 1] << std::endl;
+        return false;
+    }
+    value = (int)parsed;
+    index++;
+    return true;
+}
+
+//reads the number argument that follows a flag
+static bool readFloat(int argc, char* argv[], int& index, float& value) {
+    if (index + 1 >= argc) {
+        std::cerr << "Missing value for " << argv[index] << std::endl;
+        return false;
+    }
+    char* end = nullptr;
+    float parsed = std::strtof(argv[index + 1], &end);
+    if (end == argv[index + 1] || *end != '\0') {
+        std::cerr << "Invalid value for " << argv[index] << ": " << argv[index + 1] << std::endl;
+        return false;
+    }
+    value = parsed;
+    index++;
+    return true;
+}
+
+bool parseOptions(int argc, char* argv[], RenderOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--width" || arg == "--height") {
+            int& size = arg == "--width" ? options.imageWidth : options.imageHeight;
+            if (!readInt(argc, argv, i, size)) return false;
+            if (size < 1) {
+                std::cerr << arg << " must be at least 1" << std::endl;
+                return false;
+            }
+        } else if (arg == "--crop") {
+            if (i + 4 >= argc) {
+                std::cerr << "Missing value for --crop, it takes x0 y0 x1 y1" << std::endl;
+                return false;
+            }
+            int* corners[4] = {&options.cropX0, &options.cropY0, &options.cropX1, &options.cropY1};
+            for (int* corner : corners) {
+                char* end = nullptr;
+                long parsed = std::strtol(argv[++i], &end, 10);
+                if (end == argv[i] || *end != '\0') {
+                    std::cerr << "Invalid value for --crop: " << argv[i] << std::endl;
+                    return false;
+                }
+                *corner = (int)parsed;
+            }
+        } else if (arg == "--workers") {
+            if (!readInt(argc, argv, i, options.workers)) return false;
+            if (options.workers < 1) {
+                std::cerr << "--workers must be at least 1" << std::endl;
+                return false;
+            }
+        } else if (arg == "--threads") {
+            if (!readInt(argc, argv, i, options.threads)) return false;
+            if (options.threads < 0) {
+                std::cerr << "--threads must be at least 0" << std::endl;
+                return false;
+            }
+        } else if (arg == "--tile") {
+            if (!readInt(argc, argv, i, options.tileSize)) return false;
+            if (options.tileSize < 1) {
+                std::cerr << "--tile must be at least 1" << std::endl;
+                return false;
+            }
+        } else if (arg == "--packet") {
+            if (!readInt(argc, argv, i, options.packetSize)) return false;
+            if (options.packetSize != 0 && options.packetSize != 4 && options.packetSize != 8) {
+                std::cerr << "--packet must be 0, 4 or 8" << std::endl;
+                return false;
+            }
+        } else if (arg == "--wavefront") {
+            options.wavefront = true;
+        } else if (arg == "--kernels") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for --kernels" << std::endl;
+                return false;
+            }
+            options.kernels = argv[++i];
+        } else if (arg == "--no-occluder-cache") {
+            options.occluderCache = false;
+        } else if (arg == "--light-budget") {
+            if (!readInt(argc, argv, i, options.lightBudget)) return false;
+            if (options.lightBudget < 0) {
+                std::cerr << "--light-budget must be at least 0" << std::endl;
+                return false;
+            }
+        } else if (arg == "--output-dir") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for --output-dir" << std::endl;
+                return false;
+            }
+            options.outputDirectory = argv[++i];
+        } else if (arg == "--format") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for --format" << std::endl;
+                return false;
+            }
+            std::string name = argv[++i];
+            if (name != "png" && name != "ppm" && name != "pfm") {
+                std::cerr << "--format must be png, ppm or pfm" << std::endl;
+                return false;
+            }
+            options.format = imageFormatFor("." + name);
+        } else if (arg == "--aa-min" || arg == "--aa-max") {
+            int& samples = arg == "--aa-min" ? options.aaMinSamples : options.aaMaxSamples;
+            if (!readInt(argc, argv, i, samples)) return false;
+            if (samples < 1) {
+                std::cerr << arg << " must be at least 1" << std::endl;
+                return false;
+            }
+        } else if (arg == "--aa-threshold") {
+            if (!readFloat(argc, argv, i, options.aaThreshold)) return false;
+            if (options.aaThreshold < 0.0f) {
+                std::cerr << "--aa-threshold must be at least 0" << std::endl;
+                return false;
+            }
+        } else if (arg == "--aa-heatmap") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for --aa-heatmap" << std::endl;
+                return false;
+            }
+            options.heatMapPath = argv[++i];
+        } else if (arg == "--stats") {
+            options.stats = true;
+        } else if (arg == "--stats-json") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for --stats-json" << std::endl;
+                return false;
+            }
+            options.statsJsonPath = argv[++i];
+        } else if (arg == "--compile") {
+            options.compile = true;
+        } else if (arg == "--no-cache") {
+            options.useCache = false;
+        } else if (arg == "--progressive") {
+            options.progressive = true;
+        } else if (arg == "--time-budget") {
+            if (!readInt(argc, argv, i, options.timeBudgetMs)) return false;
+            if (options.timeBudgetMs < 1) {
+                std::cerr << "--time-budget must be at least 1" << std::endl;
+                return false;
+            }
+            options.progressive = true;
+        } else if (arg == "--watch") {
+            options.watch = true;
+        } else if (arg == "--sequence") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for --sequence" << std::endl;
+                return false;
+            }
+            options.sequencePath = argv[++i];
+        } else if (arg == "--serve") {
+            options.serve = true;
+        } else if (arg == "--socket") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for --socket" << std::endl;
+                return false;
+            }
+            options.socketPath = argv[++i];
+            options.serve = true;
+        } else if (arg == "--output") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for --output" << std::endl;
+                return false;
+            }
+            options.outputPath = argv[++i];
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printUsage();
+            return false;
+        } else if (options.scenePath.empty()) {
+            options.scenePath = arg;
+        } else {
+            printUsage();
+            return false;
+        }
+    }
+    if (options.scenePath.empty() && !options.serve) {
+        printUsage();
+        return false;
+    }
+    //each of these runs the program its own way, main would silently pick one of them
+    int modes = (options.workers > 0) + !options.sequencePath.empty() + options.watch + options.serve;
+    if (modes > 1) {
+        std::cerr << "--workers, --sequence, --watch and --serve cannot be combined, give only one of them" << std::endl;
+        return false;
+    }
+    //a crop is saved as a partial image, these save whole frames
+    if (options.cropped() && (!options.sequencePath.empty() || options.watch)) {
+        std::cerr << "--crop cannot be used with --sequence or --watch" << std::endl;
+        return false;
+    }
+    if (options.progressive && (options.cropped() || options.workers > 0 || options.watch || options.serve ||
+                                !options.sequencePath.empty() || !options.heatMapPath.empty())) {
+        std::cerr << "--progressive renders whole single images: it cannot be used with --crop, --workers, --watch,"
+                  << " --serve, --sequence or --aa-heatmap" << std::endl;
+        return false;
+    }
+    //the g-buffer keeps which lights reached a point, not which ones were drawn
+    if (options.watch && options.lightBudget > 0) {
+        std::cerr << "--light-budget cannot be used with --watch" << std::endl;
+        return false;
+    }
+    if (options.cropped() && (options.cropX0 < 0 || options.cropY0 < 0 || options.cropX1 > options.imageWidth ||
+                              options.cropY1 > options.imageHeight)) {
+        std::cerr << "--crop must lie inside the " << options.imageWidth << "x" << options.imageHeight << " image"
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
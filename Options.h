@@ -0,0 +1,52 @@
+// Options.h
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <string>
+#include "ImageWriter.h"
+
+// command line settings for a render
+struct RenderOptions {
+    std::string scenePath;
+    int imageWidth = 800;
+    int imageHeight = 800;
+    // --crop: render only the pixels [cropX0, cropX1) x [cropY0, cropY1), row 0 at the top,
+    // and save them as a partial image (PartialImage.h). empty = the whole image
+    int cropX0 = 0, cropY0 = 0, cropX1 = 0, cropY1 = 0;
+    int workers = 0;      // split the image over this many local worker processes and merge (Coordinator.h)
+    int threads = 0;      // 0 = one per hardware thread
+    int tileSize = 16;
+    int packetSize = 4;   // primary rays are traced in packetSize x packetSize packets, 0 = one by one
+    bool wavefront = false;  // trace tiles stage by stage in batches (Wavefront.h) instead of ray by ray
+    std::string kernels = "auto";  // intersection kernels: auto, scalar, sse or avx2
+    bool occluderCache = true;     // test the last occluder of each light before the BVH (OccluderCache.h)
+    int lightBudget = 0;           // shadow rays per shaded point, to lights drawn by contribution. 0 = all lights
+    // anti-aliasing (scenes with aliasing on): every pixel gets aaMinSamples, noisy pixels and
+    // edges get more, up to aaMaxSamples, until the error of their luminance is under aaThreshold
+    int aaMinSamples = 4;
+    int aaMaxSamples = 16;
+    float aaThreshold = 0.02f;
+    std::string outputDirectory = "outputs";
+    std::string outputPath;          // when set, the image is saved here (format from the extension) instead
+    ImageFormat format = IMAGE_PNG;  // format of the rendered image
+    std::string heatMapPath;       // when set, a picture of the samples taken per pixel is saved here
+    bool stats = false;            // print the render statistics
+    std::string statsJsonPath;     // when set, the render statistics are written here as JSON
+    bool compile = false;          // write the scene's binary cache (scene.rtc) and exit without rendering
+    bool useCache = true;          // load the scene from its cache when the cache is up to date
+    bool progressive = false;      // render in passes of more and more detail, saving the image after each
+    int timeBudgetMs = 0;          // progressive: stop when this much wall clock time is up, 0 = no limit
+    bool watch = false;            // render again whenever the scene file changes, reusing what did not
+    std::string sequencePath;      // when set, render the camera fly-through of this file (Sequence.h)
+    bool serve = false;            // take render jobs from stdin, or from socketPath, until told to quit (Server.h)
+    std::string socketPath;        // with serve: listen on this Unix domain socket
+
+    RenderOptions();
+    bool cropped() const { return cropX1 > cropX0 && cropY1 > cropY0; }
+};
+
+// fills options from argv, prints the usage and returns false on bad input
+bool parseOptions(int argc, char* argv[], RenderOptions& options);
+void printUsage();
+
+#endif // OPTIONS_H
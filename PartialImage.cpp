@@ -0,0 +1,56 @@
+#include "PartialImage.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+//the file: magic, the header fields as int32 in the byte order of the machine that wrote
+//it (it is read back on the same one), then the colors as float triples
+static const char kMagic[8] = {'R', 'T', 'P', 'A', 'R', 'T', '1', '\n'};
+
+bool writePartialImage(const std::string& path, const PartialImage& part) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to save the partial image to " << path << std::endl;
+        return false;
+    }
+    int32_t header[7] = {part.width, part.height, part.x0, part.y0, part.x1, part.y1, part.aliasing};
+    file.write(kMagic, sizeof(kMagic));
+    file.write((const char*)header, sizeof(header));
+    file.write((const char*)part.pixels.data(), part.pixels.size() * sizeof(Vector));
+    file.close();
+    if (!file) {
+        std::cerr << "Failed to save the partial image to " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool readPartialImage(const std::string& path, PartialImage& part) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[sizeof(kMagic)];
+    int32_t header[7];
+    if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0 ||
+        !file.read((char*)header, sizeof(header))) {
+        std::cerr << "Not a partial image: " << path << std::endl;
+        return false;
+    }
+    part.width = header[0];
+    part.height = header[1];
+    part.x0 = header[2];
+    part.y0 = header[3];
+    part.x1 = header[4];
+    part.y1 = header[5];
+    part.aliasing = header[6] != 0;
+    if (part.x0 < 0 || part.y0 < 0 || part.x1 > part.width || part.y1 > part.height || part.x0 >= part.x1 ||
+        part.y0 >= part.y1) {
+        std::cerr << "Partial image " << path << " has a bad rectangle" << std::endl;
+        return false;
+    }
+    part.pixels.resize((std::size_t)(part.x1 - part.x0) * (part.y1 - part.y0));
+    if (!file.read((char*)part.pixels.data(), part.pixels.size() * sizeof(Vector))) {
+        std::cerr << "Partial image " << path << " is cut short" << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,24 @@
+// PartialImage.h
+#ifndef PARTIALIMAGE_H
+#define PARTIALIMAGE_H
+
+#include <string>
+#include <vector>
+#include "Vector.h"
+
+// partial framebuffer: the final colors of one rectangle of an image, what a --crop
+// render saves and the coordinator (Coordinator.h) merges. the colors are the floats
+// the image would have been written from, so merged rectangles give the same image
+struct PartialImage {
+    int width = 0, height = 0;            // the whole image
+    int x0 = 0, y0 = 0, x1 = 0, y1 = 0;   // the rectangle [x0, x1) x [y0, y1), row 0 at the top
+    bool aliasing = false;                // the scene had anti-aliasing on, which names the image
+    std::vector<Vector> pixels;           // (x1 - x0) * (y1 - y0) colors, top row first
+};
+
+// false (and a message) when the file cannot be written
+bool writePartialImage(const std::string& path, const PartialImage& part);
+// false (and a message) when the file is missing or is not a partial image
+bool readPartialImage(const std::string& path, PartialImage& part);
+
+#endif // PARTIALIMAGE_H
@@ -0,0 +1,67 @@
+// Pool.h
+#ifndef POOL_H
+#define POOL_H
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+// per-type arena: objects are constructed in place in large chunks of contiguous
+// storage, one chunk per doubling of the pool, so they neither move nor get a heap
+// block each. everything is destroyed together with the pool
+template <class T>
+class Pool {
+public:
+    Pool() : count(0) {}
+    ~Pool() { clear(); }
+    Pool(const Pool&) = delete;
+    Pool& operator=(const Pool&) = delete;
+
+    // makes room for extra more objects in one chunk
+    void reserve(std::size_t extra) {
+        if (extra == 0) return;
+        if (chunks.empty() || chunks.back().capacity - chunks.back().used < extra) addChunk(extra);
+    }
+
+    template <class... Args>
+    T* create(Args&&... args) {
+        if (chunks.empty() || chunks.back().used == chunks.back().capacity) {
+            addChunk(count < kFirstChunk ? kFirstChunk : count);
+        }
+        Chunk& chunk = chunks.back();
+        T* object = new (chunk.items + chunk.used) T(std::forward<Args>(args)...);
+        chunk.used++;
+        count++;
+        return object;
+    }
+
+    std::size_t size() const { return count; }
+
+    void clear() {
+        for (Chunk& chunk : chunks) {
+            for (std::size_t k = 0; k < chunk.used; k++) chunk.items[k].~T();
+            ::operator delete(chunk.items);
+        }
+        chunks.clear();
+        count = 0;
+    }
+
+private:
+    static const std::size_t kFirstChunk = 64;
+
+    struct Chunk {
+        T* items;
+        std::size_t used;
+        std::size_t capacity;
+    };
+
+    void addChunk(std::size_t capacity) {
+        chunks.push_back(Chunk{static_cast<T*>(::operator new(capacity * sizeof(T))), 0, capacity});
+    }
+
+    std::vector<Chunk> chunks;
+    std::size_t count;
+};
+
+#endif // POOL_H
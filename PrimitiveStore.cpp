@@ -0,0 +1,192 @@
+#include <cstddef>
+#include <limits>
+#include "PrimitiveStore.h"
+#include "Object.h"
+#include "BVH.h"
+#include "Kernels.h"
+#include "TriangleMesh.h"
+#include "Instance.h"
+#include "RenderStats.h"
+
+PrimitiveStore :: PrimitiveStore()
+    : sphereSoA(), cylinderSoA(), planes(), meshSoA(), instanceSoA(), sphereCount(0), cylinderCount(0), meshCount(0),
+      instanceCount(0) {}
+
+//append zeroed entries so a full SIMD load past the last real entry stays in bounds
+template <class T>
+static void pad(std::vector<T>& values) {
+    values.resize(values.size() + PrimitiveStore::kPadding, T());
+}
+
+void PrimitiveStore :: build(const std::vector<Object*>& objects, const BVH& bvh) {
+    spheres = SphereArrays();
+    cylinders = CylinderArrays();
+    planeStorage = PlaneArrays();
+    meshes = MeshArrays();
+    instances = InstanceArrays();
+    typeStorage.assign(bvh.primIndices.size(), PRIMITIVE_SPHERE);
+    slotStorage.assign(bvh.primIndices.size(), 0);
+
+    materialStorage.resize(objects.size());
+    primitiveTypeStorage.resize(objects.size());
+    primitiveSlotStorage.resize(objects.size());
+    for (std::size_t id = 0; id < objects.size(); id++) {
+        materialStorage[id] = visitObject(*objects[id], [](const auto& object) { return object.material(); });
+        primitiveTypeStorage[id] = objects[id]->type();
+    }
+
+    for (std::size_t position = 0; position < bvh.primIndices.size(); position++) {
+        int id = bvh.primIndices[position];
+        const Object* object = objects[id];
+        typeStorage[position] = object->type();
+        if (object->type() == PRIMITIVE_SPHERE) {
+            primitiveSlotStorage[id] = spheres.count;
+            const Sphere* sphere = static_cast<const Sphere*>(object);
+            slotStorage[position] = spheres.count++;
+            spheres.centerX.push_back(sphere->center.x);
+            spheres.centerY.push_back(sphere->center.y);
+            spheres.centerZ.push_back(sphere->center.z);
+            spheres.radius.push_back(sphere->radius);
+            spheres.ids.push_back(id);
+        } else if (object->type() == PRIMITIVE_CYLINDER) {
+            primitiveSlotStorage[id] = cylinders.count;
+            const Cylinder* cylinder = static_cast<const Cylinder*>(object);
+            slotStorage[position] = cylinders.count++;
+            cylinders.centerX.push_back(cylinder->center.x);
+            cylinders.centerY.push_back(cylinder->center.y);
+            cylinders.centerZ.push_back(cylinder->center.z);
+            cylinders.axisX.push_back(cylinder->axis.x);
+            cylinders.axisY.push_back(cylinder->axis.y);
+            cylinders.axisZ.push_back(cylinder->axis.z);
+            cylinders.radius.push_back(cylinder->radius);
+            cylinders.halfHeight.push_back(cylinder->height / 2.0f);
+            cylinders.ids.push_back(id);
+        } else if (object->type() == PRIMITIVE_MESH) {
+            primitiveSlotStorage[id] = meshes.count;
+            slotStorage[position] = meshes.count++;
+            meshes.geometry.push_back(static_cast<const TriangleMesh*>(object)->geometry.get());
+            meshes.ids.push_back(id);
+        } else if (object->type() == PRIMITIVE_INSTANCE) {
+            primitiveSlotStorage[id] = instances.count;
+            slotStorage[position] = instances.count++;
+            instances.records.push_back(static_cast<const Instance*>(object));
+            instances.ids.push_back(id);
+        }
+    }
+
+    for (int id : bvh.unbounded) {
+        const Plane* plane = static_cast<const Plane*>(objects[id]);
+        primitiveSlotStorage[id] = planeStorage.count;
+        planeStorage.normalX.push_back(plane->normal.x);
+        planeStorage.normalY.push_back(plane->normal.y);
+        planeStorage.normalZ.push_back(plane->normal.z);
+        planeStorage.d.push_back(plane->d);
+        planeStorage.ids.push_back(id);
+        planeStorage.count++;
+    }
+
+    pad(spheres.centerX); pad(spheres.centerY); pad(spheres.centerZ);
+    pad(spheres.radius); pad(spheres.ids);
+    pad(cylinders.centerX); pad(cylinders.centerY); pad(cylinders.centerZ);
+    pad(cylinders.axisX); pad(cylinders.axisY); pad(cylinders.axisZ);
+    pad(cylinders.radius); pad(cylinders.halfHeight); pad(cylinders.ids);
+    pad(planeStorage.normalX); pad(planeStorage.normalY); pad(planeStorage.normalZ);
+    pad(planeStorage.d); pad(planeStorage.ids);
+
+    sphereSoA = SphereSoA{spheres.centerX.data(), spheres.centerY.data(), spheres.centerZ.data(),
+                          spheres.radius.data(), spheres.ids.data()};
+    cylinderSoA = CylinderSoA{cylinders.centerX.data(), cylinders.centerY.data(), cylinders.centerZ.data(),
+                              cylinders.axisX.data(), cylinders.axisY.data(), cylinders.axisZ.data(),
+                              cylinders.radius.data(), cylinders.halfHeight.data(), cylinders.ids.data()};
+    meshSoA = MeshSoA{meshes.geometry.data(), meshes.ids.data()};
+    instanceSoA = InstanceSoA{instances.records.data(), instances.ids.data()};
+    planes = PlaneSoA{planeStorage.normalX.data(), planeStorage.normalY.data(), planeStorage.normalZ.data(),
+                      planeStorage.d.data(), planeStorage.ids.data(), planeStorage.count};
+    sphereCount = spheres.count;
+    cylinderCount = cylinders.count;
+    meshCount = meshes.count;
+    instanceCount = instances.count;
+    types = typeStorage;
+    slots = slotStorage;
+    materials = materialStorage;
+    primitiveTypes = primitiveTypeStorage;
+    primitiveSlots = primitiveSlotStorage;
+}
+
+Intersection PrimitiveStore :: surface(const Ray& ray, const HitRecord& hit) const {
+    if (!hit.hit()) return Intersection();
+    if (primitiveTypes[hit.primitive] == PRIMITIVE_INSTANCE) {
+        return instanceSoA.records[primitiveSlots[hit.primitive]]->surface(ray, hit.t);
+    }
+    const Material& material = materials[hit.primitive];
+    int slot = primitiveSlots[hit.primitive];
+    Vector point = ray.direction.mulAdd(hit.t, ray.origin);
+    Vector normal;
+    Vector color = material.color;
+
+    //same normals and colors as the objects' intersect
+    if (primitiveTypes[hit.primitive] == PRIMITIVE_SPHERE) {
+        Vector center(sphereSoA.centerX[slot], sphereSoA.centerY[slot], sphereSoA.centerZ[slot]);
+        normal = (point - center).normalize();
+    } else if (primitiveTypes[hit.primitive] == PRIMITIVE_PLANE) {
+        normal = Vector(planes.normalX[slot], planes.normalY[slot], planes.normalZ[slot]).normalize();
+        //reflective and transparent planes never show their own color
+        if (!material.reflective && !material.transparent) {
+            color = Plane::checkerboardColor(material.color, point);
+        }
+    } else if (primitiveTypes[hit.primitive] == PRIMITIVE_MESH) {
+        //like the cylinder's surface, the mesh is searched again for the triangle that was hit
+        KernelRay kernelRay{ray.origin.x, ray.origin.y, ray.origin.z, ray.direction.x, ray.direction.y, ray.direction.z};
+        float t = std::numeric_limits<float>::infinity();
+        int triangle = 0;
+        meshSoA.geometry[slot]->closestHit(kernelRay, t, triangle);
+        normal = meshSoA.geometry[slot]->normal(triangle);
+    } else {
+        Vector center(cylinderSoA.centerX[slot], cylinderSoA.centerY[slot], cylinderSoA.centerZ[slot]);
+        Vector axis(cylinderSoA.axisX[slot], cylinderSoA.axisY[slot], cylinderSoA.axisZ[slot]);
+        KernelRay kernelRay{ray.origin.x, ray.origin.y, ray.origin.z, ray.direction.x, ray.direction.y, ray.direction.z};
+        bool onCap, onBottom;
+        cylinderSurface(cylinderSoA, slot, kernelRay, onCap, onBottom);
+        if (!onCap) {
+            Vector temp = point - center;
+            normal = (temp - axis * temp.dot(axis)).normalize();
+        } else {
+            normal = onBottom ? -axis : axis;
+        }
+    }
+    return Intersection(true, hit.t, point, normal, color, material.shininess, material.reflective, material.transparent);
+}
+
+bool PrimitiveStore :: occludedBy(int primitive, const KernelRay& ray, float tMax) const {
+    int slot = primitiveSlots[primitive];
+    countStat((StatCounter)(STAT_SPHERE_TESTS + primitiveTypes[primitive]));
+    switch (primitiveTypes[primitive]) {
+        case PRIMITIVE_SPHERE: return activeKernels().occludedSpheres(sphereSoA, slot, 1, ray, tMax);
+        case PRIMITIVE_CYLINDER: return activeKernels().occludedCylinders(cylinderSoA, slot, 1, ray, tMax);
+        case PRIMITIVE_MESH: return occludedMeshes(meshSoA, slot, 1, ray, tMax);
+        case PRIMITIVE_INSTANCE: return occludedInstances(instanceSoA, slot, 1, ray, tMax);
+        default: {
+            //the plane alone, as a one entry view
+            PlaneSoA plane{planes.normalX + slot, planes.normalY + slot, planes.normalZ + slot, planes.d + slot,
+                           planes.ids + slot, 1};
+            return occludedPlanes(plane, ray, tMax);
+        }
+    }
+}
+
+uint64_t PrimitiveStore :: occludedByPacket(int primitive, const RayPacket& packet, uint64_t rays) const {
+    int slot = primitiveSlots[primitive];
+    if (primitiveTypes[primitive] == PRIMITIVE_SPHERE || primitiveTypes[primitive] == PRIMITIVE_CYLINDER) {
+        countStat((StatCounter)(STAT_SPHERE_TESTS + primitiveTypes[primitive]), __builtin_popcountll(rays));
+        return primitiveTypes[primitive] == PRIMITIVE_SPHERE
+            ? activeKernels().occludedSpheresPacket(sphereSoA, slot, 1, packet, rays)
+            : activeKernels().occludedCylindersPacket(cylinderSoA, slot, 1, packet, rays);
+    }
+    uint64_t occluded = 0;
+    for (uint64_t left = rays; left; left &= left - 1) {
+        int k = __builtin_ctzll(left);
+        KernelRay ray{packet.ox[k], packet.oy[k], packet.oz[k], packet.dx[k], packet.dy[k], packet.dz[k]};
+        if (occludedBy(primitive, ray, packet.t[k])) occluded |= 1ull << k;
+    }
+    return occluded;
+}
@@ -0,0 +1,165 @@
+// PrimitiveStore.h
+#ifndef PRIMITIVESTORE_H
+#define PRIMITIVESTORE_H
+
+#include <cstdint>
+#include <vector>
+#include "ArrayView.h"
+#include "Vector.h"
+#include "Ray.h"
+#include "Intersection.h"
+
+class Object;
+class BVH;
+class MeshGeometry;
+class Instance;
+struct KernelRay;
+struct RayPacket;
+
+// shading data of one primitive, kept apart from the geometry so the
+// intersection kernels never stream through it
+struct Material {
+    Vector color;
+    float shininess;
+    bool reflective;
+    bool transparent;
+};
+
+// geometry arrays are structure of arrays, one array per component, padded at
+// the end so a SIMD kernel can always load a full register. ids maps an entry
+// back to its primitive ID, the object's index in Scene::objects
+struct SphereArrays {
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> radius;
+    std::vector<int> ids;
+    int count = 0;
+};
+
+struct CylinderArrays {
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> axisX, axisY, axisZ;  // normalized
+    std::vector<float> radius;
+    std::vector<float> halfHeight;
+    std::vector<int> ids;
+    int count = 0;
+};
+
+// raw pointer view of the arrays above, what the kernels take. the SIMD kernel
+// files are built with extra instruction set flags and must not instantiate any
+// inline library code (std::vector and friends) that other files could link against
+struct SphereSoA {
+    const float* centerX;
+    const float* centerY;
+    const float* centerZ;
+    const float* radius;
+    const int* ids;
+};
+
+struct CylinderSoA {
+    const float* centerX;
+    const float* centerY;
+    const float* centerZ;
+    const float* axisX;
+    const float* axisY;
+    const float* axisZ;
+    const float* radius;
+    const float* halfHeight;
+    const int* ids;
+};
+
+struct PlaneArrays {
+    std::vector<float> normalX, normalY, normalZ;  // normalized
+    std::vector<float> d;
+    std::vector<int> ids;
+    int count = 0;
+};
+
+struct PlaneSoA {
+    const float* normalX;
+    const float* normalY;
+    const float* normalZ;
+    const float* d;
+    const int* ids;
+    int count;
+};
+
+// triangle meshes keep their own buffers and tree (TriangleMesh.h), the store only
+// lists them in leaf order
+struct MeshArrays {
+    std::vector<const MeshGeometry*> geometry;
+    std::vector<int> ids;
+    int count = 0;
+};
+
+struct MeshSoA {
+    const MeshGeometry* const* geometry;
+    const int* ids;
+};
+
+// instances likewise: the store lists the records, whose geometry has its own store
+struct InstanceArrays {
+    std::vector<const Instance*> records;
+    std::vector<int> ids;
+    int count = 0;
+};
+
+struct InstanceSoA {
+    const Instance* const* records;
+    const int* ids;
+};
+
+// SoA copy of the scene geometry in BVH leaf order, plus the material table. the
+// public members are views, into the arrays below after build() or into a mapped scene cache
+class PrimitiveStore {
+public:
+    // the lanes the widest kernel reads past the last entry
+    static const int kPadding = 8;
+
+    PrimitiveStore();
+    // fills the arrays from objects; bounded primitives follow bvh.primIndices, planes bvh.unbounded
+    void build(const std::vector<Object*>& objects, const BVH& bvh);
+
+    // the sphere and cylinder views hold count + kPadding entries
+    SphereSoA sphereSoA;
+    CylinderSoA cylinderSoA;
+    PlaneSoA planes;
+    MeshSoA meshSoA;
+    InstanceSoA instanceSoA;
+    int sphereCount;
+    int cylinderCount;
+    int meshCount;
+    int instanceCount;
+
+    // for every position in BVH::primIndices: the primitive type and the index into its typed arrays.
+    // BVH leaves hold a single type, so a leaf maps to one contiguous run of one array
+    ArrayView<int> types;
+    ArrayView<int> slots;
+
+    // indexed by primitive ID: shading data, the primitive type and the index into its typed arrays
+    ArrayView<Material> materials;
+    ArrayView<int> primitiveTypes;
+    ArrayView<int> primitiveSlots;
+
+    // point, normal and material of a hit found by the kernels. this is the only
+    // place a full Intersection is built, once per shaded hit
+    Intersection surface(const Ray& ray, const HitRecord& hit) const;
+
+    // occlusion test of the one primitive with that ID, the arithmetic of the BVH's leaves
+    bool occludedBy(int primitive, const KernelRay& ray, float tMax) const;
+    // the same for the rays of a packet, returns the mask of rays it blocks before their t
+    uint64_t occludedByPacket(int primitive, const RayPacket& packet, uint64_t rays) const;
+
+private:
+    SphereArrays spheres;
+    CylinderArrays cylinders;
+    PlaneArrays planeStorage;
+    MeshArrays meshes;
+    InstanceArrays instances;
+    std::vector<int> typeStorage;
+    std::vector<int> slotStorage;
+    std::vector<Material> materialStorage;
+    std::vector<int> primitiveTypeStorage;
+    std::vector<int> primitiveSlotStorage;
+};
+
+#endif // PRIMITIVESTORE_H
@@ -0,0 +1,28 @@
+// RayPacket.h
+#ifndef RAYPACKET_H
+#define RAYPACKET_H
+
+#include <cstdint>
+
+// up to 64 rays traced together (a 4x4 or 8x8 block of pixels), stored as
+// structure of arrays. bit k of a lane mask stands for ray k.
+// t is the closest hit so far for closest-hit queries and the maximum
+// distance for occlusion queries; id is the primitive hit, -1 for none
+struct RayPacket {
+    static constexpr int kMaxRays = 64;
+
+    int count;
+    alignas(32) float ox[kMaxRays];
+    alignas(32) float oy[kMaxRays];
+    alignas(32) float oz[kMaxRays];
+    alignas(32) float dx[kMaxRays];
+    alignas(32) float dy[kMaxRays];
+    alignas(32) float dz[kMaxRays];
+    alignas(32) float invDx[kMaxRays];
+    alignas(32) float invDy[kMaxRays];
+    alignas(32) float invDz[kMaxRays];
+    alignas(32) float t[kMaxRays];
+    alignas(32) int id[kMaxRays];
+};
+
+#endif // RAYPACKET_H
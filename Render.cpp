@@ -0,0 +1,820 @@
+#include "Render.h"
+#include "SceneCache.h"
+#include "Vector.h"
+#include "Scene.h"
+#include "Object.h"
+#include "Intersection.h"
+#include "Light.h"
+#include "ThreadPool.h"
+#include "Tile.h"
+#include "RayPacket.h"
+#include "Sampling.h"
+#include "ImageWriter.h"
+#include "RenderStats.h"
+#include "Wavefront.h"
+#include "GBuffer.h"
+#include "PartialImage.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <limits>
+#include <memory>
+
+//find the closest object
+Intersection findObject(const Ray& ray, const Scene& scene) {
+    return scene.primitives.surface(ray, traceClosest(ray, scene));
+}
+
+//counts a closest hit by the type of primitive hit
+static void countHit(const Scene& scene, const HitRecord& hit) {
+    if (hit.hit()) countStat((StatCounter)(STAT_SPHERE_HITS + scene.primitives.primitiveTypes[hit.primitive]));
+}
+
+//closest hit along the ray, distance and primitive only
+HitRecord traceClosest(const Ray& ray, const Scene& scene) {
+    HitRecord hit;
+    scene.bvh.closestHit(ray, scene.primitives, hit);
+    countHit(scene, hit);
+    return hit;
+}
+
+//calculating alpha and theta from the class 
+float calcTheta(const Vector& normal, const Vector& lightDir) {
+    return std::max(0.0f, std::abs(normal.normalize().dot(lightDir.normalize())));
+}
+float calcAlpha(const Vector& normal, const Vector& lightDir, const Vector& viewDir) {
+    Vector reflectionDir = (normal * 2.0f * lightDir.dot(normal) - lightDir).normalize();
+    return std::max(0.0f, viewDir.dot(reflectionDir));
+}
+
+// calculate the reflrct direction from the class
+Vector reflect(const Vector& I, const Vector& N) {
+    return I - N * 2.0f * I.dot(N);
+}
+
+//calculate the reflrct direction of the transperent object
+Vector refract(const Vector& I, const Vector& N, float eta) {
+    float cosi = std::clamp(I.dot(N), -1.0f, 1.0f);
+    float etai = 1.0f, etat = eta;
+    Vector n = N;
+    if (cosi < 0) cosi = -cosi; 
+    else { std::swap(etai, etat); n = N * -1.0f; }
+    float etaRatio = etai / etat;
+    float k = 1 - etaRatio * etaRatio * (1 - cosi * cosi);
+    return k < 0 ? Vector(0, 0, 0) : I * etaRatio + n * (etaRatio * cosi - std::sqrt(k));
+}
+
+//calculate the pixels color
+Vector createColor(Ray ray, Scene& scene, int counter) {
+    if (counter > 5) return Vector(0, 0, 0);
+    countDepth(counter);
+
+    HitRecord hit = traceClosest(ray, scene);
+    if (!hit.hit()) return Vector(0, 0, 0);
+    //normal and material only for the winning hit
+    Intersection interObject = scene.primitives.surface(ray, hit);
+    return shadeHit(ray, interObject, scene, counter);
+}
+
+//color seen along ray at its closest hit
+Vector shadeHit(const Ray& ray, const Intersection& interObject, Scene& scene, int counter) {
+    if (!interObject.hit) return Vector(0, 0, 0);
+
+    Vector finalColor(0, 0, 0);
+    //recursive reflect object
+    if (interObject.reflective) {
+        Vector reflectedDir = reflect(ray.direction, interObject.normal).normalize();
+        Ray reflectedRay(interObject.point + reflectedDir * 1e-4f, reflectedDir);
+        countStat(STAT_REFLECTED_RAYS);
+        finalColor = finalColor + createColor(reflectedRay, scene, counter + 1);
+        return finalColor;
+    }
+    //recursive transparent object
+    if (interObject.transparent) {
+        float refractiveIndex = 1.5f;
+        Vector refractedDir = refract(ray.direction, interObject.normal, refractiveIndex).normalize();
+        Ray refractedRay(interObject.point + refractedDir * 1e-4f, refractedDir);
+        countStat(STAT_REFRACTED_RAYS);
+        finalColor = finalColor + createColor(refractedRay, scene, counter + 1);
+        return finalColor;
+    }
+    return shadeLights(ray, interObject, scene);
+}
+
+//phong term of one light at an opaque hit, toLight as from lightShadowRay
+Vector lightContribution(const Intersection& interObject, const Vector& viewDir, const ShadingLight& light,
+                         const Vector& toLight) {
+    float cosTheta = calcTheta(interObject.normal, toLight);
+    float cosAlpha = calcAlpha(interObject.normal, toLight, viewDir);
+    float ncosAlpha = pow(cosAlpha, interObject.shininess);
+    Vector diffuse = interObject.color * cosTheta;
+    Vector specular = Vector(0.7, 0.7, 0.7) * ncosAlpha;
+    Vector I = diffuse + specular;
+    return I.Hadamard(light.intensity);
+}
+
+//a light whose cone holds the shaded point, before its shadow ray is traced
+struct ReachingLight {
+    int light;
+    Ray shadowRay;
+    float lightDistance;
+    Vector contribution;  // lightContribution, as if nothing blocked the light
+    float cumulative;     // sum of the weights of the lights up to this one
+};
+
+//--light-budget: the unshadowed contribution of a light is cheap, its shadow ray is not. the
+//budget's shadow rays go to lights drawn (stratified, by a hash of the point) in proportion to
+//that contribution, and a light that gets through counts 1 / (budget * probability) times, so
+//the mean is still the image of all the lights. points no more lights reach are shaded exactly
+static Vector sampleLights(const Intersection& interObject, const Vector& viewDir, const Scene& scene) {
+    thread_local std::vector<ReachingLight> reaching;
+    reaching.clear();
+    float total = 0.0f;
+    findReachingLights(scene, interObject.point, [&](int l, const Ray& shadowRay, float lightDistance,
+                                                     const Vector& toLight) {
+        Vector contribution = lightContribution(interObject, viewDir, scene.shadingLights[l], toLight);
+        total += std::max(0.0f, contribution.x + contribution.y + contribution.z);
+        reaching.push_back(ReachingLight{l, shadowRay, lightDistance, contribution, total});
+    });
+
+    Vector color(0, 0, 0);
+    int budget = scene.lightBudget;
+    if ((int)reaching.size() <= budget) {
+        for (const ReachingLight& reach : reaching) {
+            countStat(STAT_SHADOW_RAYS);
+            if (shadowBlocked(scene, reach.light, reach.shadowRay, reach.lightDistance)) {
+                countStat(STAT_SHADOWS_OCCLUDED);
+            } else {
+                color = color + reach.contribution;
+            }
+        }
+        return color;
+    }
+    if (total <= 0.0f) return color;
+
+    uint32_t seed = 0;
+    for (float coordinate : {interObject.point.x, interObject.point.y, interObject.point.z}) {
+        uint32_t bits;
+        std::memcpy(&bits, &coordinate, sizeof(bits));
+        seed = seed * 0x9e3779b1u ^ bits;
+    }
+    float offset = hashToUnit(seed);
+    int last = -1;
+    bool lastBlocked = false;
+    for (int s = 0; s < budget; s++) {
+        float target = (s + offset) / budget * total;
+        int k = std::upper_bound(reaching.begin(), reaching.end(), target,
+                                 [](float value, const ReachingLight& reach) { return value < reach.cumulative; }) -
+                reaching.begin();
+        k = std::min(k, (int)reaching.size() - 1);
+        const ReachingLight& reach = reaching[k];
+        float weight = reach.cumulative - (k > 0 ? reaching[k - 1].cumulative : 0.0f);
+        if (weight <= 0.0f) continue;
+        //strata go up the list, a light drawn twice in a row is traced once
+        if (k != last) {
+            countStat(STAT_SHADOW_RAYS);
+            lastBlocked = shadowBlocked(scene, reach.light, reach.shadowRay, reach.lightDistance);
+            if (lastBlocked) countStat(STAT_SHADOWS_OCCLUDED);
+            last = k;
+        }
+        if (!lastBlocked) color = color + reach.contribution * (total / (budget * weight));
+    }
+    return color;
+}
+
+//phong shading of an opaque hit from the lights that reach it, plus ambient
+Vector shadeLights(const Ray& ray, const Intersection& interObject, const Scene& scene) {
+    Vector finalColor(0, 0, 0);
+    Vector viewDir = (ray.origin - interObject.point).normalize();
+    //for transparent reflect the I vector will be (0,0,0)
+    if (scene.lightBudget > 0) {
+        finalColor = sampleLights(interObject, viewDir, scene);
+    } else {
+        findLights(scene, interObject, [&](const ShadingLight& light, const Vector& toLight) {
+            finalColor = finalColor + lightContribution(interObject, viewDir, light, toLight);
+        });
+    }
+
+    finalColor = finalColor + interObject.color.Hadamard(scene.ambientLight->getIntensity());
+    return finalColor;
+}
+
+//writes buffer (top row first) in the format of fileName's extension: png, ppm or pfm
+bool saveImage(int width, int height, const std::vector<Vector>& buffer, const std::string& fileName, int threads) {
+    ImageWriter image(fileName, width, height, buffer);
+    if (!image.isOpen()) return false;
+    ThreadPool pool(threads > 0 ? threads : ThreadPool::defaultThreadCount());
+    image.writeAll(pool);
+    return image.finish();
+}
+
+//primary ray through the point (offsetX, offsetY) of pixel (i, j), offsets in [0, 1)
+static Ray primaryRay(int i, int j, float offsetX, float offsetY, float pixelWidth, float pixelHeight, const Scene& scene) {
+    float subPixelX = -1.0f + (i + offsetX) * pixelWidth;
+    float subPixelY = -1.0f + (j + offsetY) * pixelHeight;
+    Vector subPixelPosition(subPixelX, subPixelY, 0);
+    Vector rayDirection = (subPixelPosition - scene.cameraPosition).normalize();
+    return Ray(scene.cameraPosition, rayDirection);
+}
+
+//color of the next sample of pixel index, through gbuffer when there is one
+static Vector sampleColor(const Ray& ray, Scene& scene, GBuffer* gbuffer, int index, const PixelSamples& pixel) {
+    return gbuffer ? gbuffer->sample(index, pixel.count, ray, scene) : createColor(ray, scene, 0);
+}
+
+//adds raysPerPixel samples of pixel (i, j) on the sub-pixel grid
+static void renderPixel(int i, int j, float pixelWidth, float pixelHeight, int raysPerPixel, Scene& scene,
+                        GBuffer* gbuffer, int index, PixelSamples& pixel) {
+    for (int s = 0; s < raysPerPixel; s++) {
+        float offsetX, offsetY;
+        gridOffset(s, raysPerPixel, offsetX, offsetY);
+        countStat(STAT_PRIMARY_RAYS);
+        Ray ray = primaryRay(i, j, offsetX, offsetY, pixelWidth, pixelHeight, scene);
+        pixel.add(sampleColor(ray, scene, gbuffer, index, pixel));
+    }
+}
+
+//fills lane k of packet with ray
+static void setPacketRay(RayPacket& packet, int k, const Ray& ray, float t) {
+    packet.ox[k] = ray.origin.x;
+    packet.oy[k] = ray.origin.y;
+    packet.oz[k] = ray.origin.z;
+    packet.dx[k] = ray.direction.x;
+    packet.dy[k] = ray.direction.y;
+    packet.dz[k] = ray.direction.z;
+    packet.invDx[k] = 1.0f / ray.direction.x;
+    packet.invDy[k] = 1.0f / ray.direction.y;
+    packet.invDz[k] = 1.0f / ray.direction.z;
+    packet.t[k] = t;
+    packet.id[k] = -1;
+}
+
+static Ray packetRay(const RayPacket& packet, int k) {
+    return Ray(Vector(packet.ox[k], packet.oy[k], packet.oz[k]), Vector(packet.dx[k], packet.dy[k], packet.dz[k]));
+}
+
+//the kernels read whole registers, so lanes past the last ray must hold defined values
+static void clearPacket(RayPacket& packet, int count) {
+    packet.count = (count + 7) / 8 * 8;
+    for (int k = 0; k < packet.count; k++) {
+        setPacketRay(packet, k, Ray(Vector(0, 0, 0), Vector(0, 0, 0)), 0.0f);
+    }
+}
+
+//same as createColor(ray, scene, 0) for every ray of a packet of primary rays: the packet
+//finds the closest hits together, then the opaque hits send one shadow packet per light.
+//reflected and refracted rays continue one by one
+static void tracePrimaryPacket(RayPacket& packet, int count, Scene& scene, Vector* colors) {
+    uint64_t rays = count == 64 ? ~0ull : (1ull << count) - 1;
+    scene.bvh.closestHitPacket(packet, scene.primitives, rays);
+    countDepth(0, count);
+
+    Intersection hits[RayPacket::kMaxRays];
+    uint64_t opaque = 0;
+    for (int k = 0; k < count; k++) {
+        Ray ray = packetRay(packet, k);
+        HitRecord hit;
+        hit.t = packet.t[k];
+        hit.primitive = packet.id[k];
+        countHit(scene, hit);
+        hits[k] = scene.primitives.surface(ray, hit);
+        //with a light budget every hit samples its own lights, one by one
+        if (hits[k].hit && !hits[k].reflective && !hits[k].transparent && scene.lightBudget == 0) {
+            opaque |= 1ull << k;
+        } else {
+            colors[k] = shadeHit(ray, hits[k], scene, 0);
+        }
+    }
+    if (!opaque) return;
+
+    //opaque hits are shaded in place, one light at a time in scene order
+    Vector viewDirs[RayPacket::kMaxRays];
+    Vector toLights[RayPacket::kMaxRays];
+    for (int k = 0; k < count; k++) {
+        if (!(opaque & (1ull << k))) continue;
+        colors[k] = Vector(0, 0, 0);
+        viewDirs[k] = (Vector(packet.ox[k], packet.oy[k], packet.oz[k]) - hits[k].point).normalize();
+    }
+    //the lights the tree cannot rule out for a sphere around all the hits
+    thread_local std::vector<int> lights;
+    lights.clear();
+    if (scene.lightTree.empty()) {
+        for (std::size_t l = 0; l < scene.shadingLights.size(); l++) lights.push_back((int)l);
+    } else {
+        AABB points;
+        for (int k = 0; k < count; k++) {
+            if (opaque & (1ull << k)) points.expand(hits[k].point);
+        }
+        float radius = (points.max - points.min).magnitude() * 0.5f;
+        int culled = scene.lightTree.candidates(points.centroid(), radius, lights);
+        countStat(STAT_LIGHTS_CULLED, (uint64_t)culled * __builtin_popcountll(opaque));
+    }
+    RayPacket shadows;
+    for (int l : lights) {
+        const ShadingLight& light = scene.shadingLights[l];
+        clearPacket(shadows, count);
+        uint64_t lit = 0;
+        for (int k = 0; k < count; k++) {
+            Ray shadowRay(Vector(0, 0, 0), Vector(0, 0, 0));
+            float lightDistance;
+            if ((opaque & (1ull << k)) && lightShadowRay(light, hits[k].point, shadowRay, lightDistance, toLights[k])) {
+                setPacketRay(shadows, k, shadowRay, lightDistance);
+                lit |= 1ull << k;
+            }
+        }
+        uint64_t blocked = lit ? shadowBlockedPacket(scene, l, shadows, lit) : 0;
+        countStat(STAT_SHADOW_RAYS, __builtin_popcountll(lit));
+        countStat(STAT_SHADOWS_OCCLUDED, __builtin_popcountll(blocked));
+        for (int k = 0; k < count; k++) {
+            if ((lit & ~blocked) & (1ull << k)) colors[k] = colors[k] + lightContribution(hits[k], viewDirs[k], light, toLights[k]);
+        }
+    }
+    for (int k = 0; k < count; k++) {
+        if (opaque & (1ull << k)) colors[k] = colors[k] + hits[k].color.Hadamard(scene.ambientLight->getIntensity());
+    }
+}
+
+//adds raysPerPixel samples to every pixel of a block of at most 8x8 pixels, tracing each sub-pixel
+//sample of all of them as one packet
+static void renderBlock(const Tile& block, float pixelWidth, float pixelHeight, int raysPerPixel, Scene& scene,
+                        int imageWidth, std::vector<PixelSamples>& samples) {
+    int blockWidth = block.x1 - block.x0;
+    int count = blockWidth * (block.y1 - block.y0);
+    Vector colors[RayPacket::kMaxRays];
+    RayPacket packet;
+
+    for (int s = 0; s < raysPerPixel; s++) {
+        float offsetX, offsetY;
+        gridOffset(s, raysPerPixel, offsetX, offsetY);
+        clearPacket(packet, count);
+        //the directions eight at a time, lane for lane the ones primaryRay computes. lanes past
+        //count aim one unit to the side of the camera, so they normalize no zero vector
+        Vec3x8 camera = Vec3x8::broadcast(scene.cameraPosition);
+        for (int first = 0; first < count; first += Vec3x8::width) {
+            int lanes = std::min(Vec3x8::width, count - first);
+            Vec3x8 subPixels = Vec3x8::broadcast(scene.cameraPosition + Vector(1, 0, 0));
+            for (int lane = 0; lane < lanes; lane++) {
+                int i = block.x0 + (first + lane) % blockWidth;
+                int j = block.y0 + (first + lane) / blockWidth;
+                subPixels.set(lane, Vector(-1.0f + (i + offsetX) * pixelWidth, -1.0f + (j + offsetY) * pixelHeight, 0));
+            }
+            Vec3x8 directions = (subPixels - camera).normalize();
+            for (int lane = 0; lane < lanes; lane++) {
+                Ray ray(scene.cameraPosition, directions.get(lane));
+                setPacketRay(packet, first + lane, ray, std::numeric_limits<float>::max());
+            }
+        }
+        countStat(STAT_PRIMARY_RAYS, count);
+        tracePrimaryPacket(packet, count, scene, colors);
+        for (int k = 0; k < count; k++) {
+            int i = block.x0 + k % blockWidth;
+            int j = block.y0 + k / blockWidth;
+            samples[j * imageWidth + i].add(colors[k]);
+        }
+    }
+}
+
+//more samples for pixel (i, j), in rounds of roundSize jittered samples, until it has
+//maxSamples or the error of its mean drops under threshold
+static void refinePixel(int i, int j, float pixelWidth, float pixelHeight, int roundSize, int maxSamples,
+                        float threshold, Scene& scene, GBuffer* gbuffer, int index, PixelSamples& pixel) {
+    for (int round = 0; pixel.count < maxSamples; round++) {
+        int count = std::min(roundSize, maxSamples - pixel.count);
+        for (int s = 0; s < count; s++) {
+            float offsetX, offsetY;
+            jitteredOffset(i, j, round, s, count, offsetX, offsetY);
+            countStat(STAT_PRIMARY_RAYS);
+            Ray ray = primaryRay(i, j, offsetX, offsetY, pixelWidth, pixelHeight, scene);
+            pixel.add(sampleColor(ray, scene, gbuffer, index, pixel));
+        }
+        if (pixel.standardError() <= threshold) break;
+    }
+}
+
+//first pass in wavefront mode: raysPerPixel grid samples of every pixel of tile, traced as one batch
+static void renderTileWavefront(const Tile& tile, float pixelWidth, float pixelHeight, int raysPerPixel, Scene& scene,
+                                int imageWidth, std::vector<PixelSamples>& samples, Wavefront& wavefront) {
+    wavefront.clear();
+    for (int s = 0; s < raysPerPixel; s++) {
+        float offsetX, offsetY;
+        gridOffset(s, raysPerPixel, offsetX, offsetY);
+        for (int j = tile.y0; j < tile.y1; j++) {
+            for (int i = tile.x0; i < tile.x1; i++) {
+                wavefront.addCameraRay(primaryRay(i, j, offsetX, offsetY, pixelWidth, pixelHeight, scene));
+            }
+        }
+    }
+    countStat(STAT_PRIMARY_RAYS, wavefront.size());
+    wavefront.trace(scene);
+    int path = 0;
+    for (int s = 0; s < raysPerPixel; s++) {
+        for (int j = tile.y0; j < tile.y1; j++) {
+            for (int i = tile.x0; i < tile.x1; i++) {
+                samples[j * imageWidth + i].add(wavefront.color(path++));
+            }
+        }
+    }
+}
+
+//second pass in wavefront mode: refinePixel for the flagged pixels of tile, one round of all
+//of them per batch, until every pixel has its samples
+static void refineTileWavefront(const Tile& tile, float pixelWidth, float pixelHeight, int roundSize, int maxSamples,
+                                float threshold, Scene& scene, int imageWidth, const std::vector<char>& flagged,
+                                std::vector<PixelSamples>& samples, Wavefront& wavefront) {
+    std::vector<int> active;
+    for (int j = tile.y0; j < tile.y1; j++) {
+        for (int i = tile.x0; i < tile.x1; i++) {
+            int index = j * imageWidth + i;
+            if (flagged[index] && samples[index].count < maxSamples) active.push_back(index);
+        }
+    }
+    for (int round = 0; !active.empty(); round++) {
+        wavefront.clear();
+        for (int index : active) {
+            int i = index % imageWidth, j = index / imageWidth;
+            int count = std::min(roundSize, maxSamples - samples[index].count);
+            for (int s = 0; s < count; s++) {
+                float offsetX, offsetY;
+                jitteredOffset(i, j, round, s, count, offsetX, offsetY);
+                wavefront.addCameraRay(primaryRay(i, j, offsetX, offsetY, pixelWidth, pixelHeight, scene));
+            }
+        }
+        countStat(STAT_PRIMARY_RAYS, wavefront.size());
+        wavefront.trace(scene);
+        int path = 0;
+        std::size_t kept = 0;
+        for (int index : active) {
+            PixelSamples& pixel = samples[index];
+            int count = std::min(roundSize, maxSamples - pixel.count);
+            for (int s = 0; s < count; s++) pixel.add(wavefront.color(path++));
+            if (pixel.count < maxSamples && pixel.standardError() > threshold) active[kept++] = index;
+        }
+        active.resize(kept);
+    }
+}
+
+//first pass over tile: raysPerPixel grid samples of each of its pixels, through the gbuffer,
+//the wavefront, packets or one ray at a time as options and gbuffer say
+static void sampleTile(const Tile& tile, const RenderOptions& options, float pixelWidth, float pixelHeight,
+                       int raysPerPixel, Scene& scene, GBuffer* gbuffer, int imageWidth,
+                       std::vector<PixelSamples>& samples, Wavefront& wavefront) {
+    if (gbuffer) {
+        for (int j = tile.y0; j < tile.y1; j++) {
+            for (int i = tile.x0; i < tile.x1; i++) {
+                int pixel = j * imageWidth + i;
+                renderPixel(i, j, pixelWidth, pixelHeight, raysPerPixel, scene, gbuffer, pixel, samples[pixel]);
+            }
+        }
+    } else if (options.wavefront) {
+        renderTileWavefront(tile, pixelWidth, pixelHeight, raysPerPixel, scene, imageWidth, samples, wavefront);
+    } else if (options.packetSize > 0) {
+        int size = options.packetSize;
+        for (int y = tile.y0; y < tile.y1; y += size) {
+            for (int x = tile.x0; x < tile.x1; x += size) {
+                Tile block{x, y, std::min(x + size, tile.x1), std::min(y + size, tile.y1)};
+                renderBlock(block, pixelWidth, pixelHeight, raysPerPixel, scene, imageWidth, samples);
+            }
+        }
+    } else {
+        for (int j = tile.y0; j < tile.y1; j++) {
+            for (int i = tile.x0; i < tile.x1; i++) {
+                renderPixel(i, j, pixelWidth, pixelHeight, raysPerPixel, scene, nullptr, 0, samples[j * imageWidth + i]);
+            }
+        }
+    }
+}
+
+//the pixels of crop the second pass refines. they are picked before any of them changes, so
+//the choice does not depend on the tile order
+static std::vector<char> flagPixels(const std::vector<PixelSamples>& samples, const Tile& crop, int imageWidth,
+                                    int imageHeight, float threshold) {
+    std::vector<char> flagged(samples.size());
+    for (int j = crop.y0; j < crop.y1; j++) {
+        for (int i = crop.x0; i < crop.x1; i++) {
+            flagged[j * imageWidth + i] = needsRefinement(samples, imageWidth, imageHeight, i, j, threshold);
+        }
+    }
+    return flagged;
+}
+
+//second pass over tile: refinePixel for each of its flagged pixels
+static void refineTile(const Tile& tile, const RenderOptions& options, float pixelWidth, float pixelHeight,
+                       int minSamples, int maxSamples, Scene& scene, GBuffer* gbuffer, int imageWidth,
+                       const std::vector<char>& flagged, std::vector<PixelSamples>& samples, Wavefront& wavefront) {
+    if (options.wavefront && !gbuffer) {
+        refineTileWavefront(tile, pixelWidth, pixelHeight, minSamples, maxSamples, options.aaThreshold, scene,
+                            imageWidth, flagged, samples, wavefront);
+        return;
+    }
+    for (int j = tile.y0; j < tile.y1; j++) {
+        for (int i = tile.x0; i < tile.x1; i++) {
+            if (!flagged[j * imageWidth + i]) continue;
+            int pixel = j * imageWidth + i;
+            refinePixel(i, j, pixelWidth, pixelHeight, minSamples, maxSamples, options.aaThreshold, scene, gbuffer,
+                        pixel, samples[pixel]);
+        }
+    }
+}
+
+std::string imageFileName(const RenderOptions& options, bool aliasing) {
+    if (!options.outputPath.empty()) return options.outputPath;
+    // Extract the input file name
+    std::string inputFileName = std::filesystem::path(options.scenePath).stem().string();
+    //anti-aliased scenes get their own name
+    std::string prefix = aliasing ? "/myAliasing" : "/my";
+    return options.outputDirectory + prefix + inputFileName + imageExtension(options.format);
+}
+
+//loads options.scenePath into scene, from its compiled cache when that is up to date
+bool loadScene(const RenderOptions& options, Scene& scene) {
+    if (options.useCache && readSceneCache(scene, options.scenePath, sceneCachePath(options.scenePath))) return true;
+    return scene.loadFromFile(options.scenePath);
+}
+
+//creating and sending the rays
+RenderSummary renderImage(const RenderOptions& options, Scene& scene) {
+    if (!loadScene(options, scene)) {
+        RenderSummary failed;
+        failed.ok = false;
+        return failed;
+    }
+    if (options.progressive) return renderProgressive(options, scene);
+    return renderScene(options, scene, nullptr);
+}
+
+//prints or writes stats as options ask
+static void reportStats(const RenderOptions& options, const RenderStats& stats) {
+    if (!options.stats && options.statsJsonPath.empty()) return;
+    if (!statsEnabled()) {
+        std::cerr << "Statistics are compiled out of this build (NO_RENDER_STATS)" << std::endl;
+        return;
+    }
+    if (options.stats) stats.print(std::cout);
+    if (!options.statsJsonPath.empty()) stats.writeJson(options.statsJsonPath);
+}
+
+//first stride of a progressive render: one pixel in kCoarseStride x kCoarseStride
+static const int kCoarseStride = 8;
+
+RenderSummary renderScene(const RenderOptions& options, Scene& scene, GBuffer* gbuffer, ThreadPool* sharedPool,
+                          std::vector<Vector>* imageOut) {
+    int imageWidth = options.imageWidth;
+    int imageHeight = options.imageHeight;
+    float screenWidth = 2.0f, screenHeight = 2.0f;
+    int minSamples = 1, maxSamples = 1;
+    std::string outputFileName = imageFileName(options, scene.aliasing);
+   
+    //if we want more then one ray, will change the ray nomber
+    if (scene.aliasing) {
+        minSamples = options.aaMinSamples;
+        maxSamples = std::max(options.aaMinSamples, options.aaMaxSamples);
+    }
+    bool refine = maxSamples > minSamples;
+    scene.lightBudget = options.lightBudget;
+
+    //the pixels to render in (i, j) coordinates, and around them the ones the first pass
+    //needs too: refinement compares every pixel with its four neighbours
+    Tile crop{0, 0, imageWidth, imageHeight};
+    if (options.cropped()) {
+        crop = Tile{options.cropX0, imageHeight - options.cropY1, options.cropX1, imageHeight - options.cropY0};
+        if (options.outputPath.empty()) {
+            outputFileName = std::filesystem::path(outputFileName).replace_extension(".part").string();
+        }
+    }
+    int border = refine ? 1 : 0;
+    Tile area{std::max(0, crop.x0 - border), std::max(0, crop.y0 - border), std::min(imageWidth, crop.x1 + border),
+              std::min(imageHeight, crop.y1 + border)};
+
+    float pixelWidth = screenWidth / imageWidth;
+    float pixelHeight = screenHeight / imageHeight;
+    std::vector<PixelSamples> samples(imageWidth * imageHeight);
+
+    //the buffers are stored top row first. rows go to disk as soon as their tiles are done
+    std::vector<Vector> imageBuffer(imageWidth * imageHeight);
+    std::vector<Vector> heatMap(options.heatMapPath.empty() ? 0 : imageWidth * imageHeight);
+    std::unique_ptr<ImageWriter> image;
+    if (!imageOut && !options.cropped()) {
+        image.reset(new ImageWriter(outputFileName, imageWidth, imageHeight, imageBuffer));
+    }
+
+    resetStats();
+
+    //every pixel is independent, so the tiles can be shaded in any order on any thread
+    std::unique_ptr<ThreadPool> ownPool;
+    if (!sharedPool) {
+        int threadCount = options.threads > 0 ? options.threads : ThreadPool::defaultThreadCount();
+        ownPool.reset(new ThreadPool(threadCount));
+    }
+    ThreadPool& pool = sharedPool ? *sharedPool : *ownPool;
+    std::vector<Tile> tiles = makeTiles(area.x1 - area.x0, area.y1 - area.y0, options.tileSize);
+    for (Tile& tile : tiles) {
+        tile.x0 += area.x0;
+        tile.x1 += area.x0;
+        tile.y0 += area.y0;
+        tile.y1 += area.y0;
+    }
+    std::vector<Wavefront> wavefronts(pool.size());
+    //what each tile's shadow rays ran into in the first pass, for when the second comes back to it
+    std::vector<std::vector<int>> occluderHints(refine ? tiles.size() : 0);
+
+    //the pixels of a tile are final: average them into the image and hand them to the writer
+    auto finishTile = [&](const Tile& tile) {
+        for (int j = tile.y0; j < tile.y1; j++) {
+            for (int i = tile.x0; i < tile.x1; i++) {
+                const PixelSamples& pixel = samples[j * imageWidth + i];
+                int idx = (imageHeight - j - 1) * imageWidth + i;
+                imageBuffer[idx] = pixel.mean();
+                if (!heatMap.empty()) heatMap[idx] = sampleCountColor(pixel.count, minSamples, maxSamples);
+            }
+        }
+        if (image) image->regionDone(tile.x0, imageHeight - tile.y1, tile.x1, imageHeight - tile.y0);
+    };
+
+    //first pass: minSamples for every pixel
+    pool.run((int)tiles.size(), [&](int worker, int index) {
+        const Tile& tile = tiles[index];
+        sampleTile(tile, options, pixelWidth, pixelHeight, minSamples, scene, gbuffer, imageWidth, samples,
+                   wavefronts[worker]);
+        if (refine) saveOccluders(occluderHints[index]);
+        else finishTile(tile);
+    });
+
+    //second pass: more samples where the first pass found noise or an edge
+    if (refine) {
+        std::vector<char> flagged = flagPixels(samples, crop, imageWidth, imageHeight, options.aaThreshold);
+        pool.run((int)tiles.size(), [&](int worker, int index) {
+            const Tile& tile = tiles[index];
+            loadOccluders(occluderHints[index]);
+            refineTile(tile, options, pixelWidth, pixelHeight, minSamples, maxSamples, scene, gbuffer, imageWidth,
+                       flagged, samples, wavefronts[worker]);
+            finishTile(tile);
+        });
+    }
+
+    bool saved = true;
+    if (image) {
+        saved = image->finish();
+    } else if (options.cropped()) {
+        PartialImage part;
+        part.width = imageWidth;
+        part.height = imageHeight;
+        part.x0 = options.cropX0;
+        part.y0 = options.cropY0;
+        part.x1 = options.cropX1;
+        part.y1 = options.cropY1;
+        part.aliasing = scene.aliasing;
+        for (int y = part.y0; y < part.y1; y++) {
+            const Vector* row = &imageBuffer[(std::size_t)y * imageWidth];
+            part.pixels.insert(part.pixels.end(), row + part.x0, row + part.x1);
+        }
+        saved = writePartialImage(outputFileName, part);
+    } else {
+        *imageOut = std::move(imageBuffer);
+    }
+    if (!heatMap.empty() && !saveImage(imageWidth, imageHeight, heatMap, options.heatMapPath)) saved = false;
+
+    RenderSummary summary;
+    summary.imagePath = outputFileName;
+    summary.ok = saved;
+    for (const auto& pixel : samples) summary.primaryRays += pixel.count;  //the border of a crop included
+    summary.stats = collectStats();
+    reportStats(options, summary.stats);
+    return summary;
+}
+
+RenderSummary renderProgressive(const RenderOptions& options, Scene& scene, const ProgressCallback& onPass) {
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point start = Clock::now();
+    Clock::time_point deadline = start + std::chrono::milliseconds(options.timeBudgetMs);
+    auto expired = [&] { return options.timeBudgetMs > 0 && Clock::now() >= deadline; };
+
+    int imageWidth = options.imageWidth;
+    int imageHeight = options.imageHeight;
+    int minSamples = 1, maxSamples = 1;
+    if (scene.aliasing) {
+        minSamples = options.aaMinSamples;
+        maxSamples = std::max(options.aaMinSamples, options.aaMaxSamples);
+    }
+    bool refine = maxSamples > minSamples;
+    scene.lightBudget = options.lightBudget;
+    std::string outputFileName = imageFileName(options, scene.aliasing);
+    float pixelWidth = 2.0f / imageWidth;
+    float pixelHeight = 2.0f / imageHeight;
+
+    resetStats();
+    ThreadPool pool(options.threads > 0 ? options.threads : ThreadPool::defaultThreadCount());
+    std::vector<Tile> tiles = makeTiles(imageWidth, imageHeight, options.tileSize);
+    std::vector<Wavefront> wavefronts(pool.size());
+    std::vector<std::vector<int>> occluderHints(tiles.size());
+    //the stride passes take the centre sample of a pixel, the one a render without anti-aliasing
+    //takes; the anti-aliasing passes sample every pixel again, the way renderScene does
+    std::vector<PixelSamples> preview(imageWidth * imageHeight);
+    std::vector<PixelSamples> samples(scene.aliasing ? imageWidth * imageHeight : 0);
+    std::vector<Vector> imageBuffer(imageWidth * imageHeight);
+
+    //runs pass over the tiles. the ones not started when the budget runs out are skipped, unless
+    //the pass must finish. true when every tile ran
+    std::vector<char> tileDone(tiles.size());
+    auto runPass = [&](bool mustFinish, const std::function<void(int, int)>& pass) {
+        std::fill(tileDone.begin(), tileDone.end(), 0);
+        pool.run((int)tiles.size(), [&](int worker, int index) {
+            if (!mustFinish && expired()) return;
+            pass(worker, index);
+            tileDone[index] = 1;
+        });
+        return std::find(tileDone.begin(), tileDone.end(), 0) == tileDone.end();
+    };
+
+    //a pixel shows its anti-aliased samples once it has them, before that the centre sample of
+    //the nearest pixel at or below it on the finest stride that reached it
+    int passIndex = 0;
+    //at most one image is being written while the next pass renders
+    std::future<bool> writing;
+    bool saved = true;
+    auto finishPass = [&](const std::string& name, bool complete, bool last) {
+        for (int j = 0; j < imageHeight; j++) {
+            for (int i = 0; i < imageWidth; i++) {
+                Vector& color = imageBuffer[(imageHeight - j - 1) * imageWidth + i];
+                if (!samples.empty() && samples[j * imageWidth + i].count > 0) {
+                    color = samples[j * imageWidth + i].mean();
+                    continue;
+                }
+                for (int stride = 1; stride <= kCoarseStride; stride *= 2) {
+                    const PixelSamples& pixel = preview[(j - j % stride) * imageWidth + i - i % stride];
+                    if (pixel.count > 0) {
+                        color = pixel.mean();
+                        break;
+                    }
+                }
+            }
+        }
+        ProgressivePass pass;
+        pass.index = passIndex++;
+        pass.name = name;
+        pass.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        pass.complete = complete;
+        pass.last = last;
+        pass.image = &imageBuffer;
+        if (onPass) {
+            onPass(pass);
+            return;
+        }
+        std::cout << "Pass " << name << (complete ? "" : " (out of time)") << " done at " << (int)(pass.seconds * 1000)
+                  << " ms" << std::endl;
+        if (writing.valid() && !writing.get()) saved = false;
+        writing = std::async(std::launch::async, [imageWidth, imageHeight, outputFileName, image = imageBuffer]() {
+            return saveImage(imageWidth, imageHeight, image, outputFileName, 1);
+        });
+    };
+
+    //the coarsest pass always finishes, so however short the budget there is a whole image
+    bool complete = true;
+    for (int stride = kCoarseStride; stride >= 1 && complete; stride /= 2) {
+        complete = runPass(stride == kCoarseStride, [&](int, int index) {
+            const Tile& tile = tiles[index];
+            for (int j = tile.y0; j < tile.y1; j++) {
+                for (int i = tile.x0; i < tile.x1; i++) {
+                    if (i % stride || j % stride) continue;
+                    //the pixels of the coarser strides are done
+                    if (stride < kCoarseStride && i % (2 * stride) == 0 && j % (2 * stride) == 0) continue;
+                    int pixel = j * imageWidth + i;
+                    renderPixel(i, j, pixelWidth, pixelHeight, 1, scene, nullptr, pixel, preview[pixel]);
+                }
+            }
+        });
+        finishPass("stride " + std::to_string(stride), complete, !complete || (stride == 1 && !scene.aliasing));
+    }
+    if (complete && scene.aliasing) {
+        complete = runPass(false, [&](int worker, int index) {
+            sampleTile(tiles[index], options, pixelWidth, pixelHeight, minSamples, scene, nullptr, imageWidth, samples,
+                       wavefronts[worker]);
+            if (refine) saveOccluders(occluderHints[index]);
+        });
+        finishPass("samples", complete, !complete || !refine);
+    }
+    if (complete && refine) {
+        std::vector<char> flagged =
+            flagPixels(samples, Tile{0, 0, imageWidth, imageHeight}, imageWidth, imageHeight, options.aaThreshold);
+        complete = runPass(false, [&](int worker, int index) {
+            loadOccluders(occluderHints[index]);
+            refineTile(tiles[index], options, pixelWidth, pixelHeight, minSamples, maxSamples, scene, nullptr,
+                       imageWidth, flagged, samples, wavefronts[worker]);
+        });
+        finishPass("refine", complete, true);
+    }
+    if (writing.valid() && !writing.get()) saved = false;
+
+    RenderSummary summary;
+    summary.imagePath = outputFileName;
+    summary.ok = saved;
+    for (const auto& pixel : preview) summary.primaryRays += pixel.count;
+    for (const auto& pixel : samples) summary.primaryRays += pixel.count;
+    summary.stats = collectStats();
+    reportStats(options, summary.stats);
+    return summary;
+}
@@ -0,0 +1,143 @@
+// Render.h
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "Vector.h"
+#include "Ray.h"
+#include "Intersection.h"
+#include "Options.h"
+#include "RenderStats.h"
+#include "Scene.h"
+#include "Light.h"
+#include "OccluderCache.h"
+#include <limits>
+
+//find the closest object
+Intersection findObject(const Ray& ray, const Scene& scene);
+//closest hit along the ray, distance and primitive only
+HitRecord traceClosest(const Ray& ray, const Scene& scene);
+//the shadow ray from point toward light and toLight, the light's getDistance(point) that
+//shading uses. false when the point is outside a spotlight's cone
+inline bool lightShadowRay(const ShadingLight& light, const Vector& point, Ray& shadowRay, float& lightDistance,
+                           Vector& toLight) {
+    if (light.type == LIGHT_DIRECTIONAL) {
+        shadowRay = Ray(point + light.toLightUnit * 1e-4f, light.toLightUnit);
+        lightDistance = std::numeric_limits<float>::infinity();
+        toLight = light.toLight;
+        return true;
+    }
+    if (light.type == LIGHT_SPOT) {
+        Vector offset = light.position - point;
+        Vector shadowRayDirection = offset.normalize();
+        //(point - position).normalize() is exactly the negated direction
+        float cosAngle = (shadowRayDirection * -1).dot(light.axis);
+        if (cosAngle >= light.cutoff) {
+            shadowRay = Ray(point + shadowRayDirection * 1e-4f, shadowRayDirection);
+            lightDistance = offset.magnitude();
+            toLight = shadowRayDirection;
+            return true;
+        }
+        countStat(STAT_LIGHTS_CULLED);
+    }
+    return false;
+}
+
+//calls reach(l, shadowRay, lightDistance, toLight) for every light l whose cone holds point,
+//in scene order: all the lights, or the ones the scene's light tree does not rule out
+template <class Visitor>
+void findReachingLights(const Scene& scene, const Vector& point, Visitor&& reach) {
+    auto visit = [&](int l) {
+        Ray shadowRay(Vector(0, 0, 0), Vector(0, 0, 0));
+        float lightDistance;
+        Vector toLight;
+        if (lightShadowRay(scene.shadingLights[l], point, shadowRay, lightDistance, toLight)) {
+            reach(l, shadowRay, lightDistance, toLight);
+        }
+    };
+    if (scene.lightTree.empty()) {
+        for (std::size_t l = 0; l < scene.shadingLights.size(); l++) visit((int)l);
+        return;
+    }
+    thread_local std::vector<int> candidates;
+    countStat(STAT_LIGHTS_CULLED, scene.lightTree.candidates(point, 0.0f, candidates));
+    for (int l : candidates) visit(l);
+}
+
+//find the ligth that that effect the object: calls visit(light, toLight) for every light whose
+//shadow ray reaches the hit point, in scene order
+template <class Visitor>
+void findLights(const Scene& scene, const Intersection& interObject, Visitor&& visit) {
+    findReachingLights(scene, interObject.point, [&](int l, const Ray& shadowRay, float lightDistance,
+                                                     const Vector& toLight) {
+        countStat(STAT_SHADOW_RAYS);
+        if (shadowBlocked(scene, l, shadowRay, lightDistance)) {
+            countStat(STAT_SHADOWS_OCCLUDED);
+        } else {
+            visit(scene.shadingLights[l], toLight);
+        }
+    });
+}
+//calculate the pixels color
+Vector createColor(Ray ray, Scene& scene, int counter);
+//color seen along ray at its closest hit, recursing for reflective and transparent hits
+Vector shadeHit(const Ray& ray, const Intersection& interObject, Scene& scene, int counter);
+//mirror and refraction (eta = 1.5 for glass) directions of I at a surface with normal N
+Vector reflect(const Vector& I, const Vector& N);
+Vector refract(const Vector& I, const Vector& N, float eta);
+//phong term of one light at an opaque hit, toLight as from lightShadowRay
+Vector lightContribution(const Intersection& interObject, const Vector& viewDir, const ShadingLight& light,
+                         const Vector& toLight);
+//phong shading of an opaque hit from the lights that reach it, plus ambient
+Vector shadeLights(const Ray& ray, const Intersection& interObject, const Scene& scene);
+
+//writes buffer (top row first) as png, ppm or pfm, by the extension of fileName, on threads
+//threads (0 = one per hardware thread). false when the file could not be written
+bool saveImage(int width, int height, const std::vector<Vector>& buffer, const std::string& fileName, int threads = 0);
+// what a render did, for benchmarks and logs
+struct RenderSummary {
+    long long primaryRays = 0;   // camera rays, all anti-aliasing samples included
+    RenderStats stats;           // all zero when the counters are compiled out
+    std::string imagePath;       // where the image was saved
+    bool ok = true;              // false when the scene could not be loaded or the image not saved
+};
+
+class GBuffer;
+class ThreadPool;
+
+// the image of a progressive render after one of its passes
+struct ProgressivePass {
+    int index = 0;            // 0 for the first pass
+    std::string name;         // "stride 8" to "stride 1", then "samples" and "refine" with anti-aliasing
+    double seconds = 0.0;     // wall clock since the render started
+    bool complete = false;    // false when the budget ran out before the pass reached every tile
+    bool last = false;        // no pass follows
+    const std::vector<Vector>* image = nullptr;  // top row first, valid during the call
+};
+using ProgressCallback = std::function<void(const ProgressivePass&)>;
+
+//where the image of a render goes: --output, or <output dir>/my<scene name> (myAliasing
+//for scenes with anti-aliasing) with the extension of the format
+std::string imageFileName(const RenderOptions& options, bool aliasing);
+//loads options.scenePath into scene, from its compiled cache when that is up to date
+bool loadScene(const RenderOptions& options, Scene& scene);
+//creating and sending the rays: loads the scene of options and renders it. summary.ok is false,
+//with no image saved, when the scene cannot be loaded
+RenderSummary renderImage(const RenderOptions& options, Scene& scene);
+//renders scene, already loaded. with a gbuffer every camera sample goes through its cache.
+//pool, when given, runs the tiles instead of a pool made for this render. with imageOut
+//the image (top row first) is moved there instead of saved to summary.imagePath. with a
+//crop only its pixels are rendered and saved as a partial image (.part unless --output).
+//summary.ok is false when an image or the heat map could not be written
+RenderSummary renderScene(const RenderOptions& options, Scene& scene, GBuffer* gbuffer, ThreadPool* pool = nullptr,
+                          std::vector<Vector>* imageOut = nullptr);
+//renders scene in passes that each leave a better image: one pixel in 8 x 8, then the pixels
+//between them at strides 4, 2 and 1, then the anti-aliasing samples and refinement of
+//renderScene, whose image it ends with. after each pass the image goes to onPass, or replaces
+//the one at imageFileName when there is no onPass. with options.timeBudgetMs the tiles not
+//started when it runs out are skipped and the render ends after that pass
+RenderSummary renderProgressive(const RenderOptions& options, Scene& scene, const ProgressCallback& onPass = nullptr);
+
+#endif // RENDER_H
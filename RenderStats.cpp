@@ -0,0 +1,96 @@
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "RenderStats.h"
+
+void RenderStats :: add(const RenderStats& other) {
+    for (int k = 0; k < STAT_COUNTER_COUNT; k++) counters[k] += other.counters[k];
+    for (int k = 0; k < kDepths; k++) depths[k] += other.depths[k];
+}
+
+const char* RenderStats :: name(StatCounter counter) {
+    static const char* names[STAT_COUNTER_COUNT] = {
+        "primary_rays", "reflected_rays", "refracted_rays", "shadow_rays", "box_tests",
+        "sphere_tests", "plane_tests", "cylinder_tests", "mesh_tests", "instance_tests", "sphere_hits",
+        "plane_hits", "cylinder_hits", "mesh_hits", "instance_hits",
+        "lights_culled", "shadows_occluded", "occluder_cache_hits"};
+    return names[counter];
+}
+
+void RenderStats :: print(std::ostream& out) const {
+    out << "Render statistics" << std::endl;
+    for (int k = 0; k < STAT_COUNTER_COUNT; k++) {
+        out << "  " << std::left << std::setw(18) << name((StatCounter)k) << std::right << std::setw(14)
+            << counters[k] << std::endl;
+    }
+    out << "  createColor calls by depth:";
+    for (int k = 0; k < kDepths; k++) out << " " << depths[k];
+    out << std::endl;
+}
+
+bool RenderStats :: writeJson(const std::string& fileName) const {
+    std::ofstream file(fileName);
+    if (!file) {
+        std::cerr << "Failed to write the statistics to " << fileName << std::endl;
+        return false;
+    }
+    file << "{";
+    for (int k = 0; k < STAT_COUNTER_COUNT; k++) {
+        file << (k ? ", " : "") << "\"" << name((StatCounter)k) << "\": " << counters[k];
+    }
+    file << ", \"depth_histogram\": [";
+    for (int k = 0; k < kDepths; k++) file << (k ? ", " : "") << depths[k];
+    file << "]}" << std::endl;
+    return true;
+}
+
+#ifndef NO_RENDER_STATS
+
+thread_local RenderStats* threadStats = nullptr;
+
+//every thread's block, kept until the program ends so the counts of finished threads stay readable
+static std::mutex registryLock;
+static std::vector<std::unique_ptr<RenderStats>>& registry() {
+    static std::vector<std::unique_ptr<RenderStats>> blocks;
+    return blocks;
+}
+
+RenderStats* registerStatsThread() {
+    std::lock_guard<std::mutex> guard(registryLock);
+    registry().emplace_back(new RenderStats());
+    threadStats = registry().back().get();
+    return threadStats;
+}
+
+bool statsEnabled() {
+    return true;
+}
+
+void resetStats() {
+    std::lock_guard<std::mutex> guard(registryLock);
+    for (auto& block : registry()) *block = RenderStats();
+}
+
+RenderStats collectStats() {
+    std::lock_guard<std::mutex> guard(registryLock);
+    RenderStats total;
+    for (const auto& block : registry()) total.add(*block);
+    return total;
+}
+
+#else
+
+bool statsEnabled() {
+    return false;
+}
+
+void resetStats() {}
+
+RenderStats collectStats() {
+    return RenderStats();
+}
+
+#endif
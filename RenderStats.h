@@ -0,0 +1,85 @@
+// RenderStats.h
+#ifndef RENDERSTATS_H
+#define RENDERSTATS_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// what the renderer counts. the hits are the closest hits found, by the type of the
+// primitive that was hit; the tests are the primitives handed to the intersection code
+enum StatCounter {
+    STAT_PRIMARY_RAYS,
+    STAT_REFLECTED_RAYS,
+    STAT_REFRACTED_RAYS,
+    STAT_SHADOW_RAYS,
+    STAT_BOX_TESTS,
+    STAT_SPHERE_TESTS,       // the per-type counters follow PrimitiveType's order
+    STAT_PLANE_TESTS,
+    STAT_CYLINDER_TESTS,
+    STAT_MESH_TESTS,         // meshes entered, not their triangles
+    STAT_INSTANCE_TESTS,     // instances entered, their geometry counts on its own
+    STAT_SPHERE_HITS,
+    STAT_PLANE_HITS,
+    STAT_CYLINDER_HITS,
+    STAT_MESH_HITS,
+    STAT_INSTANCE_HITS,
+    STAT_LIGHTS_CULLED,      // spotlights skipped because the point is outside the cone
+    STAT_SHADOWS_OCCLUDED,   // shadow rays that found something before the light
+    STAT_OCCLUDER_CACHE_HITS,  // of those, the ones the light's last occluder blocked (OccluderCache.h)
+    STAT_COUNTER_COUNT
+};
+
+struct RenderStats {
+    static const int kDepths = 8;
+
+    uint64_t counters[STAT_COUNTER_COUNT] = {};
+    uint64_t depths[kDepths] = {};   // traced createColor calls per recursion depth
+
+    void add(const RenderStats& other);
+    void print(std::ostream& out) const;
+    bool writeJson(const std::string& fileName) const;
+
+    static const char* name(StatCounter counter);
+};
+
+// true unless the counters were compiled out
+bool statsEnabled();
+// zero the counters of every thread
+void resetStats();
+// sum of the counters of every thread. call while no thread is counting
+RenderStats collectStats();
+
+// every thread counts into its own block, found through a thread_local pointer, so a count
+// is a plain increment. building with -DNO_RENDER_STATS (make RELEASE=1) removes them
+#ifndef NO_RENDER_STATS
+RenderStats* registerStatsThread();
+extern thread_local RenderStats* threadStats;
+
+inline RenderStats& localStats() {
+    RenderStats* stats = threadStats;
+    return stats ? *stats : *registerStatsThread();
+}
+inline void countStat(StatCounter counter, uint64_t amount = 1) {
+    localStats().counters[counter] += amount;
+}
+inline void countDepth(int depth, uint64_t amount = 1) {
+    localStats().depths[depth < RenderStats::kDepths ? depth : RenderStats::kDepths - 1] += amount;
+}
+#else
+inline void countStat(StatCounter, uint64_t = 1) {}
+inline void countDepth(int, uint64_t = 1) {}
+#endif
+
+// the tests of one BVH query, summed in locals and counted once when it returns
+struct TraversalCounts {
+    uint64_t boxes = 0;
+    uint64_t primitives[5] = {};   // by PrimitiveType
+
+    ~TraversalCounts() {
+        countStat(STAT_BOX_TESTS, boxes);
+        for (int k = 0; k < 5; k++) countStat((StatCounter)(STAT_SPHERE_TESTS + k), primitives[k]);
+    }
+};
+
+#endif // RENDERSTATS_H
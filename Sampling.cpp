@@ -0,0 +1,89 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "Sampling.h"
+
+void PixelSamples :: add(const Vector& color) {
+    sum = sum + color;
+    float luminance = displayLuminance(color);
+    luminanceSum += luminance;
+    luminanceSquaredSum += luminance * luminance;
+    count++;
+}
+
+Vector PixelSamples :: mean() const {
+    return sum / float(count);
+}
+
+float PixelSamples :: meanLuminance() const {
+    return count > 0 ? luminanceSum / count : 0.0f;
+}
+
+float PixelSamples :: standardError() const {
+    if (count < 2) return 0.0f;
+    float mean = luminanceSum / count;
+    float variance = std::max(0.0f, luminanceSquaredSum / count - mean * mean);
+    return std::sqrt(variance / count);
+}
+
+float displayLuminance(const Vector& color) {
+    float r = std::min(1.0f, std::max(0.0f, color.x));
+    float g = std::min(1.0f, std::max(0.0f, color.y));
+    float b = std::min(1.0f, std::max(0.0f, color.z));
+    return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+}
+
+void gridOffset(int s, int count, float& offsetX, float& offsetY) {
+    int subGridX = std::ceil(std::sqrt(count));
+    int subGridY = std::ceil(static_cast<float>(count) / subGridX);
+    int sx = s / subGridY;
+    int sy = s % subGridY;
+    offsetX = (sx + 0.5f) / subGridX;
+    offsetY = (sy + 0.5f) / subGridY;
+}
+
+//integer hash (the murmur3 finalizer), so jitter is the same on every run and thread
+static uint32_t hash(uint32_t v) {
+    v ^= v >> 16;
+    v *= 0x85ebca6bu;
+    v ^= v >> 13;
+    v *= 0xc2b2ae35u;
+    v ^= v >> 16;
+    return v;
+}
+
+float hashToUnit(uint32_t v) {
+    return (hash(v) >> 8) * (1.0f / 16777216.0f);
+}
+
+void jitteredOffset(int i, int j, int round, int s, int count, float& offsetX, float& offsetY) {
+    int subGridX = std::ceil(std::sqrt(count));
+    int subGridY = std::ceil(static_cast<float>(count) / subGridX);
+    int sx = s / subGridY;
+    int sy = s % subGridY;
+    uint32_t seed = hash((uint32_t)i * 73856093u ^ (uint32_t)j * 19349663u ^ (uint32_t)round * 83492791u) + (uint32_t)s * 2u;
+    offsetX = (sx + hashToUnit(seed)) / subGridX;
+    offsetY = (sy + hashToUnit(seed + 1)) / subGridY;
+}
+
+bool needsRefinement(const std::vector<PixelSamples>& pixels, int imageWidth, int imageHeight,
+                     int i, int j, float threshold) {
+    const PixelSamples& pixel = pixels[j * imageWidth + i];
+    if (pixel.standardError() > threshold) return true;
+
+    float luminance = pixel.meanLuminance();
+    const int neighbours[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+    for (const auto& offset : neighbours) {
+        int ni = i + offset[0];
+        int nj = j + offset[1];
+        if (ni < 0 || nj < 0 || ni >= imageWidth || nj >= imageHeight) continue;
+        if (std::abs(pixels[nj * imageWidth + ni].meanLuminance() - luminance) > threshold) return true;
+    }
+    return false;
+}
+
+Vector sampleCountColor(int count, int minSamples, int maxSamples) {
+    float range = std::max(1, maxSamples - minSamples);
+    float level = std::min(1.0f, std::max(0.0f, (count - minSamples) / range));
+    return Vector(level, 0.0f, 1.0f - level);
+}
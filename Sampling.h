@@ -0,0 +1,45 @@
+// Sampling.h
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <cstdint>
+#include <vector>
+#include "Vector.h"
+
+// running sums of the samples taken in one pixel
+struct PixelSamples {
+    Vector sum;
+    float luminanceSum = 0.0f;
+    float luminanceSquaredSum = 0.0f;
+    int count = 0;
+
+    void add(const Vector& color);
+    Vector mean() const;
+    float meanLuminance() const;
+    // standard error of the mean luminance, how far the pixel may still be from converged
+    float standardError() const;
+};
+
+// luminance of a color as it ends up on screen (clamped to [0, 1])
+float displayLuminance(const Vector& color);
+
+// position of sample s of count inside the pixel, on a regular sub-grid. this is
+// the pattern the renderer always used for a fixed number of rays per pixel
+void gridOffset(int s, int count, float& offsetX, float& offsetY);
+
+// position of sample s of count for refinement round `round` of pixel (i, j): one
+// sample per cell of the sub-grid, at a hashed (repeatable) spot inside the cell
+void jitteredOffset(int i, int j, int round, int s, int count, float& offsetX, float& offsetY);
+
+// a number in [0, 1) hashed from v, the same on every run and thread
+float hashToUnit(uint32_t v);
+
+// true when pixel (i, j) needs more samples after the first pass: its samples
+// vary, or it differs from a neighbour by more than threshold in luminance
+bool needsRefinement(const std::vector<PixelSamples>& pixels, int imageWidth, int imageHeight,
+                     int i, int j, float threshold);
+
+// heat map color of a pixel that took count samples: blue at minSamples to red at maxSamples
+Vector sampleCountColor(int count, int minSamples, int maxSamples);
+
+#endif // SAMPLING_H
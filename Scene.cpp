@@ -1,13 +1,17 @@
 #include <vector>
 #include <string>
+#include <charconv>
+#include <cstring>
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include "Scene.h"
 #include "Object.h"
 #include "Light.h"
 #include "Intersection.h"
 #include "Vector.h"
+#include "MappedFile.h"
+#include "TriangleMesh.h"
+#include "Instance.h"
+#include <filesystem>
 #include <cmath>
 
 Scene::Scene() 
@@ -19,32 +23,134 @@ Scene::Scene()
       pointCounter(0)
 {}
 
-Scene::~Scene() {
-    for (Object* obj : objects) {
-        delete obj;
+//the pools destroy the objects and lights
+Scene::~Scene() {}
+
+namespace {
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+//reads numbers off one line of the scene file, [cursor, end)
+struct LineReader {
+    const char* cursor;
+    const char* end;
+
+    void skipSpaces() {
+        while (cursor < end && isSpace(*cursor)) cursor++;
     }
-    for (Light* light : lights) {
-        delete light;
+
+    //the next number, which must be followed by a space or the end of the line
+    bool readFloat(float& value) {
+        skipSpaces();
+        if (cursor < end && *cursor == '+') cursor++;
+        std::from_chars_result result = std::from_chars(cursor, end, value);
+        if (result.ec != std::errc() || (result.ptr < end && !isSpace(*result.ptr))) return false;
+        cursor = result.ptr;
+        return true;
+    }
+
+    //the next run of characters up to a space, false at the end of the line
+    bool readWord(std::string& word) {
+        skipSpaces();
+        const char* start = cursor;
+        while (cursor < end && !isSpace(*cursor)) cursor++;
+        word.assign(start, cursor);
+        return !word.empty();
+    }
+
+    //count numbers into values, anything after them on the line is ignored
+    bool readFloats(float* values, int count) {
+        for (int k = 0; k < count; k++) {
+            if (!readFloat(values[k])) return false;
+        }
+        return true;
     }
+};
+
+const char* lineEnd(const char* begin, const char* end) {
+    const char* newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+    return newline ? newline : end;
+}
+
+//first character of the line that is not a space, 0 for a blank line
+char lineType(const char* begin, const char* end) {
+    while (begin < end && isSpace(*begin)) begin++;
+    return begin < end ? *begin : 0;
+}
+
 }
 
-void Scene::loadFromFile(const std::string& filename) {
-    std::ifstream file(filename);
-    if (!file.is_open()) {
+bool Scene::loadFromFile(const std::string& filename) {
+    MappedFile file;
+    if (!file.open(filename)) {
         std::cerr << "Failed to open scene file: " << filename << std::endl;
-        return;
+        return false;
+    }
+    return loadFromText(file.data(), file.data() + file.size(), filename);
+}
+
+bool Scene::loadFromText(const char* begin, const char* end, const std::string& filename) {
+    //count the objects and lights of every type first, so their pools and vectors are allocated
+    //once. spheres and planes, and spotlights and directional lights, differ by their fourth number
+    std::size_t sphereLines = 0, planeLines = 0, cylinderLines = 0, meshLines = 0, instanceLines = 0;
+    std::size_t ambientLines = 0, directionalLines = 0, spotLines = 0;
+    for (const char* line = begin; line < end; line = lineEnd(line, end) + 1) {
+        const char* last = lineEnd(line, end);
+        char type = lineType(line, last);
+        float v[4];
+        if (type == 'o' || type == 't' || type == 'r' || type == 'd') {
+            LineReader reader{line, last};
+            reader.skipSpaces();
+            reader.cursor++;
+            if (!reader.readFloats(v, 4)) continue;
+            if (type == 'd') (v[3] == 0.0f ? directionalLines : spotLines)++;
+            else (v[3] > 0 ? sphereLines : planeLines)++;
+        } else if (type == 'f') {
+            cylinderLines++;
+        } else if (type == 'm') {
+            meshLines++;
+        } else if (type == 'n') {
+            instanceLines++;
+        } else if (type == 'a') {
+            ambientLines++;
+        }
     }
+    spheres.reserve(sphereLines);
+    planes.reserve(planeLines);
+    cylinders.reserve(cylinderLines);
+    meshes.reserve(meshLines);
+    instances.reserve(instanceLines);
+    ambientLights.reserve(ambientLines);
+    directionalLights.reserve(directionalLines);
+    spotlights.reserve(spotLines);
+    objects.reserve(objects.size() + sphereLines + planeLines + cylinderLines + meshLines + instanceLines);
+    lights.reserve(lights.size() + directionalLines + spotLines);
+
+    int lineNumber = 0;
+    for (const char* line = begin; line < end; line = lineEnd(line, end) + 1) {
+        lineNumber++;
+        LineReader reader{line, lineEnd(line, end)};
+        reader.skipSpaces();
+        if (reader.cursor == reader.end) continue;
+        char type = *reader.cursor++;
+
+        //the numbers every line type needs
+        int needed = 4;
+        if (type == 'a' || type == 'i') needed = 3;
+        else if (type == 'f') needed = 8;
+        float v[8];
+        bool known = type != 0 && std::strchr("eaotrdpcif", type) != nullptr;
+        if (known && !reader.readFloats(v, needed)) {
+            std::cerr << "Error: " << filename << ":" << lineNumber << ": expected " << needed
+                      << " numbers after '" << type << "', line skipped." << std::endl;
+            continue;
+        }
 
-    std::string line;
-    while (std::getline(file, line)) {
-        if(line.empty()) continue;
-        std::istringstream iss(line);
-        char type;
-        iss >> type;
         switch (type) {
             case 'e': {
-                float x, y, z, a;
-                iss >> x >> y >> z >> a;
+                float x = v[0], y = v[1], z = v[2], a = v[3];
                 cameraPosition = Vector(x, y, z);
                 if (a - 0.0 < 1e-6){
                     aliasing = true;
@@ -52,121 +158,200 @@ void Scene::loadFromFile(const std::string& filename) {
                 break;
             }
             case 'a': {
-                float r, g, b;
-                iss >> r >> g >> b;
-                ambientLight = new AmbientLight(Vector(r, g, b));
+                float r = v[0], g = v[1], b = v[2];
+                ambientLight = ambientLights.create(Vector(r, g, b));
                 break;
             }
             case 'o': {
                 // Non-transparent, non-reflective objects
-                float x, y, z, param;
-                iss >> x >> y >> z >> param;
+                float x = v[0], y = v[1], z = v[2], param = v[3];
                 if (param > 0) {
                     // Sphere
                     Vector center(x, y, z);
-                    objects.push_back(new Sphere(center, param, Vector(0, 0, 0), 0, false, false));
+                    objects.push_back(spheres.create(center, param, Vector(0, 0, 0), 0, false, false));
                 } else {
                     // Plane
                     Vector normal(x, y, z);
-                    objects.push_back(new Plane(normal, param, Vector(0, 0, 0), 0, false, false));
+                    objects.push_back(planes.create(normal, param, Vector(0, 0, 0), 0, false, false));
                 }
                 break;
             }
             case 't': {
                 // Transparent objects
-                float x, y, z, param;
-                iss >> x >> y >> z >> param;
+                float x = v[0], y = v[1], z = v[2], param = v[3];
                 if (param > 0) {
                     Vector center(x, y, z);
-                    objects.push_back(new Sphere(center, param, Vector(0, 0, 0), 0, true, false));
+                    objects.push_back(spheres.create(center, param, Vector(0, 0, 0), 0, true, false));
                 } else {
                     Vector normal(x, y, z);
-                    objects.push_back(new Plane(normal, param, Vector(0, 0, 0), 0, true, false));
+                    objects.push_back(planes.create(normal, param, Vector(0, 0, 0), 0, true, false));
                 }
                 break;
             }
             case 'r': {
                 // Reflective objects
-                float x, y, z, param;
-                iss >> x >> y >> z >> param;
+                float x = v[0], y = v[1], z = v[2], param = v[3];
                 if (param > 0) {
                     Vector center(x, y, z);
-                    objects.push_back(new Sphere(center, param, Vector(0, 0, 0), 0, false, true));
+                    objects.push_back(spheres.create(center, param, Vector(0, 0, 0), 0, false, true));
                 } else {
                     Vector normal(x, y, z);
-                    objects.push_back(new Plane(normal, param, Vector(0, 0, 0), 0, false, true));
+                    objects.push_back(planes.create(normal, param, Vector(0, 0, 0), 0, false, true));
                 }
                 break;
             }
             case 'd': {
-                float x, y, z, l;
-                iss >> x >> y >> z >> l;
+                float x = v[0], y = v[1], z = v[2], l = v[3];
                 Vector direction(x, y, z);
                 if (l == 0.0f) {
                     // Directional Light
                     Vector intensity = (ambientLight ? ambientLight->getIntensity() : Vector(0,0,0));
-                    lights.push_back(new DirectionalLight(direction, intensity));
+                    lights.push_back(directionalLights.create(direction, intensity));
                 } else {
                     // Spotlight with default position and cutoff, will be set later
                     Vector intensity = (ambientLight ? ambientLight->getIntensity() : Vector(0,0,0));
-                    lights.push_back(new Spotlight(Vector(0,0,0), direction, 0, intensity));
+                    lights.push_back(spotlights.create(Vector(0,0,0), direction, 0, intensity));
                 }
                 break;
             }
             case 'p': {
-                float px, py, pz, cutoff;
-                iss >> px >> py >> pz >> cutoff;
+                float px = v[0], py = v[1], pz = v[2], cutoff = v[3];
                 if (pointCounter < (int)lights.size()) {
-                    Spotlight* spotLight = dynamic_cast<Spotlight*>(lights[pointCounter]);
-                    if (spotLight) {
-                        spotLight->setPosition(Vector(px, py, pz), cutoff);
+                    if (lights[pointCounter]->type() == LIGHT_SPOT) {
+                        lights[pointCounter]->setPosition(Vector(px, py, pz), cutoff);
                         pointCounter++;
                     } else {
-                        std::cerr << "Error: Attempted to set position for a non-spotlight light." << std::endl;
+                        std::cerr << "Error: line " << lineNumber << ": Attempted to set position for a non-spotlight light." << std::endl;
                     }
                 } else {
-                    std::cerr << "Error: Mismatch in spotlight position assignment. Not enough spotlights." << std::endl;
+                    std::cerr << "Error: line " << lineNumber << ": Mismatch in spotlight position assignment. Not enough spotlights." << std::endl;
                 }
                 break;
             }
             case 'c': {
-                float r, g, b, shininess;
-                iss >> r >> g >> b >> shininess;
+                float r = v[0], g = v[1], b = v[2], shininess = v[3];
                 if (objCounter < (int)objects.size()) {
                     objects[objCounter]->setColor(Vector(r, g, b), shininess);
                     objCounter++;
                 } else {
-                    std::cerr << "Error: Mismatch in object color assignment. More 'c' lines than objects." << std::endl;
+                    std::cerr << "Error: line " << lineNumber << ": Mismatch in object color assignment. More 'c' lines than objects." << std::endl;
                 }
                 break;
             }
             case 'i': {
-                float r, g, b;
-                iss >> r >> g >> b;
+                float r = v[0], g = v[1], b = v[2];
                 if (lightCounter < (int)lights.size()) {
                     lights[lightCounter]->setIntensity(Vector(r, g, b));
                     lightCounter++;
                 } else {
-                    std::cerr << "Error: Mismatch in light intensity assignment. More 'i' lines than lights." << std::endl;
+                    std::cerr << "Error: line " << lineNumber << ": Mismatch in light intensity assignment. More 'i' lines than lights." << std::endl;
                 }
                 break;
             }
             case 'f': {
                 // Cylinder object
-                float cx, cy, cz, ax, ay, az, rad, h;
-                iss >> cx >> cy >> cz >> ax >> ay >> az >> rad >> h;
-                Vector center(cx, cy, cz);
-                Vector axis(ax, ay, az);
-                objects.push_back(new Cylinder(center, axis, rad, h, Vector(0, 0, 0), 0, false, false));
+                Vector center(v[0], v[1], v[2]);
+                Vector axis(v[3], v[4], v[5]);
+                float rad = v[6], h = v[7];
+                objects.push_back(cylinders.create(center, axis, rad, h, Vector(0, 0, 0), 0, false, false));
+                break;
+            }
+            case 'm': {
+                // Triangle mesh: m <obj file> [x y z [scale]], the path relative to the scene file
+                std::string path;
+                float placement[4] = {0, 0, 0, 1};
+                bool valid = reader.readWord(path);
+                int numbers = 0;
+                for (; numbers < 4 && valid; numbers++) {
+                    reader.skipSpaces();
+                    if (reader.cursor == reader.end) break;
+                    valid = reader.readFloat(placement[numbers]);
+                }
+                if (!valid || numbers == 1 || numbers == 2) {
+                    std::cerr << "Error: " << filename << ":" << lineNumber
+                              << ": expected 'm <obj file> [x y z [scale]]', line skipped." << std::endl;
+                    break;
+                }
+                std::filesystem::path meshPath(path);
+                if (meshPath.is_relative()) meshPath = std::filesystem::path(filename).parent_path() / meshPath;
+                auto geometry = std::make_shared<MeshGeometry>();
+                if (!loadObj(meshPath.string(), Vector(placement[0], placement[1], placement[2]), placement[3], *geometry)) {
+                    std::cerr << "Error: " << filename << ":" << lineNumber << ": mesh skipped." << std::endl;
+                    break;
+                }
+                meshFiles[meshPath.string()] = geometry->sourceHash;
+                objects.push_back(meshes.create(std::move(geometry), Vector(0, 0, 0), 0, false, false));
+                break;
+            }
+            case 'n': {
+                // Instance: n <file> [x y z [scale [ax ay az degrees]]], a copy of the objects of
+                // a scene or OBJ file, rotated around the axis, scaled and moved
+                std::string path;
+                float placement[8] = {0, 0, 0, 1, 0, 0, 1, 0};
+                bool valid = reader.readWord(path);
+                int numbers = 0;
+                for (; numbers < 8 && valid; numbers++) {
+                    reader.skipSpaces();
+                    if (reader.cursor == reader.end) break;
+                    valid = reader.readFloat(placement[numbers]);
+                }
+                if (!valid || (numbers != 0 && numbers != 3 && numbers != 4 && numbers != 8) || placement[3] <= 0) {
+                    std::cerr << "Error: " << filename << ":" << lineNumber
+                              << ": expected 'n <file> [x y z [scale [ax ay az degrees]]]', line skipped." << std::endl;
+                    break;
+                }
+                if (instanceBlock) {
+                    std::cerr << "Error: " << filename << ":" << lineNumber
+                              << ": instances cannot be nested, line skipped." << std::endl;
+                    break;
+                }
+                std::filesystem::path instancePath(path);
+                if (instancePath.is_relative()) instancePath = std::filesystem::path(filename).parent_path() / instancePath;
+                std::shared_ptr<const InstanceGeometry>& geometry = instanceGeometry[instancePath.string()];
+                if (!geometry) {
+                    auto loaded = std::make_shared<InstanceGeometry>();
+                    if (!loadInstanceGeometry(instancePath.string(), *loaded)) {
+                        instanceGeometry.erase(instancePath.string());
+                        std::cerr << "Error: " << filename << ":" << lineNumber << ": instance skipped." << std::endl;
+                        break;
+                    }
+                    geometry = std::move(loaded);
+                }
+                objects.push_back(instances.create(geometry, Vector(placement[0], placement[1], placement[2]), placement[3],
+                                                   Vector(placement[4], placement[5], placement[6]), placement[7]));
                 break;
             }
             default: {
-                std::cerr << "Unknown line type: " << type << " in scene file." << std::endl;
+                std::cerr << "Unknown line type: " << type << " in scene file, line " << lineNumber << "." << std::endl;
                 break;
             }
         }
     }
 
-    file.close();
+    //a scene without an 'a' line gets a black ambient light, shading adds it to every hit
+    if (!ambientLight) ambientLight = ambientLights.create(Vector(0, 0, 0));
+    bvh.build(objects);
+    primitives.build(objects, bvh);
+    prepareLights();
+    return true;
+}
 
+void Scene::prepareLights() {
+    shadingLights.clear();
+    shadingLights.reserve(lights.size());
+    for (const Light* light : lights) {
+        shadingLights.push_back(shadingLight(*light));
+    }
+    lightTree.build(shadingLights);
+}
+
+std::map<std::string, uint64_t> Scene::sourceFiles() const {
+    std::map<std::string, uint64_t> files = meshFiles;
+    for (const auto& entry : instanceGeometry) {
+        files[entry.first] = entry.second->sourceHash;
+        //the meshes a block file of instances loads in turn
+        std::map<std::string, uint64_t> inner = entry.second->scene->sourceFiles();
+        files.insert(inner.begin(), inner.end());
+    }
+    return files;
 }
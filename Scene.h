@@ -1,27 +1,75 @@
 #ifndef SCENE_H
 #define SCENE_H
 
+#include <cstdint>
 #include <vector>
 #include <string>
+#include <map>
+#include <memory>
 #include "Vector.h"
+#include "BVH.h"
+#include "PrimitiveStore.h"
+#include "Pool.h"
+#include "Light.h"
+#include "LightTree.h"
 
 class Object;
-class Light;
-class AmbientLight;
+class Sphere;
+class Plane;
+class Cylinder;
+class TriangleMesh;
+class Instance;
+class InstanceGeometry;
+class MappedFile;
 
 class Scene {
 public:
     Scene();
     ~Scene();
 
-    void loadFromFile(const std::string& filename);
+    // false when the file cannot be read
+    bool loadFromFile(const std::string& filename);
+    // the same from scene text already in memory, [begin, end). filename is for the messages
+    bool loadFromText(const char* begin, const char* end, const std::string& filename);
+    // fills shadingLights and lightTree from lights, done by every loader once the lights are final
+    void prepareLights();
+    // every file the scene read besides its own text, by resolved path, with the hash of the
+    // bytes read. a cache of parsed scenes is only good while all of them are unchanged
+    std::map<std::string, uint64_t> sourceFiles() const;
 
     Vector cameraPosition;
     bool aliasing;
     AmbientLight* ambientLight = nullptr;
+    // objects and lights in file order. they point into the pools below, which own them
     std::vector<Object*> objects;
     std::vector<Light*> lights;
-
+    Pool<Sphere> spheres;
+    Pool<Plane> planes;
+    Pool<Cylinder> cylinders;
+    Pool<TriangleMesh> meshes;
+    Pool<Instance> instances;
+    Pool<AmbientLight> ambientLights;
+    Pool<DirectionalLight> directionalLights;
+    Pool<Spotlight> spotlights;
+    // lights in the same order, in the flat form shading reads
+    std::vector<ShadingLight> shadingLights;
+    // the spotlights of shadingLights bounded for culling, empty when there are few of them
+    LightTree lightTree;
+    // --light-budget of the render in progress: lights sampled per shaded point, 0 for all of them
+    int lightBudget = 0;
+    // acceleration structure over objects and the SoA copy of their geometry and
+    // materials it indexes, both rebuilt at the end of loadFromFile
+    BVH bvh;
+    PrimitiveStore primitives;
+    // set when the scene was loaded from a compiled cache (see SceneCache.h): bvh and
+    // primitives point into this mapping and objects stays empty
+    std::unique_ptr<MappedFile> cacheFile;
+    // the OBJ files of the 'm' lines by resolved path, with the hash of the bytes read from each
+    std::map<std::string, uint64_t> meshFiles;
+    // geometry of the 'n' lines by file path, loaded once and shared by all their instances
+    std::map<std::string, std::shared_ptr<const InstanceGeometry>> instanceGeometry;
+    // set on scenes loaded as instance geometry, which may not hold instances themselves
+    bool instanceBlock = false;
 
 private:
     int objCounter;
@@ -0,0 +1,370 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "SceneCache.h"
+#include "Scene.h"
+#include "Light.h"
+#include "MappedFile.h"
+
+namespace {
+
+const char kMagic[8] = {'R', 'T', 'S', 'C', 'E', 'N', 'E', 0};
+// bump when anything written below changes shape
+const uint32_t kVersion = 1;
+const uint32_t kByteOrder = 0x01020304;
+// every array starts on a cache line
+const uint64_t kAlignment = 64;
+
+enum Section {
+    SECTION_NODES,
+    SECTION_PRIM_INDICES,
+    SECTION_UNBOUNDED,
+    SECTION_SPHERE_CENTER_X,
+    SECTION_SPHERE_CENTER_Y,
+    SECTION_SPHERE_CENTER_Z,
+    SECTION_SPHERE_RADIUS,
+    SECTION_SPHERE_IDS,
+    SECTION_CYLINDER_CENTER_X,
+    SECTION_CYLINDER_CENTER_Y,
+    SECTION_CYLINDER_CENTER_Z,
+    SECTION_CYLINDER_AXIS_X,
+    SECTION_CYLINDER_AXIS_Y,
+    SECTION_CYLINDER_AXIS_Z,
+    SECTION_CYLINDER_RADIUS,
+    SECTION_CYLINDER_HALF_HEIGHT,
+    SECTION_CYLINDER_IDS,
+    SECTION_PLANE_NORMAL_X,
+    SECTION_PLANE_NORMAL_Y,
+    SECTION_PLANE_NORMAL_Z,
+    SECTION_PLANE_D,
+    SECTION_PLANE_IDS,
+    SECTION_TYPES,
+    SECTION_SLOTS,
+    SECTION_MATERIALS,
+    SECTION_PRIMITIVE_TYPES,
+    SECTION_PRIMITIVE_SLOTS,
+    SECTION_LIGHTS,
+    SECTION_COUNT
+};
+
+struct SectionEntry {
+    uint64_t offset;
+    uint64_t count;
+    uint64_t elementSize;   // guards against a different struct layout
+};
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+    float camera[3];
+    uint32_t aliasing;
+    float ambient[3];
+    uint32_t hasAmbient;
+    int32_t objectCount;
+    int32_t sphereCount;
+    int32_t cylinderCount;
+    int32_t planeCount;
+    SectionEntry sections[SECTION_COUNT];
+};
+
+struct LightRecord {
+    uint32_t type;          // LightType
+    float direction[3];
+    float position[3];
+    float cutoff;
+    float intensity[3];
+};
+
+//an array to write: where it is in memory and what it is
+struct Block {
+    const void* data;
+    uint64_t count;
+    uint64_t elementSize;
+};
+
+uint64_t alignUp(uint64_t value) {
+    return (value + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+}
+
+//64 bit FNV-1a over 8 byte words, then the tail bytes
+uint64_t hashBytes(const char* data, std::size_t size) {
+    const uint64_t prime = 1099511628211ull;
+    uint64_t hash = 14695981039346656037ull;
+    std::size_t k = 0;
+    for (; k + 8 <= size; k += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + k, 8);
+        hash = (hash ^ word) * prime;
+    }
+    for (; k < size; k++) hash = (hash ^ (unsigned char)data[k]) * prime;
+    return hash;
+}
+
+namespace {
+
+bool hashFile(const std::string& path, uint64_t& hash, uint64_t& size) {
+    MappedFile file;
+    if (!file.open(path)) return false;
+    hash = hashBytes(file.data(), file.size());
+    size = file.size();
+    return true;
+}
+
+template <class T>
+Block block(const T* data, std::size_t count) {
+    return Block{data, count, sizeof(T)};
+}
+
+void storeVector(float* out, const Vector& v) {
+    out[0] = v.x;
+    out[1] = v.y;
+    out[2] = v.z;
+}
+
+Vector loadVector(const float* in) {
+    return Vector(in[0], in[1], in[2]);
+}
+
+}
+
+std::string sceneCachePath(const std::string& scenePath) {
+    return std::filesystem::path(scenePath).replace_extension(".rtc").string();
+}
+
+bool writeSceneCache(const Scene& scene, const std::string& scenePath, const std::string& cachePath) {
+    //the hash only covers the scene file, a changed OBJ or instance file would not be noticed
+    if (scene.primitives.meshCount > 0 || scene.primitives.instanceCount > 0) {
+        std::cerr << "Scenes with meshes or instances cannot be compiled: " << scenePath << std::endl;
+        return false;
+    }
+    CacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.byteOrder = kByteOrder;
+    if (!hashFile(scenePath, header.sourceHash, header.sourceSize)) {
+        std::cerr << "Failed to read scene file: " << scenePath << std::endl;
+        return false;
+    }
+    storeVector(header.camera, scene.cameraPosition);
+    header.aliasing = scene.aliasing;
+    if (scene.ambientLight) {
+        storeVector(header.ambient, scene.ambientLight->getIntensity());
+        header.hasAmbient = 1;
+    }
+    const PrimitiveStore& store = scene.primitives;
+    header.objectCount = (int32_t)store.materials.size();
+    header.sphereCount = store.sphereCount;
+    header.cylinderCount = store.cylinderCount;
+    header.planeCount = store.planes.count;
+
+    std::vector<LightRecord> lights;
+    for (const Light* light : scene.lights) {
+        LightRecord record;
+        std::memset(&record, 0, sizeof(record));
+        storeVector(record.direction, light->getDirection());
+        storeVector(record.intensity, light->getIntensity());
+        record.type = light->type();
+        if (light->type() == LIGHT_SPOT) {
+            const Spotlight* spotlight = static_cast<const Spotlight*>(light);
+            storeVector(record.position, spotlight->position);
+            record.cutoff = spotlight->cutoffAngle;
+        }
+        lights.push_back(record);
+    }
+
+    //materials hold padding bytes, copy them into zeroed records so the file does not depend on stack garbage
+    std::vector<Material> materials(store.materials.size());
+    std::memset(static_cast<void*>(materials.data()), 0, materials.size() * sizeof(Material));
+    for (std::size_t k = 0; k < materials.size(); k++) {
+        materials[k].color = store.materials[k].color;
+        materials[k].shininess = store.materials[k].shininess;
+        materials[k].reflective = store.materials[k].reflective;
+        materials[k].transparent = store.materials[k].transparent;
+    }
+
+    std::size_t spheres = store.sphereCount + PrimitiveStore::kPadding;
+    std::size_t cylinders = store.cylinderCount + PrimitiveStore::kPadding;
+    std::size_t planes = store.planes.count + PrimitiveStore::kPadding;
+    Block blocks[SECTION_COUNT] = {
+        block(scene.bvh.nodes.data(), scene.bvh.nodes.size()),
+        block(scene.bvh.primIndices.data(), scene.bvh.primIndices.size()),
+        block(scene.bvh.unbounded.data(), scene.bvh.unbounded.size()),
+        block(store.sphereSoA.centerX, spheres),
+        block(store.sphereSoA.centerY, spheres),
+        block(store.sphereSoA.centerZ, spheres),
+        block(store.sphereSoA.radius, spheres),
+        block(store.sphereSoA.ids, spheres),
+        block(store.cylinderSoA.centerX, cylinders),
+        block(store.cylinderSoA.centerY, cylinders),
+        block(store.cylinderSoA.centerZ, cylinders),
+        block(store.cylinderSoA.axisX, cylinders),
+        block(store.cylinderSoA.axisY, cylinders),
+        block(store.cylinderSoA.axisZ, cylinders),
+        block(store.cylinderSoA.radius, cylinders),
+        block(store.cylinderSoA.halfHeight, cylinders),
+        block(store.cylinderSoA.ids, cylinders),
+        block(store.planes.normalX, planes),
+        block(store.planes.normalY, planes),
+        block(store.planes.normalZ, planes),
+        block(store.planes.d, planes),
+        block(store.planes.ids, planes),
+        block(store.types.data(), store.types.size()),
+        block(store.slots.data(), store.slots.size()),
+        block(materials.data(), materials.size()),
+        block(store.primitiveTypes.data(), store.primitiveTypes.size()),
+        block(store.primitiveSlots.data(), store.primitiveSlots.size()),
+        block(lights.data(), lights.size()),
+    };
+    uint64_t offset = alignUp(sizeof(CacheHeader));
+    for (int k = 0; k < SECTION_COUNT; k++) {
+        header.sections[k] = SectionEntry{offset, blocks[k].count, blocks[k].elementSize};
+        offset = alignUp(offset + blocks[k].count * blocks[k].elementSize);
+    }
+
+    //write next to the cache and rename, so a render never maps a half written file
+    std::string temporaryPath = cachePath + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "Failed to write scene cache: " << cachePath << std::endl;
+            return false;
+        }
+        static const char zeros[kAlignment] = {};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        uint64_t position = sizeof(header);
+        for (int k = 0; k < SECTION_COUNT; k++) {
+            file.write(zeros, header.sections[k].offset - position);
+            uint64_t bytes = blocks[k].count * blocks[k].elementSize;
+            if (bytes > 0) file.write(static_cast<const char*>(blocks[k].data), bytes);
+            position = header.sections[k].offset + bytes;
+        }
+        file.write(zeros, offset - position);
+        if (!file) {
+            std::cerr << "Failed to write scene cache: " << cachePath << std::endl;
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+    }
+    if (std::rename(temporaryPath.c_str(), cachePath.c_str()) != 0) {
+        std::cerr << "Failed to write scene cache: " << cachePath << std::endl;
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool readSceneCache(Scene& scene, const std::string& scenePath, const std::string& cachePath) {
+    if (!std::filesystem::exists(cachePath)) return false;
+    std::unique_ptr<MappedFile> file(new MappedFile());
+    const CacheHeader* header = nullptr;
+    if (file->open(cachePath) && file->size() >= sizeof(CacheHeader)) {
+        header = reinterpret_cast<const CacheHeader*>(file->data());
+    }
+    if (!header || std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || header->byteOrder != kByteOrder) {
+        std::cerr << "Ignoring " << cachePath << ": not a scene cache" << std::endl;
+        return false;
+    }
+    if (header->version != kVersion) {
+        std::cerr << "Ignoring " << cachePath << ": written by another version, run --compile again" << std::endl;
+        return false;
+    }
+    uint64_t sourceHash, sourceSize;
+    if (!hashFile(scenePath, sourceHash, sourceSize) || sourceHash != header->sourceHash ||
+        sourceSize != header->sourceSize) {
+        std::cerr << "Ignoring " << cachePath << ": " << scenePath << " changed since it was compiled" << std::endl;
+        return false;
+    }
+
+    //every array must lie inside the file and have the element size this build uses
+    static const uint64_t elementSizes[SECTION_COUNT] = {
+        sizeof(BVHNode), sizeof(int), sizeof(int),
+        sizeof(float), sizeof(float), sizeof(float), sizeof(float), sizeof(int),
+        sizeof(float), sizeof(float), sizeof(float), sizeof(float), sizeof(float), sizeof(float),
+        sizeof(float), sizeof(float), sizeof(int),
+        sizeof(float), sizeof(float), sizeof(float), sizeof(float), sizeof(int),
+        sizeof(int), sizeof(int), sizeof(Material), sizeof(int), sizeof(int), sizeof(LightRecord)};
+    const char* base = file->data();
+    bool valid = header->sphereCount >= 0 && header->cylinderCount >= 0 && header->planeCount >= 0 &&
+                 header->objectCount >= 0;
+    for (int k = 0; k < SECTION_COUNT && valid; k++) {
+        const SectionEntry& section = header->sections[k];
+        valid = section.elementSize == elementSizes[k] && section.offset % kAlignment == 0 &&
+                section.offset <= file->size() &&
+                section.count <= (file->size() - section.offset) / section.elementSize;
+    }
+    auto count = [&](Section section) { return header->sections[section].count; };
+    valid = valid && count(SECTION_SPHERE_IDS) == (uint64_t)header->sphereCount + PrimitiveStore::kPadding &&
+            count(SECTION_CYLINDER_IDS) == (uint64_t)header->cylinderCount + PrimitiveStore::kPadding &&
+            count(SECTION_PLANE_IDS) == (uint64_t)header->planeCount + PrimitiveStore::kPadding &&
+            count(SECTION_TYPES) == count(SECTION_PRIM_INDICES) && count(SECTION_SLOTS) == count(SECTION_PRIM_INDICES) &&
+            count(SECTION_MATERIALS) == (uint64_t)header->objectCount &&
+            count(SECTION_PRIMITIVE_TYPES) == (uint64_t)header->objectCount &&
+            count(SECTION_PRIMITIVE_SLOTS) == (uint64_t)header->objectCount;
+    for (int k = SECTION_SPHERE_CENTER_X; k <= SECTION_PLANE_IDS && valid; k++) {
+        int last = k <= SECTION_SPHERE_IDS ? SECTION_SPHERE_IDS : (k <= SECTION_CYLINDER_IDS ? SECTION_CYLINDER_IDS : SECTION_PLANE_IDS);
+        valid = header->sections[k].count == header->sections[last].count;
+    }
+    if (!valid) {
+        std::cerr << "Ignoring " << cachePath << ": the file is damaged" << std::endl;
+        return false;
+    }
+    auto floats = [&](Section section) { return reinterpret_cast<const float*>(base + header->sections[section].offset); };
+    auto ints = [&](Section section) { return reinterpret_cast<const int*>(base + header->sections[section].offset); };
+
+    scene.cameraPosition = loadVector(header->camera);
+    scene.aliasing = header->aliasing != 0;
+    scene.ambientLight = scene.ambientLights.create(header->hasAmbient ? loadVector(header->ambient) : Vector(0, 0, 0));
+    const LightRecord* lights = reinterpret_cast<const LightRecord*>(base + header->sections[SECTION_LIGHTS].offset);
+    for (uint64_t k = 0; k < count(SECTION_LIGHTS); k++) {
+        const LightRecord& record = lights[k];
+        if (record.type == LIGHT_SPOT) {
+            scene.lights.push_back(scene.spotlights.create(loadVector(record.position), loadVector(record.direction),
+                                                 record.cutoff, loadVector(record.intensity)));
+        } else {
+            scene.lights.push_back(scene.directionalLights.create(loadVector(record.direction), loadVector(record.intensity)));
+        }
+    }
+
+    scene.prepareLights();
+
+    BVH& bvh = scene.bvh;
+    bvh.nodes = ArrayView<BVHNode>(reinterpret_cast<const BVHNode*>(base + header->sections[SECTION_NODES].offset),
+                                   count(SECTION_NODES));
+    bvh.primIndices = ArrayView<int>(ints(SECTION_PRIM_INDICES), count(SECTION_PRIM_INDICES));
+    bvh.unbounded = ArrayView<int>(ints(SECTION_UNBOUNDED), count(SECTION_UNBOUNDED));
+
+    PrimitiveStore& store = scene.primitives;
+    store.sphereSoA = SphereSoA{floats(SECTION_SPHERE_CENTER_X), floats(SECTION_SPHERE_CENTER_Y),
+                                floats(SECTION_SPHERE_CENTER_Z), floats(SECTION_SPHERE_RADIUS), ints(SECTION_SPHERE_IDS)};
+    store.cylinderSoA = CylinderSoA{floats(SECTION_CYLINDER_CENTER_X), floats(SECTION_CYLINDER_CENTER_Y),
+                                    floats(SECTION_CYLINDER_CENTER_Z), floats(SECTION_CYLINDER_AXIS_X),
+                                    floats(SECTION_CYLINDER_AXIS_Y), floats(SECTION_CYLINDER_AXIS_Z),
+                                    floats(SECTION_CYLINDER_RADIUS), floats(SECTION_CYLINDER_HALF_HEIGHT),
+                                    ints(SECTION_CYLINDER_IDS)};
+    store.planes = PlaneSoA{floats(SECTION_PLANE_NORMAL_X), floats(SECTION_PLANE_NORMAL_Y),
+                            floats(SECTION_PLANE_NORMAL_Z), floats(SECTION_PLANE_D), ints(SECTION_PLANE_IDS),
+                            header->planeCount};
+    store.sphereCount = header->sphereCount;
+    store.cylinderCount = header->cylinderCount;
+    store.types = ArrayView<int>(ints(SECTION_TYPES), count(SECTION_TYPES));
+    store.slots = ArrayView<int>(ints(SECTION_SLOTS), count(SECTION_SLOTS));
+    store.materials = ArrayView<Material>(reinterpret_cast<const Material*>(base + header->sections[SECTION_MATERIALS].offset),
+                                          count(SECTION_MATERIALS));
+    store.primitiveTypes = ArrayView<int>(ints(SECTION_PRIMITIVE_TYPES), count(SECTION_PRIMITIVE_TYPES));
+    store.primitiveSlots = ArrayView<int>(ints(SECTION_PRIMITIVE_SLOTS), count(SECTION_PRIMITIVE_SLOTS));
+
+    //the scene keeps the mapping for as long as its arrays point into it
+    scene.cacheFile = std::move(file);
+    return true;
+}
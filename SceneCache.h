@@ -0,0 +1,29 @@
+// SceneCache.h
+#ifndef SCENECACHE_H
+#define SCENECACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class Scene;
+
+// compiled scene cache: the camera, lights, materials, geometry arrays and BVH of a
+// loaded scene in one binary file. loading maps the file and points the scene's
+// arrays into it, so no object is parsed, allocated or rebuilt. the cache records a
+// hash of the text scene it came from and is ignored once that file changes
+
+// 64 bit FNV-1a hash of a scene's text, what the cache checks its source against
+uint64_t hashBytes(const char* data, std::size_t size);
+
+// the cache file that belongs to a scene file: the same path with the extension .rtc
+std::string sceneCachePath(const std::string& scenePath);
+
+// writes scene, loaded from scenePath, to cachePath. false (and a message) on failure
+bool writeSceneCache(const Scene& scene, const std::string& scenePath, const std::string& cachePath);
+
+// loads cachePath into an empty scene if it is a valid cache of scenePath as that file
+// is now. false when there is no cache or it is stale or damaged; the scene is untouched
+bool readSceneCache(Scene& scene, const std::string& scenePath, const std::string& cachePath);
+
+#endif // SCENECACHE_H
@@ -0,0 +1,87 @@
+#include "Sequence.h"
+#include "Render.h"
+#include "Scene.h"
+#include "ThreadPool.h"
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <sstream>
+
+//path of frame f: the image path with _f before the extension
+static std::string framePath(const std::string& imagePath, int frame) {
+    std::filesystem::path path(imagePath);
+    char number[16];
+    std::snprintf(number, sizeof(number), "_%04d", frame);
+    path.replace_filename(path.stem().string() + number + path.extension().string());
+    return path.string();
+}
+
+bool readSequence(const std::string& path, std::vector<Vector>& cameras) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Failed to open sequence file: " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    for (int lineNumber = 1; std::getline(file, line); lineNumber++) {
+        std::istringstream words(line);
+        std::string first;
+        if (!(words >> first) || first[0] == '#') continue;
+        std::istringstream numbers(line);
+        Vector camera;
+        if (!(numbers >> camera.x >> camera.y >> camera.z)) {
+            std::cerr << "Error: " << path << ":" << lineNumber << ": expected a camera position x y z" << std::endl;
+            return false;
+        }
+        cameras.push_back(camera);
+    }
+    if (cameras.empty()) {
+        std::cerr << "Sequence file " << path << " has no frames" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool renderSequence(const RenderOptions& options) {
+    std::vector<Vector> cameras;
+    if (!readSequence(options.sequencePath, cameras)) return false;
+    auto start = std::chrono::steady_clock::now();
+    Scene scene;
+    if (!loadScene(options, scene)) return false;
+    ThreadPool pool(options.threads > 0 ? options.threads : ThreadPool::defaultThreadCount());
+
+    //at most one frame is being written while the next one renders
+    std::future<bool> writing;
+    int writingFrame = -1;
+    std::vector<int> failed;
+    auto waitForWrite = [&]() {
+        if (writing.valid() && !writing.get()) failed.push_back(writingFrame);
+    };
+    for (int frame = 0; frame < (int)cameras.size(); frame++) {
+        scene.cameraPosition = cameras[frame];
+        std::vector<Vector> image;
+        RenderSummary summary = renderScene(options, scene, nullptr, &pool, &image);
+        std::string path = framePath(summary.imagePath, frame);
+        waitForWrite();
+        int width = options.imageWidth, height = options.imageHeight;
+        writing = std::async(std::launch::async, [width, height, path, image = std::move(image)]() {
+            return saveImage(width, height, image, path, 1);
+        });
+        writingFrame = frame;
+    }
+    waitForWrite();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Rendered " << cameras.size() << " frames in " << seconds << "s: " << cameras.size() / seconds
+              << " frames/second" << std::endl;
+    if (!failed.empty()) {
+        std::cerr << failed.size() << " of " << cameras.size() << " frames could not be saved:";
+        for (int frame : failed) std::cerr << " " << frame;
+        std::cerr << std::endl;
+        return false;
+    }
+    return true;
+}
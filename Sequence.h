@@ -0,0 +1,24 @@
+// Sequence.h
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#include <string>
+#include <vector>
+#include "Vector.h"
+#include "Options.h"
+
+// camera fly-through (--sequence): the scene is loaded once and rendered from every
+// camera position of the sequence file, one frame per line as "x y z" (blank lines and
+// lines starting with # are skipped). frame f is saved next to where the single image
+// would go, with _f (four digits) before the extension. the geometry, BVH and lights
+// are shared by all frames, and frame f is encoded and written on its own thread while
+// frame f + 1 renders
+
+// reads the camera positions of a sequence file, false (and a message) on bad input
+bool readSequence(const std::string& path, std::vector<Vector>& cameras);
+
+// renders the sequence of options.sequencePath and prints the frames per second. false on
+// failure, also when a frame could not be saved (the others are still written)
+bool renderSequence(const RenderOptions& options);
+
+#endif // SEQUENCE_H
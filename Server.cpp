@@ -0,0 +1,253 @@
+#include "Server.h"
+#include "Render.h"
+#include "Scene.h"
+#include "SceneCache.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+//parsed scenes kept at once, the least recently used one goes first
+static const std::size_t kMaxScenes = 8;
+
+//the next line of in without its line break, false at the end of the stream
+static bool readLine(FILE* in, std::string& line) {
+    line.clear();
+    int c;
+    while ((c = std::getc(in)) != EOF && c != '\n') line += (char)c;
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    return c != EOF || !line.empty();
+}
+
+//the words of a job line, see quoteJobWord. false when a quote is not closed, words then ends
+//with what it holds
+static bool splitWords(const std::string& line, std::vector<std::string>& words) {
+    std::size_t i = 0;
+    while (true) {
+        while (i < line.size() && std::isspace((unsigned char)line[i])) i++;
+        if (i == line.size()) return true;
+        std::string word;
+        bool quoted = false;
+        for (; i < line.size() && (quoted || !std::isspace((unsigned char)line[i])); i++) {
+            if (line[i] == '"') quoted = !quoted;
+            else if (quoted && line[i] == '\\' && i + 1 < line.size()) word += line[++i];
+            else word += line[i];
+        }
+        words.push_back(word);
+        if (quoted) return false;
+    }
+}
+
+std::string quoteJobWord(const std::string& word) {
+    if (!word.empty() && word.find_first_of(" \t\"\\") == std::string::npos) return word;
+    std::string quoted = "\"";
+    for (char c : word) {
+        if (c == '"' || c == '\\') quoted += '\\';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+RenderServer :: RenderServer(const RenderOptions& defaults)
+    : defaults(defaults), pool(defaults.threads > 0 ? defaults.threads : ThreadPool::defaultThreadCount()), jobs(0) {}
+
+RenderServer :: ~RenderServer() {}
+
+bool RenderServer :: run() {
+    //the replies may share stdout with the jobs' protocol, so what the renderer logs goes to stderr
+    std::streambuf* console = std::cout.rdbuf(std::cerr.rdbuf());
+    bool served = true;
+    if (!defaults.socketPath.empty()) served = serveSocket();
+    else serveStream(stdin, stdout);
+    std::cout.rdbuf(console);
+    return served;
+}
+
+bool RenderServer :: serveSocket() {
+    const std::string& path = defaults.socketPath;
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path is too long: " << path << std::endl;
+        return false;
+    }
+    std::strcpy(address.sun_path, path.c_str());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        std::cerr << "Failed to create a socket: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    //a socket file left by a server that did not stop cleanly
+    unlink(path.c_str());
+    if (bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 16) != 0) {
+        std::cerr << "Failed to listen on " << path << ": " << std::strerror(errno) << std::endl;
+        close(listener);
+        return false;
+    }
+    //a client that hangs up before its reply must not stop the server
+    std::signal(SIGPIPE, SIG_IGN);
+    std::cout << "Serving on " << path << std::endl;
+
+    bool serving = true;
+    while (serving) {
+        int connection = accept(listener, nullptr, nullptr);
+        if (connection < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Failed to accept a connection: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        int copy = dup(connection);
+        FILE* in = fdopen(connection, "r");
+        FILE* out = copy >= 0 ? fdopen(copy, "w") : nullptr;
+        if (in && out) serving = serveStream(in, out);
+        if (in) std::fclose(in);
+        else close(connection);
+        if (out) std::fclose(out);
+        else if (copy >= 0) close(copy);
+    }
+    close(listener);
+    unlink(path.c_str());
+    return true;
+}
+
+bool RenderServer :: serveStream(FILE* in, FILE* out) {
+    std::string line;
+    while (readLine(in, line)) {
+        std::istringstream words(line);
+        std::string first;
+        if (!(words >> first)) continue;
+        if (first == "quit") {
+            std::fputs("bye\n", out);
+            std::fflush(out);
+            return false;
+        }
+        std::string reply = runJob(line, in) + "\n";
+        std::fputs(reply.c_str(), out);
+        std::fflush(out);
+    }
+    return true;
+}
+
+std::string RenderServer :: runJob(const std::string& line, FILE* in) {
+    std::vector<std::string> words;
+    bool closed = splitWords(line, words);
+
+    std::vector<char*> argv;
+    std::string program = "job";
+    argv.push_back(&program[0]);
+    for (std::string& word : words) argv.push_back(&word[0]);
+    RenderOptions options = defaults;
+    options.scenePath.clear();
+    options.outputPath.clear();
+    options.serve = false;
+    options.socketPath.clear();
+    options.sequencePath.clear();
+    bool parsed = closed && parseOptions((int)argv.size(), argv.data(), options);
+
+    //the inline scene is read even for a bad job, so it does not leave its text behind as jobs. a job
+    //that does not parse has it when any word is "-", also split at every space for an unclosed quote
+    bool inlineScene = parsed && options.scenePath == "-";
+    if (!parsed) {
+        std::istringstream plain(line);
+        for (std::string word; plain >> word;) inlineScene = inlineScene || word == "-";
+        inlineScene = inlineScene || std::find(words.begin(), words.end(), "-") != words.end();
+    }
+    std::string text;
+    if (inlineScene) {
+        std::string textLine;
+        while (readLine(in, textLine) && textLine != ".") text += textLine + "\n";
+    }
+    if (!closed) return "error unclosed quote in job: " + line;
+    if (!parsed) return "error invalid job: " + line;
+    if (options.serve || options.watch || options.compile || !options.sequencePath.empty()) {
+        return "error not a render job: " + line;
+    }
+    //the pool and the kernels are the server's, set when it starts
+    if (options.threads != defaults.threads || options.kernels != defaults.kernels ||
+        options.occluderCache != defaults.occluderCache || options.workers != defaults.workers ||
+        options.progressive != defaults.progressive) {
+        return "error --threads, --kernels, --no-occluder-cache, --workers and --progressive are server options: " +
+               line;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    MappedFile file;
+    const char* begin = text.data();
+    const char* end = begin + text.size();
+    std::string path;
+    if (options.scenePath == "-") {
+        options.scenePath = "inline";
+    } else {
+        if (!file.open(options.scenePath)) return "error cannot read scene file " + options.scenePath;
+        begin = file.data();
+        end = begin + file.size();
+        path = options.scenePath;
+    }
+    bool cached;
+    Scene* scene = findScene(begin, end, path, options.useCache, cached);
+    if (!scene) return "error cannot load scene " + options.scenePath;
+    RenderSummary summary = renderScene(options, *scene, nullptr, &pool);
+    if (!summary.ok) return "error cannot write " + summary.imagePath;
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::ostringstream reply;
+    reply << "ok " << summary.imagePath << " " << milliseconds << " ms " << (cached ? "cached" : "loaded");
+    return reply.str();
+}
+
+//true when every file scene read besides its text still holds the bytes it read then
+static bool sourcesUnchanged(const Scene& scene) {
+    for (const auto& source : scene.sourceFiles()) {
+        MappedFile file;
+        if (!file.open(source.first) || hashBytes(file.data(), file.size()) != source.second) return false;
+    }
+    return true;
+}
+
+Scene* RenderServer :: findScene(const char* begin, const char* end, const std::string& path, bool useCache,
+                                 bool& cached) {
+    std::size_t size = end - begin;
+    uint64_t hash = hashBytes(begin, size);
+    //the loader resolves relative paths against the scene file's directory, inline scenes against ours
+    std::string directory = std::filesystem::path(path).parent_path().string();
+    jobs++;
+    for (auto entry = scenes.begin(); entry != scenes.end(); ++entry) {
+        if (entry->hash != hash || entry->size != size) continue;
+        if (!entry->scene->sourceFiles().empty()) {
+            if (entry->directory != directory) continue;
+            if (!sourcesUnchanged(*entry->scene)) {
+                scenes.erase(entry);
+                break;
+            }
+        }
+        entry->lastUsed = jobs;
+        cached = true;
+        return entry->scene.get();
+    }
+
+    cached = false;
+    std::unique_ptr<Scene> scene(new Scene());
+    if ((path.empty() || !useCache || !readSceneCache(*scene, path, sceneCachePath(path))) &&
+        !scene->loadFromText(begin, end, path.empty() ? "inline scene" : path)) {
+        return nullptr;
+    }
+    if (scenes.size() >= kMaxScenes) {
+        auto oldest = std::min_element(scenes.begin(), scenes.end(), [](const CachedScene& a, const CachedScene& b) {
+            return a.lastUsed < b.lastUsed;
+        });
+        scenes.erase(oldest);
+    }
+    scenes.push_back(CachedScene{hash, size, directory, std::move(scene), jobs});
+    return scenes.back().scene.get();
+}
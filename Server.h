@@ -0,0 +1,67 @@
+// Server.h
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Options.h"
+#include "ThreadPool.h"
+
+class Scene;
+
+// long running render server (--serve). jobs come one per line, from stdin or from
+// the connections to a Unix domain socket, served one after another:
+//   <scene path> [options]      render a scene file
+//   - [options]                 render the scene text on the following lines, up to a line "."
+//   quit                        stop the server
+// a word holding spaces goes in double quotes, with \" and \\ for a quote and a backslash
+// inside them (quoteJobWord). the options are the command line ones (--width, --height,
+// --output, --aa-min, ...), on top of the ones the server was started with, except those
+// that set up the server itself (--threads, --kernels, --no-occluder-cache, --workers,
+// --progressive). every job gets one reply line, on the stream the job came from, while the
+// renderer's own messages go to stderr:
+//   ok <image path> <milliseconds> ms <loaded|cached>
+//   error <message>
+// parsed scenes and their BVHs are kept by a hash of their text, so a scene that did
+// not change is not parsed again, and all jobs share one pool of render threads. a scene
+// that reads other files (meshes, instances) is only reused from the same directory, while every
+// one of those files is unchanged
+class RenderServer {
+public:
+    explicit RenderServer(const RenderOptions& defaults);
+    ~RenderServer();
+
+    // serves until a quit job (or the end of stdin). false when the socket cannot be opened
+    bool run();
+
+private:
+    struct CachedScene {
+        uint64_t hash;
+        std::size_t size;
+        std::string directory;  // relative file paths in the text resolve against it
+        std::unique_ptr<Scene> scene;
+        long long lastUsed;
+    };
+
+    bool serveSocket();
+    // answers the jobs of one stream until it ends (true) or a quit job (false)
+    bool serveStream(FILE* in, FILE* out);
+    std::string runJob(const std::string& line, FILE* in);
+    // the loaded scene of text, parsed only when no cached scene has the same text.
+    // path is the file the text was read from, empty for inline scenes. with useCache its .rtc is tried first.
+    // nullptr, with nothing cached, when the scene does not load
+    Scene* findScene(const char* begin, const char* end, const std::string& path, bool useCache, bool& cached);
+
+    RenderOptions defaults;
+    ThreadPool pool;
+    std::vector<CachedScene> scenes;
+    long long jobs;
+};
+
+// word as a job line writes it: quoted when it is empty or holds spaces, quotes or backslashes
+std::string quoteJobWord(const std::string& word);
+
+#endif // SERVER_H
@@ -0,0 +1,111 @@
+#include "ThreadPool.h"
+
+ThreadPool :: ThreadPool(int threadCount)
+    : job(nullptr), generation(0), busyWorkers(0), stopping(false) {
+    if (threadCount < 1) threadCount = 1;
+    for (int w = 0; w < threadCount; w++) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    //worker 0 is the thread that calls run
+    for (int w = 1; w < threadCount; w++) {
+        threads.emplace_back(&ThreadPool::workerLoop, this, w);
+    }
+}
+
+ThreadPool :: ~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(jobLock);
+        stopping = true;
+    }
+    jobReady.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+int ThreadPool :: size() const {
+    return (int)queues.size();
+}
+
+int ThreadPool :: defaultThreadCount() {
+    unsigned int count = std::thread::hardware_concurrency();
+    return count == 0 ? 1 : (int)count;
+}
+
+void ThreadPool :: run(int taskCount, const std::function<void(int, int)>& task) {
+    if (taskCount <= 0) return;
+    int workers = size();
+
+    //give every worker a contiguous run of tasks so neighbouring tiles stay on one core
+    for (int w = 0; w < workers; w++) {
+        int begin = (int)((long long)taskCount * w / workers);
+        int end = (int)((long long)taskCount * (w + 1) / workers);
+        std::lock_guard<std::mutex> guard(queues[w]->lock);
+        for (int t = begin; t < end; t++) {
+            queues[w]->tasks.push_back(t);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(jobLock);
+        job = &task;
+        busyWorkers = workers - 1;
+        generation++;
+    }
+    jobReady.notify_all();
+
+    work(0);
+
+    std::unique_lock<std::mutex> guard(jobLock);
+    jobDone.wait(guard, [this] { return busyWorkers == 0; });
+    job = nullptr;
+}
+
+void ThreadPool :: workerLoop(int worker) {
+    int seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(jobLock);
+            jobReady.wait(guard, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+        work(worker);
+        {
+            std::lock_guard<std::mutex> guard(jobLock);
+            if (--busyWorkers == 0) jobDone.notify_all();
+        }
+    }
+}
+
+void ThreadPool :: work(int worker) {
+    //all tasks are queued before the job starts, so empty queues everywhere means we are done
+    int task;
+    while (popLocal(worker, task) || steal(worker, task)) {
+        (*job)(worker, task);
+    }
+}
+
+bool ThreadPool :: popLocal(int worker, int& task) {
+    Queue& queue = *queues[worker];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.tasks.empty()) return false;
+    task = queue.tasks.front();
+    queue.tasks.pop_front();
+    return true;
+}
+
+bool ThreadPool :: steal(int worker, int& task) {
+    int workers = size();
+    for (int offset = 1; offset < workers; offset++) {
+        Queue& victim = *queues[(worker + offset) % workers];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            //take from the far end, away from where the owner is working
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,54 @@
+// ThreadPool.h
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// persistent pool of render workers. every worker owns a task queue, pops from
+// its front and steals from the back of the other queues once it runs dry, so
+// expensive tiles (deep reflection/refraction) do not leave threads idle.
+class ThreadPool {
+public:
+    explicit ThreadPool(int threadCount);
+    ~ThreadPool();
+
+    // number of workers, including the calling thread
+    int size() const;
+
+    // runs task(worker, index) for every index in [0, taskCount) and returns
+    // when all of them are done. the calling thread works as worker 0.
+    // tasks are handed out in index order, in contiguous chunks per worker.
+    void run(int taskCount, const std::function<void(int, int)>& task);
+
+    static int defaultThreadCount();
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<int> tasks;
+    };
+
+    void workerLoop(int worker);
+    void work(int worker);
+    bool popLocal(int worker, int& task);
+    bool steal(int worker, int& task);
+
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<Queue>> queues;
+
+    std::mutex jobLock;
+    std::condition_variable jobReady;
+    std::condition_variable jobDone;
+    const std::function<void(int, int)>* job;
+    int generation;
+    int busyWorkers;
+    bool stopping;
+};
+
+#endif // THREADPOOL_H
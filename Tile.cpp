@@ -0,0 +1,45 @@
+#include <algorithm>
+#include <cstdint>
+#include "Tile.h"
+
+//spread the low 16 bits of v so there is a zero bit between each of them
+static uint32_t spreadBits(uint32_t v) {
+    v &= 0x0000ffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+static uint32_t mortonCode(int x, int y) {
+    return spreadBits((uint32_t)x) | (spreadBits((uint32_t)y) << 1);
+}
+
+std::vector<Tile> makeTiles(int imageWidth, int imageHeight, int tileSize) {
+    if (tileSize < 1) tileSize = 1;
+    int tilesX = (imageWidth + tileSize - 1) / tileSize;
+    int tilesY = (imageHeight + tileSize - 1) / tileSize;
+
+    std::vector<std::pair<uint32_t, Tile>> ordered;
+    ordered.reserve(tilesX * tilesY);
+    for (int ty = 0; ty < tilesY; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            Tile tile;
+            tile.x0 = tx * tileSize;
+            tile.y0 = ty * tileSize;
+            tile.x1 = std::min(imageWidth, tile.x0 + tileSize);
+            tile.y1 = std::min(imageHeight, tile.y0 + tileSize);
+            ordered.push_back({mortonCode(tx, ty), tile});
+        }
+    }
+    std::sort(ordered.begin(), ordered.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    std::vector<Tile> tiles;
+    tiles.reserve(ordered.size());
+    for (const auto& entry : ordered) {
+        tiles.push_back(entry.second);
+    }
+    return tiles;
+}
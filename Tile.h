@@ -0,0 +1,17 @@
+// Tile.h
+#ifndef TILE_H
+#define TILE_H
+
+#include <vector>
+
+// a rectangle of pixels [x0, x1) x [y0, y1), in renderImage's (i, j) pixel coordinates
+struct Tile {
+    int x0, y0, x1, y1;
+};
+
+// splits the image into tileSize x tileSize tiles (smaller at the right/top
+// edges) and returns them in Morton (Z-curve) order, so tiles that are close
+// in the list are close on screen and share cached scene data
+std::vector<Tile> makeTiles(int imageWidth, int imageHeight, int tileSize);
+
+#endif // TILE_H
@@ -0,0 +1,327 @@
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "TriangleMesh.h"
+#include "MappedFile.h"
+#include "PrimitiveStore.h"
+#include "SceneCache.h"
+
+namespace {
+
+const int kStackSize = 65;
+
+//the ray sheared so that it runs along +z from the origin: the watertight test of Woop,
+//Benthin and Wald. its edge functions agree on shared edges, so no ray slips between
+//two triangles of a closed mesh
+struct ShearedRay {
+    int kx, ky, kz;
+    float sx, sy, sz;
+    float ox, oy, oz;
+    Vector origin;
+    Vector invDirection;
+};
+
+ShearedRay shear(const KernelRay& ray) {
+    float d[3] = {ray.dx, ray.dy, ray.dz};
+    ShearedRay s;
+    s.kz = std::abs(d[0]) > std::abs(d[1]) ? (std::abs(d[0]) > std::abs(d[2]) ? 0 : 2)
+                                           : (std::abs(d[1]) > std::abs(d[2]) ? 1 : 2);
+    s.kx = (s.kz + 1) % 3;
+    s.ky = (s.kx + 1) % 3;
+    //keep the winding when the main axis points backwards
+    if (d[s.kz] < 0) std::swap(s.kx, s.ky);
+    s.sx = d[s.kx] / d[s.kz];
+    s.sy = d[s.ky] / d[s.kz];
+    s.sz = 1.0f / d[s.kz];
+    s.ox = ray.ox;
+    s.oy = ray.oy;
+    s.oz = ray.oz;
+    s.origin = Vector(ray.ox, ray.oy, ray.oz);
+    s.invDirection = Vector(1.0f / ray.dx, 1.0f / ray.dy, 1.0f / ray.dz);
+    return s;
+}
+
+//distance to the triangle, or 0 when it is missed
+float triangleDistance(const ShearedRay& ray, const float* a, const float* b, const float* c) {
+    float o[3] = {ray.ox, ray.oy, ray.oz};
+    float ax = a[ray.kx] - o[ray.kx], ay = a[ray.ky] - o[ray.ky], az = a[ray.kz] - o[ray.kz];
+    float bx = b[ray.kx] - o[ray.kx], by = b[ray.ky] - o[ray.ky], bz = b[ray.kz] - o[ray.kz];
+    float cx = c[ray.kx] - o[ray.kx], cy = c[ray.ky] - o[ray.ky], cz = c[ray.kz] - o[ray.kz];
+    ax -= ray.sx * az; ay -= ray.sy * az;
+    bx -= ray.sx * bz; by -= ray.sy * bz;
+    cx -= ray.sx * cz; cy -= ray.sy * cz;
+
+    float u = cx * by - cy * bx;
+    float v = ax * cy - ay * cx;
+    float w = bx * ay - by * ax;
+    //on an edge the float products can round either way, decide it in double
+    if (u == 0.0f || v == 0.0f || w == 0.0f) {
+        u = (float)((double)cx * by - (double)cy * bx);
+        v = (float)((double)ax * cy - (double)ay * cx);
+        w = (float)((double)bx * ay - (double)by * ax);
+    }
+    if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0)) return 0;
+    float determinant = u + v + w;
+    if (determinant == 0.0f) return 0;
+    float t = (u * ray.sz * az + v * ray.sz * bz + w * ray.sz * cz) / determinant;
+    //same near limit as the other primitives
+    return t < 1e-6 ? 0 : t;
+}
+
+}
+
+void MeshGeometry :: buildBVH() {
+    int count = triangleCount();
+    std::vector<AABB> boxes(count);
+    bounds = AABB();
+    for (int k = 0; k < count; k++) {
+        for (int corner = 0; corner < 3; corner++) {
+            const float* p = &vertices[3 * (std::size_t)indices[3 * (std::size_t)k + corner]];
+            boxes[k].expand(Vector(p[0], p[1], p[2]));
+        }
+        //flat triangles still need a box of some thickness
+        boxes[k].min = boxes[k].min - Vector(1e-4f, 1e-4f, 1e-4f);
+        boxes[k].max = boxes[k].max + Vector(1e-4f, 1e-4f, 1e-4f);
+        bounds.expand(boxes[k]);
+    }
+    std::vector<int> order;
+    buildBoxTree(boxes, nodes, order);
+
+    //store the triangles in leaf order
+    std::vector<uint32_t> sorted(indices.size());
+    for (int k = 0; k < count; k++) {
+        std::copy_n(&indices[3 * (std::size_t)order[k]], 3, &sorted[3 * (std::size_t)k]);
+    }
+    indices.swap(sorted);
+}
+
+bool MeshGeometry :: closestHit(const KernelRay& kernelRay, float& tBest, int& triangle) const {
+    if (nodes.empty()) return false;
+    ShearedRay ray = shear(kernelRay);
+    float tNear;
+    if (!intersectBox(nodes[0].box, ray.origin, ray.invDirection, tBest, tNear)) return false;
+
+    bool found = false;
+    int stack[kStackSize];
+    int stackSize = 0;
+    int current = 0;
+    while (true) {
+        const BVHNode& node = nodes[current];
+        if (node.count > 0) {
+            for (int k = node.leftFirst; k < node.leftFirst + node.count; k++) {
+                const uint32_t* corners = &indices[3 * (std::size_t)k];
+                float t = triangleDistance(ray, &vertices[3 * (std::size_t)corners[0]],
+                                           &vertices[3 * (std::size_t)corners[1]], &vertices[3 * (std::size_t)corners[2]]);
+                if (t > 0 && (t < tBest || (t == tBest && (!found || k < triangle)))) {
+                    tBest = t;
+                    triangle = k;
+                    found = true;
+                }
+            }
+        } else {
+            //nearer child first, like BVH::closestFrom
+            int left = current + 1;
+            int right = node.leftFirst;
+            float tLeft, tRight;
+            bool hitLeft = intersectBox(nodes[left].box, ray.origin, ray.invDirection, tBest, tLeft);
+            bool hitRight = intersectBox(nodes[right].box, ray.origin, ray.invDirection, tBest, tRight);
+            if (hitLeft && hitRight) {
+                if (tRight < tLeft) std::swap(left, right);
+                stack[stackSize++] = right;
+                current = left;
+                continue;
+            }
+            if (hitLeft) { current = left; continue; }
+            if (hitRight) { current = right; continue; }
+        }
+
+        bool more = false;
+        while (stackSize > 0) {
+            current = stack[--stackSize];
+            if (intersectBox(nodes[current].box, ray.origin, ray.invDirection, tBest, tNear)) {
+                more = true;
+                break;
+            }
+        }
+        if (!more) break;
+    }
+    return found;
+}
+
+bool MeshGeometry :: occluded(const KernelRay& kernelRay, float tMax) const {
+    if (nodes.empty()) return false;
+    ShearedRay ray = shear(kernelRay);
+    int stack[kStackSize];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0) {
+        int current = stack[--stackSize];
+        const BVHNode& node = nodes[current];
+        float tNear;
+        if (!intersectBox(node.box, ray.origin, ray.invDirection, tMax, tNear)) continue;
+        if (node.count > 0) {
+            for (int k = node.leftFirst; k < node.leftFirst + node.count; k++) {
+                const uint32_t* corners = &indices[3 * (std::size_t)k];
+                float t = triangleDistance(ray, &vertices[3 * (std::size_t)corners[0]],
+                                           &vertices[3 * (std::size_t)corners[1]], &vertices[3 * (std::size_t)corners[2]]);
+                if (t > 0 && t < tMax) return true;
+            }
+        } else {
+            stack[stackSize++] = node.leftFirst;
+            stack[stackSize++] = current + 1;
+        }
+    }
+    return false;
+}
+
+Vector MeshGeometry :: normal(int triangle) const {
+    const uint32_t* corners = &indices[3 * (std::size_t)triangle];
+    const float* a = &vertices[3 * (std::size_t)corners[0]];
+    const float* b = &vertices[3 * (std::size_t)corners[1]];
+    const float* c = &vertices[3 * (std::size_t)corners[2]];
+    Vector ab(b[0] - a[0], b[1] - a[1], b[2] - a[2]);
+    Vector ac(c[0] - a[0], c[1] - a[1], c[2] - a[2]);
+    return ab.cross(ac).normalize();
+}
+
+std::size_t MeshGeometry :: memoryBytes() const {
+    return vertices.capacity() * sizeof(float) + indices.capacity() * sizeof(uint32_t) +
+           nodes.capacity() * sizeof(BVHNode);
+}
+
+namespace {
+
+const char* skipSpaces(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    return p;
+}
+
+const char* lineEnd(const char* p, const char* end) {
+    const char* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    return newline ? newline : end;
+}
+
+//from_chars for float is missing from some standard libraries, strtof needs the text to
+//end somewhere it may read, so the number is copied out first
+const char* parseFloat(const char* p, const char* end, float& value) {
+    char number[64];
+    std::size_t length = 0;
+    while (p + length < end && length < sizeof(number) - 1 && p[length] != ' ' && p[length] != '\t' &&
+           p[length] != '\r') {
+        number[length] = p[length];
+        length++;
+    }
+    number[length] = '\0';
+    char* stop;
+    value = std::strtof(number, &stop);
+    return stop == number ? nullptr : p + (stop - number);
+}
+
+}
+
+bool loadObj(const std::string& path, const Vector& offset, float scale, MeshGeometry& mesh) {
+    MappedFile file;
+    if (!file.open(path)) {
+        std::cerr << "Failed to open mesh file: " << path << std::endl;
+        return false;
+    }
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+    mesh.sourceHash = hashBytes(begin, file.size());
+
+    //count first, so the arrays are allocated once at their final size
+    std::size_t vertexLines = 0, faceLines = 0;
+    for (const char* p = begin; p < end; p = lineEnd(p, end) + 1) {
+        p = skipSpaces(p, end);
+        if (end - p < 2 || (p[1] != ' ' && p[1] != '\t')) continue;
+        if (p[0] == 'v') vertexLines++;
+        else if (p[0] == 'f') faceLines++;
+    }
+    mesh.vertices.clear();
+    mesh.indices.clear();
+    mesh.vertices.reserve(3 * vertexLines);
+    mesh.indices.reserve(3 * faceLines);
+
+    int lineNumber = 0;
+    for (const char* p = begin; p < end; p = lineEnd(p, end) + 1) {
+        lineNumber++;
+        const char* stop = lineEnd(p, end);
+        p = skipSpaces(p, stop);
+        if (stop - p < 2 || (p[1] != ' ' && p[1] != '\t')) continue;
+        if (p[0] == 'v') {
+            p++;
+            float xyz[3];
+            for (float& value : xyz) {
+                p = skipSpaces(p, stop);
+                p = parseFloat(p, stop, value);
+                if (!p) {
+                    std::cerr << "Error: " << path << ":" << lineNumber << ": expected a vertex x y z" << std::endl;
+                    return false;
+                }
+            }
+            mesh.vertices.push_back(xyz[0] * scale + offset.x);
+            mesh.vertices.push_back(xyz[1] * scale + offset.y);
+            mesh.vertices.push_back(xyz[2] * scale + offset.z);
+        } else if (p[0] == 'f') {
+            p++;
+            long vertexCount = (long)(mesh.vertices.size() / 3);
+            uint32_t first = 0, previous = 0;
+            int corners = 0;
+            while ((p = skipSpaces(p, stop)) < stop) {
+                long index = 0;
+                auto result = std::from_chars(p, stop, index);
+                //v, v/vt, v//vn or v/vt/vn: only the position index is used
+                if (result.ec != std::errc() || index == 0) {
+                    std::cerr << "Error: " << path << ":" << lineNumber << ": bad face index" << std::endl;
+                    return false;
+                }
+                if (index < 0) index += vertexCount + 1;
+                if (index < 1 || index > vertexCount) {
+                    std::cerr << "Error: " << path << ":" << lineNumber << ": face index out of range" << std::endl;
+                    return false;
+                }
+                p = result.ptr;
+                while (p < stop && *p != ' ' && *p != '\t' && *p != '\r') p++;
+                uint32_t vertex = (uint32_t)(index - 1);
+                //polygons become fans around their first corner
+                if (corners == 0) first = vertex;
+                if (corners >= 2) {
+                    mesh.indices.push_back(first);
+                    mesh.indices.push_back(previous);
+                    mesh.indices.push_back(vertex);
+                }
+                previous = vertex;
+                corners++;
+            }
+        }
+    }
+    if (mesh.indices.empty()) {
+        std::cerr << "Mesh file " << path << " has no faces" << std::endl;
+        return false;
+    }
+    mesh.buildBVH();
+    return true;
+}
+
+void closestMeshes(const MeshSoA& meshes, int begin, int count, const KernelRay& ray, float& tBest, int& idBest) {
+    for (int k = begin; k < begin + count; k++) {
+        float t = tBest;
+        int triangle = 0;
+        if (!meshes.geometry[k]->closestHit(ray, t, triangle)) continue;
+        int id = meshes.ids[k];
+        if (t < tBest || id < idBest) {
+            tBest = t;
+            idBest = id;
+        }
+    }
+}
+
+bool occludedMeshes(const MeshSoA& meshes, int begin, int count, const KernelRay& ray, float tMax) {
+    for (int k = begin; k < begin + count; k++) {
+        if (meshes.geometry[k]->occluded(ray, tMax)) return true;
+    }
+    return false;
+}
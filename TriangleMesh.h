@@ -0,0 +1,53 @@
+// TriangleMesh.h
+#ifndef TRIANGLEMESH_H
+#define TRIANGLEMESH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "AABB.h"
+#include "BVH.h"
+#include "Kernels.h"
+
+// indexed triangle geometry with its own BVH. vertices are packed float triples and
+// every triangle is three indices into them. the triangles are stored in the order of
+// the tree's leaves, so a leaf is a run [leftFirst, leftFirst + count) of triangles and
+// no separate index list is kept
+class MeshGeometry {
+public:
+    std::vector<float> vertices;     // x, y, z of each vertex
+    std::vector<uint32_t> indices;   // three per triangle
+    std::vector<BVHNode> nodes;
+    AABB bounds;
+    uint64_t sourceHash = 0;         // of the OBJ file it was loaded from
+
+    int triangleCount() const { return (int)(indices.size() / 3); }
+    // builds nodes over the triangles and puts the triangles in leaf order. called once
+    // the triangles are final
+    void buildBVH();
+
+    // closest triangle hit before tBest, by the watertight test: lowers tBest, sets
+    // triangle and returns true. on equal distances the lower triangle wins
+    bool closestHit(const KernelRay& ray, float& tBest, int& triangle) const;
+    // true when any triangle is hit before tMax
+    bool occluded(const KernelRay& ray, float tMax) const;
+    // unit normal of triangle, on the side its vertices wind counterclockwise around
+    Vector normal(int triangle) const;
+    // bytes held by the vertices, indices and tree
+    std::size_t memoryBytes() const;
+};
+
+// streams the vertices and faces of a Wavefront OBJ file into mesh, in one pass over the
+// mapped file with no object per triangle: polygons become triangle fans, negative
+// (relative) indices and the v/vt/vn forms are accepted, other lines are ignored. the
+// vertices are scaled by scale and moved by offset, then the BVH is built. false (and a
+// message) when the file cannot be read or holds no triangle
+bool loadObj(const std::string& path, const Vector& offset, float scale, MeshGeometry& mesh);
+
+// the mesh counterparts of the kernels, over the meshes [begin, begin + count) of store.
+// scalar only, like the planes
+void closestMeshes(const MeshSoA& meshes, int begin, int count, const KernelRay& ray, float& tBest, int& idBest);
+bool occludedMeshes(const MeshSoA& meshes, int begin, int count, const KernelRay& ray, float tMax);
+
+#endif // TRIANGLEMESH_H
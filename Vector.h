@@ -1,28 +1,167 @@
 #ifndef VECTOR_H
 #define VECTOR_H
 
-#include <limits>
+#include <cmath>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+// header only, so every operation inlines into the intersection and shading code.
+// the operations do the same float math in the same order as always (the images
+// depend on it), and the layout stays three packed floats: the image writer, the
+// scene cache and the SIMD kernels read Vectors as float triples
 class Vector {
 public:
     float x, y, z;
 
-    Vector() ;
-    Vector(float x, float y, float z) ;
+    constexpr Vector() : x(0), y(0), z(0) {}
+    constexpr Vector(float x, float y, float z) : x(x), y(y), z(z) {}
+
+    constexpr Vector operator+(const Vector& other) const { return Vector(x + other.x, y + other.y, z + other.z); }
+    constexpr Vector operator-() const { return Vector(-x, -y, -z); }
+    constexpr Vector operator-(const Vector& other) const { return Vector(x - other.x, y - other.y, z - other.z); }
+    constexpr Vector operator*(float scalar) const { return Vector(x * scalar, y * scalar, z * scalar); }
+    constexpr Vector operator/(float scalar) const { return Vector(x / scalar, y / scalar, z / scalar); }
+
+    constexpr float dot(const Vector& other) const { return x * other.x + y * other.y + z * other.z; }
+    constexpr Vector cross(const Vector& other) const {
+        return Vector(
+            y * other.z - z * other.y,
+            z * other.x - x * other.z,
+            x * other.y - y * other.x
+        );
+    }
+    Vector normalize() const {
+        float length = std::sqrt(x * x + y * y + z * z);
+        return Vector(x / length, y / length, z / length);
+    }
+    float magnitude() const { return std::sqrt(x * x + y * y + z * z); }
+    constexpr float getZ() const { return z; }
+    constexpr Vector& operator+=(const Vector& other) {
+        x += other.x;
+        y += other.y;
+        z += other.z;
+        return *this;
+    }
+    constexpr Vector Hadamard(const Vector& other) const { return Vector(x * other.x, y * other.y, z * other.z); }
+
+    // this * scale + add, fused into one rounding where the target has FMA (-mfma). the default
+    // build has none and gets exactly the unfused result, so its images do not change
+    Vector mulAdd(float scale, const Vector& add) const {
+        return Vector(fusedMulAdd(x, scale, add.x), fusedMulAdd(y, scale, add.y), fusedMulAdd(z, scale, add.z));
+    }
+
+    static float fusedMulAdd(float a, float b, float c) {
+#if defined(__FMA__) || defined(__ARM_FEATURE_FMA)
+        return std::fma(a, b, c);
+#else
+        return a * b + c;
+#endif
+    }
+};
+
+// eight floats, and eight Vectors as structure of arrays. the operations are plain
+// loops over the lanes that the compiler can vectorize for whatever target it builds
+// for. not for the kernel files built with extra instruction sets: an inline function
+// compiled there could be the copy the linker keeps for every other file
+struct Float8 {
+    static constexpr int width = 8;
+    alignas(32) float v[width];
+
+    static Float8 broadcast(float value) {
+        Float8 out;
+        for (int k = 0; k < width; k++) out.v[k] = value;
+        return out;
+    }
+};
 
-    Vector operator+(const Vector& other) const;
-    Vector operator-() const;
-    Vector operator-(const Vector& other) const;
-    Vector operator*(float scalar) const;
-    Vector operator/(float scalar) const;
+struct Vec3x8 {
+    static constexpr int width = 8;
+    alignas(32) float x[width];
+    alignas(32) float y[width];
+    alignas(32) float z[width];
 
-    float dot(const Vector& other) const;
-    Vector cross(const Vector& other) const;
-    Vector normalize() const;
-    float magnitude() const;
-    float getZ() const ;
-    Vector& operator+=(const Vector& other) ;
-    Vector Hadamard(const Vector& other) const;
+    static Vec3x8 broadcast(const Vector& value) {
+        Vec3x8 out;
+        for (int k = 0; k < width; k++) out.set(k, value);
+        return out;
+    }
+    // the first count (at most 8) vectors of values, the other lanes zero
+    static Vec3x8 load(const Vector* values, int count) {
+        Vec3x8 out;
+        for (int k = 0; k < width; k++) out.set(k, k < count ? values[k] : Vector());
+        return out;
+    }
+    Vector get(int lane) const { return Vector(x[lane], y[lane], z[lane]); }
+    void set(int lane, const Vector& value) {
+        x[lane] = value.x;
+        y[lane] = value.y;
+        z[lane] = value.z;
+    }
 
+    Vec3x8 operator+(const Vec3x8& other) const {
+        Vec3x8 out;
+        for (int k = 0; k < width; k++) {
+            out.x[k] = x[k] + other.x[k];
+            out.y[k] = y[k] + other.y[k];
+            out.z[k] = z[k] + other.z[k];
+        }
+        return out;
+    }
+    Vec3x8 operator-(const Vec3x8& other) const {
+        Vec3x8 out;
+        for (int k = 0; k < width; k++) {
+            out.x[k] = x[k] - other.x[k];
+            out.y[k] = y[k] - other.y[k];
+            out.z[k] = z[k] - other.z[k];
+        }
+        return out;
+    }
+    Vec3x8 operator*(const Float8& scale) const {
+        Vec3x8 out;
+        for (int k = 0; k < width; k++) {
+            out.x[k] = x[k] * scale.v[k];
+            out.y[k] = y[k] * scale.v[k];
+            out.z[k] = z[k] * scale.v[k];
+        }
+        return out;
+    }
+    Vec3x8 Hadamard(const Vec3x8& other) const {
+        Vec3x8 out;
+        for (int k = 0; k < width; k++) {
+            out.x[k] = x[k] * other.x[k];
+            out.y[k] = y[k] * other.y[k];
+            out.z[k] = z[k] * other.z[k];
+        }
+        return out;
+    }
+    Float8 dot(const Vec3x8& other) const {
+        Float8 out;
+        for (int k = 0; k < width; k++) out.v[k] = x[k] * other.x[k] + y[k] * other.y[k] + z[k] * other.z[k];
+        return out;
+    }
+    // lane k is exactly get(k).normalize()
+    Vec3x8 normalize() const {
+        Vec3x8 out;
+#if defined(__SSE__)
+        //a plain loop would stay scalar, std::sqrt has to keep errno
+        for (int k = 0; k < width; k += 4) {
+            __m128 vx = _mm_load_ps(x + k), vy = _mm_load_ps(y + k), vz = _mm_load_ps(z + k);
+            __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz)));
+            _mm_store_ps(out.x + k, _mm_div_ps(vx, length));
+            _mm_store_ps(out.y + k, _mm_div_ps(vy, length));
+            _mm_store_ps(out.z + k, _mm_div_ps(vz, length));
+        }
+#else
+        for (int k = 0; k < width; k++) {
+            float length = std::sqrt(x[k] * x[k] + y[k] * y[k] + z[k] * z[k]);
+            out.x[k] = x[k] / length;
+            out.y[k] = y[k] / length;
+            out.z[k] = z[k] / length;
+        }
+#endif
+        return out;
+    }
 };
 
 #endif // VECTOR_H
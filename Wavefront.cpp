@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <limits>
+#include "Wavefront.h"
+#include "Render.h"
+#include "Scene.h"
+#include "RenderStats.h"
+#include "OccluderCache.h"
+
+//same as createColor: rays deeper than this are black
+static const int kMaxDepth = 5;
+
+void RayQueue :: clear() {
+    ox.clear(); oy.clear(); oz.clear();
+    dx.clear(); dy.clear(); dz.clear();
+    tMax.clear();
+    path.clear();
+}
+
+void RayQueue :: push(const Ray& ray, float t, int owner) {
+    ox.push_back(ray.origin.x);
+    oy.push_back(ray.origin.y);
+    oz.push_back(ray.origin.z);
+    dx.push_back(ray.direction.x);
+    dy.push_back(ray.direction.y);
+    dz.push_back(ray.direction.z);
+    tMax.push_back(t);
+    path.push_back(owner);
+}
+
+Ray RayQueue :: ray(int k) const {
+    return Ray(Vector(ox[k], oy[k], oz[k]), Vector(dx[k], dy[k], dz[k]));
+}
+
+void RayQueue :: toPacket(int first, int count, RayPacket& packet) const {
+    //the kernels read whole registers, so the lanes past the last ray get defined values
+    packet.count = (count + 7) / 8 * 8;
+    for (int k = 0; k < packet.count; k++) {
+        int from = first + k;
+        bool live = k < count;
+        packet.ox[k] = live ? ox[from] : 0.0f;
+        packet.oy[k] = live ? oy[from] : 0.0f;
+        packet.oz[k] = live ? oz[from] : 0.0f;
+        packet.dx[k] = live ? dx[from] : 0.0f;
+        packet.dy[k] = live ? dy[from] : 0.0f;
+        packet.dz[k] = live ? dz[from] : 0.0f;
+        packet.invDx[k] = 1.0f / packet.dx[k];
+        packet.invDy[k] = 1.0f / packet.dy[k];
+        packet.invDz[k] = 1.0f / packet.dz[k];
+        packet.t[k] = live ? tMax[from] : 0.0f;
+        packet.id[k] = -1;
+    }
+}
+
+//mask of the first count rays of a packet
+static uint64_t firstRays(int count) {
+    return count == 64 ? ~0ull : (1ull << count) - 1;
+}
+
+void Wavefront :: clear() {
+    rays.clear();
+    colors.clear();
+}
+
+void Wavefront :: addCameraRay(const Ray& ray) {
+    rays.push(ray, std::numeric_limits<float>::max(), (int)colors.size());
+    colors.push_back(Vector(0, 0, 0));
+}
+
+void Wavefront :: trace(const Scene& scene) {
+    for (int depth = 0; rays.size() > 0; depth++) {
+        extend(scene, depth);
+        shade(scene, depth);
+        shadow(scene, depth);
+        std::swap(rays, spawned);
+    }
+}
+
+//closest hit of every queued ray
+void Wavefront :: extend(const Scene& scene, int depth) {
+    int count = rays.size();
+    countDepth(depth, count);
+    hits.resize(count);
+    for (int first = 0; first < count; first += RayPacket::kMaxRays) {
+        int size = std::min(RayPacket::kMaxRays, count - first);
+        rays.toPacket(first, size, packet);
+        scene.bvh.closestHitPacket(packet, scene.primitives, firstRays(size));
+        for (int k = 0; k < size; k++) {
+            HitRecord& hit = hits[first + k];
+            hit.t = packet.t[k];
+            hit.primitive = packet.id[k];
+            if (hit.hit()) countStat((StatCounter)(STAT_SPHERE_HITS + scene.primitives.primitiveTypes[hit.primitive]));
+        }
+    }
+}
+
+//ends the paths that missed, spawns the mirror and glass rays into the next queue and
+//queues the shadow rays of the opaque hits, light by light in scene order
+void Wavefront :: shade(const Scene& scene, int depth) {
+    spawned.clear();
+    opaqueHits.clear();
+    opaqueViews.clear();
+    opaquePaths.clear();
+    shadows.clear();
+    shadowLights.clear();
+    shadowToLights.clear();
+
+    int count = rays.size();
+    for (int k = 0; k < count; k++) {
+        if (!hits[k].hit()) continue;
+        Ray ray = rays.ray(k);
+        int path = rays.path[k];
+        Intersection interObject = scene.primitives.surface(ray, hits[k]);
+        if (interObject.reflective || interObject.transparent) {
+            Vector direction = interObject.reflective
+                                   ? reflect(ray.direction, interObject.normal).normalize()
+                                   : refract(ray.direction, interObject.normal, 1.5f).normalize();
+            countStat(interObject.reflective ? STAT_REFLECTED_RAYS : STAT_REFRACTED_RAYS);
+            if (depth + 1 <= kMaxDepth) {
+                spawned.push(Ray(interObject.point + direction * 1e-4f, direction), std::numeric_limits<float>::max(), path);
+            }
+            continue;
+        }
+
+        if (scene.lightBudget > 0) {
+            //sampled lights are drawn per hit, the hit is shaded here with its own shadow rays
+            Vector color = shadeLights(ray, interObject, scene);
+            colors[path] = depth > 0 ? Vector(0, 0, 0) + color : color;
+            continue;
+        }
+        int opaque = (int)opaqueHits.size();
+        opaqueHits.push_back(interObject);
+        opaqueViews.push_back((ray.origin - interObject.point).normalize());
+        opaquePaths.push_back(path);
+        findReachingLights(scene, interObject.point, [&](int l, const Ray& shadowRay, float lightDistance,
+                                                         const Vector& toLight) {
+            shadows.push(shadowRay, lightDistance, opaque);
+            shadowLights.push_back(l);
+            shadowToLights.push_back(toLight);
+        });
+    }
+}
+
+//any-hit tests of the queued shadow rays, then phong shading of the opaque hits from
+//the lights that reach them, in the order shadeLights adds them
+void Wavefront :: shadow(const Scene& scene, int depth) {
+    int count = shadows.size();
+    countStat(STAT_SHADOW_RAYS, count);
+    shadowBlocked.resize(count);
+    for (int first = 0; first < count; first += RayPacket::kMaxRays) {
+        int size = std::min(RayPacket::kMaxRays, count - first);
+        shadows.toPacket(first, size, packet);
+        //the queue goes light by light, so a packet holds the rays of one light or a few
+        uint64_t blocked = 0;
+        for (uint64_t pending = firstRays(size); pending;) {
+            int light = shadowLights[first + __builtin_ctzll(pending)];
+            uint64_t same = 0;
+            for (uint64_t left = pending; left; left &= left - 1) {
+                int k = __builtin_ctzll(left);
+                if (shadowLights[first + k] == light) same |= 1ull << k;
+            }
+            blocked |= shadowBlockedPacket(scene, light, packet, same);
+            pending &= ~same;
+        }
+        countStat(STAT_SHADOWS_OCCLUDED, __builtin_popcountll(blocked));
+        for (int k = 0; k < size; k++) shadowBlocked[first + k] = (blocked >> k) & 1;
+    }
+
+    shading.assign(opaqueHits.size(), Vector(0, 0, 0));
+    for (int k = 0; k < count; k++) {
+        if (shadowBlocked[k]) continue;
+        int opaque = shadows.path[k];
+        shading[opaque] = shading[opaque] + lightContribution(opaqueHits[opaque], opaqueViews[opaque],
+                                                              scene.shadingLights[shadowLights[k]], shadowToLights[k]);
+    }
+    for (std::size_t opaque = 0; opaque < opaqueHits.size(); opaque++) {
+        const Intersection& interObject = opaqueHits[opaque];
+        Vector color = shading[opaque] + interObject.color.Hadamard(scene.ambientLight->getIntensity());
+        //createColor adds a mirror's reflection to black, which turns a -0 into 0
+        colors[opaquePaths[opaque]] = depth > 0 ? Vector(0, 0, 0) + color : color;
+    }
+}
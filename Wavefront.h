@@ -0,0 +1,72 @@
+// Wavefront.h
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include <vector>
+#include "Vector.h"
+#include "Ray.h"
+#include "Intersection.h"
+#include "RayPacket.h"
+
+class Scene;
+
+// rays waiting for one stage, as structure of arrays. path is the camera ray (the
+// index in the batch) a ray belongs to, tMax the farthest hit that counts
+struct RayQueue {
+    std::vector<float> ox, oy, oz;
+    std::vector<float> dx, dy, dz;
+    std::vector<float> tMax;
+    std::vector<int> path;
+
+    void clear();
+    void push(const Ray& ray, float t, int owner);
+    int size() const { return (int)path.size(); }
+    Ray ray(int k) const;
+    // copies rays [first, first + count) into packet, count at most RayPacket::kMaxRays
+    void toPacket(int first, int count, RayPacket& packet) const;
+};
+
+// traces a batch of camera rays breadth first instead of one path at a time: every
+// ray of the batch goes through a stage before any ray goes on to the next one.
+//   extend: closest hits of the whole queue, in packets of 64 rays
+//   shade: misses end their path, mirrors and glass spawn the next queue, opaque
+//          hits queue one shadow ray per light
+//   shadow: any-hit tests of all the shadow rays, then the lit ones are shaded
+// and then the spawned rays are extended, until no ray is left. the colors are
+// exactly the ones createColor(ray, scene, 0) returns. one per thread, the queues
+// are reused from batch to batch
+class Wavefront {
+public:
+    void clear();
+    // generate: queues a camera ray, its color will be color(index) where index is size() before the call
+    void addCameraRay(const Ray& ray);
+    int size() const { return (int)colors.size(); }
+    void trace(const Scene& scene);
+    const Vector& color(int path) const { return colors[path]; }
+
+private:
+    void extend(const Scene& scene, int depth);
+    void shade(const Scene& scene, int depth);
+    void shadow(const Scene& scene, int depth);
+
+    RayQueue rays;
+    RayQueue spawned;
+    std::vector<HitRecord> hits;
+    std::vector<Vector> colors;
+
+    // opaque hits of the current depth waiting for their shadow rays
+    std::vector<Intersection> opaqueHits;
+    std::vector<Vector> opaqueViews;
+    std::vector<int> opaquePaths;
+    // for every shadow ray: the light, the light's direction for shading and the
+    // opaque hit it belongs to (the queue's path)
+    RayQueue shadows;
+    std::vector<int> shadowLights;
+    std::vector<Vector> shadowToLights;
+    std::vector<char> shadowBlocked;
+    std::vector<Vector> shading;
+
+    RayPacket packet;
+};
+
+#endif // WAVEFRONT_H
@@ -0,0 +1,373 @@
+// benchmarks for the ray tracer: microbenchmarks of the intersection and shading
+// building blocks, then end-to-end renders of the sample scenes and of generated
+// scenes with many objects. run with "make bench"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Kernels.h"
+#include "Light.h"
+#include "Object.h"
+#include "Options.h"
+#include "Ray.h"
+#include "Render.h"
+#include "Scene.h"
+#include "ThreadPool.h"
+#include "Vector.h"
+
+namespace {
+
+struct BenchSettings {
+    int warmup = 1;
+    int repetitions = 5;
+    int renderRepetitions = 3;
+    std::string filter;            // only run benchmarks whose name contains this
+    std::string jsonPath;
+    std::string outputDirectory = "bench/out";
+    bool micro = true;
+    bool render = true;
+};
+
+struct Summary {
+    double median = 0;
+    double stddev = 0;
+};
+
+Summary summarize(std::vector<double> values) {
+    Summary summary;
+    std::sort(values.begin(), values.end());
+    std::size_t n = values.size();
+    summary.median = n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+    double mean = 0;
+    for (double v : values) mean += v;
+    mean /= n;
+    double variance = 0;
+    for (double v : values) variance += (v - mean) * (v - mean);
+    summary.stddev = n > 1 ? std::sqrt(variance / (n - 1)) : 0;
+    return summary;
+}
+
+double now() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//seconds of every repetition of body, after the warmup runs
+std::vector<double> measure(int warmup, int repetitions, const std::function<void()>& body) {
+    for (int k = 0; k < warmup; k++) body();
+    std::vector<double> seconds;
+    for (int k = 0; k < repetitions; k++) {
+        double start = now();
+        body();
+        seconds.push_back(now() - start);
+    }
+    return seconds;
+}
+
+//keeps results alive so the compiler cannot drop the measured work
+volatile float sink;
+
+struct MicroResult {
+    std::string name;
+    long long operations;          // per repetition
+    Summary nanosPerOperation;
+    double operationsPerSecond;    // from the median
+};
+
+struct RenderResult {
+    std::string scene;
+    long long primaryRays;
+    Summary seconds;
+    double raysPerSecond;          // primary rays per second, from the median
+};
+
+std::vector<MicroResult> microResults;
+std::vector<RenderResult> renderResults;
+
+bool selected(const BenchSettings& settings, const std::string& name) {
+    return settings.filter.empty() || name.find(settings.filter) != std::string::npos;
+}
+
+void micro(const BenchSettings& settings, const std::string& name, long long operations, const std::function<void()>& body) {
+    if (!selected(settings, name)) return;
+    std::vector<double> seconds = measure(settings.warmup, settings.repetitions, body);
+    for (double& s : seconds) s = s * 1e9 / operations;
+    MicroResult result{name, operations, summarize(seconds), 0};
+    result.operationsPerSecond = 1e9 / result.nanosPerOperation.median;
+    microResults.push_back(result);
+    std::printf("%-28s %10.2f ns/op  (+- %6.2f)  %12.0f ops/s\n", name.c_str(), result.nanosPerOperation.median,
+                result.nanosPerOperation.stddev, result.operationsPerSecond);
+}
+
+//rays from around the camera toward a box of half size spread around the origin
+std::vector<Ray> randomRays(int count, float spread, unsigned seed) {
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::vector<Ray> rays;
+    rays.reserve(count);
+    for (int k = 0; k < count; k++) {
+        Vector origin(unit(random) * 0.1f, unit(random) * 0.1f, 4.0f);
+        Vector target(unit(random) * spread, unit(random) * spread, -4.0f);
+        rays.push_back(Ray(origin, (target - origin).normalize()));
+    }
+    return rays;
+}
+
+//scene with count random spheres and cylinders over a checkerboard floor, lit by two
+//spotlights and a directional light. same count, same scene
+std::string writeSyntheticScene(const std::string& directory, const std::string& name, int count, bool aliasing) {
+    std::string path = directory + "/" + name + ".txt";
+    std::ofstream file(path);
+    std::mt19937 random(1234 + count);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    file << "e 0.0 0.0 4.0 " << (aliasing ? "0.0" : "1.0") << "\n";
+    file << "a 0.1 0.1 0.1 1.0\n";
+    file << "o 0.0 -1.0 0.0 -2.0\n";
+    std::vector<std::string> colors;
+    colors.push_back("c 0.6 0.6 0.6 10.0");
+    for (int k = 0; k < count; k++) {
+        float x = unit(random) * 12 - 6, y = unit(random) * 8 - 2, z = -2 - unit(random) * 14;
+        float kind = unit(random);
+        char prefix = kind < 0.1f ? 'r' : (kind < 0.15f ? 't' : 'o');
+        if (kind < 0.75f) {
+            file << prefix << " " << x << " " << y << " " << z << " " << 0.05f + unit(random) * 0.2f << "\n";
+        } else {
+            file << "f " << x << " " << y << " " << z << " " << unit(random) - 0.5f << " 1.0 " << unit(random) - 0.5f
+                 << " " << 0.05f + unit(random) * 0.1f << " " << 0.1f + unit(random) * 0.4f << "\n";
+        }
+        std::ostringstream color;
+        color << "c " << unit(random) << " " << unit(random) << " " << unit(random) << " " << 5 + unit(random) * 50;
+        colors.push_back(color.str());
+    }
+    for (const auto& color : colors) file << color << "\n";
+    //p lines go to the spotlights in order, so they come first
+    file << "d 0.0 -1.0 -0.3 1.0\n";
+    file << "d 0.2 -0.5 -1.0 1.0\n";
+    file << "d 0.5 -1.0 -1.0 0.0\n";
+    file << "p 0.0 5.0 -6.0 0.8\n";
+    file << "p -3.0 3.0 2.0 0.9\n";
+    file << "i 0.6 0.6 0.6\n";
+    file << "i 0.5 0.4 0.3\n";
+    file << "i 0.3 0.4 0.5\n";
+    return path;
+}
+
+void runMicro(const BenchSettings& settings) {
+    std::printf("microbenchmarks (%d warmup, %d repetitions)\n", settings.warmup, settings.repetitions);
+    const int rayCount = 1 << 16;
+    const int passes = 16;
+    std::vector<Ray> rays = randomRays(rayCount, 2.0f, 7);
+
+    Sphere sphere(Vector(0, 0, -4), 1.0f, Vector(1, 0, 0), 10, false, false);
+    Plane plane(Vector(0, 1, 0.2f), -1.0f, Vector(1, 1, 1), 10, false, false);
+    Cylinder cylinder(Vector(0, 0, -4), Vector(0.3f, 1, 0), 0.8f, 1.5f, Vector(0, 1, 0), 10, false, false);
+    struct Primitive { const char* name; Object* object; };
+    Primitive primitives[] = {{"Sphere::intersect", &sphere}, {"Plane::intersect", &plane}, {"Cylinder::intersect", &cylinder}};
+    for (const auto& primitive : primitives) {
+        micro(settings, primitive.name, (long long)rayCount * passes, [&] {
+            float sum = 0;
+            for (int pass = 0; pass < passes; pass++) {
+                for (const Ray& ray : rays) sum += primitive.object->intersect(ray).distance;
+            }
+            sink = sum;
+        });
+    }
+
+    //findObject and findLights on the sample scene and on a large generated one
+    std::string synthetic = writeSyntheticScene(settings.outputDirectory, "synthetic-10k", 10000, false);
+    const char* scenes[][2] = {{"scene1", "scene1.txt"}, {"synthetic-10k", synthetic.c_str()}};
+    for (const auto& entry : scenes) {
+        Scene scene;
+        scene.loadFromFile(entry[1]);
+        std::vector<Ray> cameraRays = randomRays(rayCount, 3.0f, 11);
+        std::string suffix = std::string("/") + entry[0];
+        micro(settings, "findObject" + suffix, rayCount, [&] {
+            float sum = 0;
+            for (const Ray& ray : cameraRays) sum += findObject(ray, scene).distance;
+            sink = sum;
+        });
+
+        std::vector<Intersection> hits;
+        for (const Ray& ray : cameraRays) {
+            Intersection hit = findObject(ray, scene);
+            if (hit.hit) hits.push_back(hit);
+        }
+        if (hits.empty()) continue;
+        micro(settings, "findLights" + suffix, (long long)hits.size(), [&] {
+            std::size_t sum = 0;
+            for (const Intersection& hit : hits) findLights(scene, hit, [&sum](const ShadingLight&, const Vector&) { sum++; });
+            sink = (float)sum;
+        });
+    }
+
+    std::vector<Vector> a(4096), b(4096);
+    std::mt19937 random(3);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    for (std::size_t k = 0; k < a.size(); k++) {
+        a[k] = Vector(unit(random), unit(random), unit(random));
+        b[k] = Vector(unit(random), unit(random), unit(random));
+    }
+    const long long vectorOps = (long long)a.size() * 256;
+    micro(settings, "Vector::operator+", vectorOps, [&] {
+        Vector sum;
+        for (int pass = 0; pass < 256; pass++) {
+            for (std::size_t k = 0; k < a.size(); k++) sum = sum + a[k] + b[k] * 0.0f;
+        }
+        sink = sum.x;
+    });
+    micro(settings, "Vector::dot", vectorOps, [&] {
+        float sum = 0;
+        for (int pass = 0; pass < 256; pass++) {
+            for (std::size_t k = 0; k < a.size(); k++) sum += a[k].dot(b[k]);
+        }
+        sink = sum;
+    });
+    micro(settings, "Vector::cross", vectorOps, [&] {
+        Vector sum;
+        for (int pass = 0; pass < 256; pass++) {
+            for (std::size_t k = 0; k < a.size(); k++) sum += a[k].cross(b[k]);
+        }
+        sink = sum.x;
+    });
+    micro(settings, "Vector::normalize", vectorOps, [&] {
+        Vector sum;
+        for (int pass = 0; pass < 256; pass++) {
+            for (std::size_t k = 0; k < a.size(); k++) sum += a[k].normalize();
+        }
+        sink = sum.x;
+    });
+    std::vector<Vec3x8> batches(a.size() / Vec3x8::width);
+    for (std::size_t k = 0; k < batches.size(); k++) batches[k] = Vec3x8::load(&a[k * Vec3x8::width], Vec3x8::width);
+    micro(settings, "Vec3x8::normalize", vectorOps, [&] {
+        Vec3x8 sum = Vec3x8::broadcast(Vector());
+        for (int pass = 0; pass < 256; pass++) {
+            for (const Vec3x8& batch : batches) sum = sum + batch.normalize();
+        }
+        sink = sum.x[0];
+    });
+}
+
+void runRenders(const BenchSettings& settings) {
+    std::printf("renders (%d warmup, %d repetitions)\n", settings.warmup, settings.renderRepetitions);
+    std::vector<std::pair<std::string, std::string>> scenes;
+    for (int k = 1; k <= 6; k++) {
+        std::string name = "scene" + std::to_string(k);
+        scenes.push_back({name, name + ".txt"});
+    }
+    scenes.push_back({"synthetic-1k", writeSyntheticScene(settings.outputDirectory, "synthetic-1k", 1000, false)});
+    scenes.push_back({"synthetic-10k", writeSyntheticScene(settings.outputDirectory, "synthetic-10k", 10000, false)});
+    scenes.push_back({"synthetic-100k", writeSyntheticScene(settings.outputDirectory, "synthetic-100k", 100000, false)});
+    scenes.push_back({"synthetic-1k-aa", writeSyntheticScene(settings.outputDirectory, "synthetic-1k-aa", 1000, true)});
+
+    RenderOptions options;
+    options.outputDirectory = settings.outputDirectory;
+    for (const auto& entry : scenes) {
+        std::string name = "render/" + entry.first;
+        if (!selected(settings, name)) continue;
+        options.scenePath = entry.second;
+        long long primaryRays = 0;
+        bool loaded = true;
+        //the renderer reports every saved image, keep that out of the table
+        std::ostringstream quiet;
+        std::streambuf* console = std::cout.rdbuf(quiet.rdbuf());
+        std::vector<double> seconds = measure(settings.warmup, settings.renderRepetitions, [&] {
+            Scene scene;
+            RenderSummary summary = renderImage(options, scene);
+            primaryRays = summary.primaryRays;
+            loaded = loaded && summary.ok;
+        });
+        std::cout.rdbuf(console);
+        if (!loaded) continue;
+
+        RenderResult result{entry.first, primaryRays, summarize(seconds), 0};
+        result.raysPerSecond = primaryRays / result.seconds.median;
+        renderResults.push_back(result);
+        std::printf("%-28s %10.3f s  (+- %6.3f)  %12.0f primary rays/s\n", name.c_str(), result.seconds.median,
+                    result.seconds.stddev, result.raysPerSecond);
+    }
+}
+
+void writeJson(const BenchSettings& settings) {
+    std::ofstream file(settings.jsonPath);
+    if (!file) {
+        std::cerr << "Failed to write " << settings.jsonPath << std::endl;
+        return;
+    }
+    file.precision(6);
+    file << "{\n  \"threads\": " << ThreadPool::defaultThreadCount() << ",\n";
+    file << "  \"kernels\": \"" << activeKernels().name << "\",\n";
+    file << "  \"warmup\": " << settings.warmup << ",\n";
+    file << "  \"micro\": [";
+    for (std::size_t k = 0; k < microResults.size(); k++) {
+        const MicroResult& r = microResults[k];
+        file << (k ? "," : "") << "\n    {\"name\": \"" << r.name << "\", \"operations\": " << r.operations
+             << ", \"repetitions\": " << settings.repetitions
+             << ", \"ns_per_op_median\": " << r.nanosPerOperation.median
+             << ", \"ns_per_op_stddev\": " << r.nanosPerOperation.stddev
+             << ", \"ops_per_second\": " << r.operationsPerSecond << "}";
+    }
+    file << "\n  ],\n  \"render\": [";
+    for (std::size_t k = 0; k < renderResults.size(); k++) {
+        const RenderResult& r = renderResults[k];
+        file << (k ? "," : "") << "\n    {\"scene\": \"" << r.scene << "\", \"primary_rays\": " << r.primaryRays
+             << ", \"repetitions\": " << settings.renderRepetitions
+             << ", \"wall_seconds_median\": " << r.seconds.median
+             << ", \"wall_seconds_stddev\": " << r.seconds.stddev
+             << ", \"rays_per_second\": " << r.raysPerSecond << "}";
+    }
+    file << "\n  ]\n}\n";
+    std::printf("results written to %s\n", settings.jsonPath.c_str());
+}
+
+void printUsage() {
+    std::cerr << "Usage: raytracer-bench [options]" << std::endl;
+    std::cerr << "  --warmup <n>       runs before measuring (default: 1)" << std::endl;
+    std::cerr << "  --reps <n>         measured repetitions of a microbenchmark (default: 5)" << std::endl;
+    std::cerr << "  --render-reps <n>  measured repetitions of a render (default: 3)" << std::endl;
+    std::cerr << "  --filter <text>    only benchmarks whose name contains text" << std::endl;
+    std::cerr << "  --micro-only, --render-only" << std::endl;
+    std::cerr << "  --json <path>      also write the results as JSON" << std::endl;
+    std::cerr << "  --output-dir <dir> where renders and generated scenes go (default: bench/out)" << std::endl;
+}
+
+bool parseSettings(int argc, char* argv[], BenchSettings& settings) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--warmup" && hasValue) settings.warmup = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--reps" && hasValue) settings.repetitions = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--render-reps" && hasValue) settings.renderRepetitions = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--filter" && hasValue) settings.filter = argv[++i];
+        else if (arg == "--json" && hasValue) settings.jsonPath = argv[++i];
+        else if (arg == "--output-dir" && hasValue) settings.outputDirectory = argv[++i];
+        else if (arg == "--micro-only") settings.render = false;
+        else if (arg == "--render-only") settings.micro = false;
+        else {
+            printUsage();
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    BenchSettings settings;
+    if (!parseSettings(argc, argv, settings)) return 1;
+    std::filesystem::create_directories(settings.outputDirectory);
+
+    if (settings.micro) runMicro(settings);
+    if (settings.render) runRenders(settings);
+    if (!settings.jsonPath.empty()) writeJson(settings);
+    return 0;
+}